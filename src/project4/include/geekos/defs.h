@@ -24,6 +24,12 @@
 #define KERN_THREAD_OBJ (1024 * 1024)
 #define KERN_STACK (KERN_THREAD_OBJ + 4096)
 
+/*
+ * Page below 1MB where application processors start executing
+ * (see smpboot.asm).  Keep this up to date with defs.asm.
+ */
+#define AP_TRAMPOLINE_ADDR 0x7000
+
 /*
  * Address where kernel is loaded
  */
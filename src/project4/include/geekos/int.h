@@ -19,6 +19,9 @@
 #include <geekos/kassert.h>
 #include <geekos/ktypes.h>
 #include <geekos/defs.h>
+#ifdef INTR_TRACE
+#  include <geekos/intrtrace.h>
+#endif
 
 /*
  * This struct reflects the contents of the stack when
@@ -100,6 +103,26 @@ void Init_Interrupts(void);
  */
 bool Interrupts_Enabled(void);
 
+/*
+ * Hooks for the interrupts-disabled latency tracer.
+ */
+#ifdef INTR_TRACE
+#  define INTR_TRACE_OFF() Intr_Trace_Off()
+#  define INTR_TRACE_ON() Intr_Trace_On()
+#else
+#  define INTR_TRACE_OFF() do { } while (0)
+#  define INTR_TRACE_ON() do { } while (0)
+#endif
+
+/*
+ * The kernel lock.  Once the application processors run threads,
+ * a CPU holds it exactly while it has interrupts disabled, so that
+ * disabling interrupts still excludes all other kernel code that
+ * does the same, on every CPU.  See smp.c.
+ */
+void Lock_Kernel(void);
+void Unlock_Kernel(void);
+
 /*
  * Block interrupts.
  */
@@ -111,6 +134,8 @@ static __inline__ void __Disable_Interrupts(void)
 do {					\
     KASSERT(Interrupts_Enabled());	\
     __Disable_Interrupts();		\
+    Lock_Kernel();			\
+    INTR_TRACE_OFF();			\
 } while (0)
 
 /*
@@ -123,9 +148,28 @@ static __inline__ void __Enable_Interrupts(void)
 #define Enable_Interrupts()		\
 do {					\
     KASSERT(!Interrupts_Enabled());	\
+    INTR_TRACE_ON();			\
+    Unlock_Kernel();			\
     __Enable_Interrupts();		\
 } while (0)
 
+/*
+ * Unblock interrupts and wait for the next one.
+ * The sti only takes effect after the following instruction, so
+ * an interrupt cannot slip in between the two and be missed.
+ */
+static __inline__ void __Enable_Interrupts_And_Halt(void)
+{
+    __asm__ __volatile__ ("sti; hlt");
+}
+#define Enable_Interrupts_And_Halt()	\
+do {					\
+    KASSERT(!Interrupts_Enabled());	\
+    INTR_TRACE_ON();			\
+    Unlock_Kernel();			\
+    __Enable_Interrupts_And_Halt();	\
+} while (0)
+
 /*
  * Dump interrupt state struct to screen
  */
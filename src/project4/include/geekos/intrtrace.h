@@ -0,0 +1,63 @@
+/*
+ * Interrupts-disabled latency tracer
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_INTRTRACE_H
+#define GEEKOS_INTRTRACE_H
+
+/*
+ * Flags for the SYS_INTRTRACE system call.
+ */
+#define INTR_TRACE_PRINT 1	/* print the report */
+#define INTR_TRACE_CLEAR 2	/* then forget the recorded spans */
+
+#if defined(GEEKOS)
+
+#include <geekos/ktypes.h>
+
+/*
+ * When the kernel is built with INTR_TRACE (see the Makefile),
+ * every transition of the interrupt flag made through int.h, and
+ * every interrupt entry and return in lowlevel.asm, is timestamped
+ * with the TSC.  The longest stretches with interrupts disabled
+ * are kept along with the code addresses where they started and
+ * ended, and Intr_Trace_Report() prints them with function names
+ * from the kernel symbol table.
+ */
+
+/*
+ * Number of worst offenders kept.  Each is a distinct pair of
+ * disabling and enabling sites.
+ */
+#define INTR_TRACE_WORST 16
+
+/* Times the TSC against the timer, so interrupts must be enabled */
+void Init_Intr_Trace(void);
+
+/*
+ * The hooks.  Call with interrupts disabled: Off right after
+ * disabling them, On right before enabling them.
+ */
+
+/* Interrupts were just disabled; the site is the caller */
+void Intr_Trace_Off(void);
+/* Interrupts are about to be enabled; the site is the caller */
+void Intr_Trace_On(void);
+
+/* Variants taking the site explicitly, for lowlevel.asm */
+void Intr_Trace_Off_At(ulong_t site);
+void Intr_Trace_On_At(ulong_t site);
+
+/*
+ * Reporting.  Call with interrupts enabled or disabled; they
+ * disable interrupts themselves while they touch the spans.
+ */
+void Intr_Trace_Report(void);
+void Intr_Trace_Reset(void);
+
+#endif  /* defined(GEEKOS) */
+
+#endif  /* GEEKOS_INTRTRACE_H */
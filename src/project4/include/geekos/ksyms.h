@@ -0,0 +1,31 @@
+/*
+ * Kernel symbol table
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_KSYMS_H
+#define GEEKOS_KSYMS_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * A kernel function (text symbol).
+ */
+struct Kernel_Symbol {
+    ulong_t addr;
+    const char* name;
+};
+
+/*
+ * Table of text symbols sorted by address.  It is generated from
+ * the kernel's own symbol map (kernel.syms) by scripts/genksyms
+ * and linked into the kernel in a second link pass.
+ */
+extern const struct Kernel_Symbol g_kernelSymbols[];
+extern const int g_numKernelSymbols;
+
+const char* Find_Kernel_Symbol(ulong_t addr, ulong_t* offset);
+
+#endif  /* GEEKOS_KSYMS_H */
@@ -11,8 +11,10 @@
 #define GEEKOS_KTHREAD_H
 
 #include <geekos/ktypes.h>
+#include <geekos/defs.h>
 #include <geekos/list.h>
 #include <geekos/bitset.h>
+#include <geekos/mlf.h>
 
 struct Kernel_Thread;
 struct User_Context;
@@ -41,6 +43,17 @@ DEFINE_LIST(All_Thread_List, Kernel_Thread);
 struct Kernel_Thread {
     ulong_t esp;			 /* offset 0 */
     volatile ulong_t numTicks;		 /* offset 4 */
+
+    /*
+     * Set when the thread should give up its CPU on the way back
+     * from the current interrupt.  Checked by the interrupt return
+     * code (Handle_Interrupt, in lowlevel.asm).
+     */
+    volatile int needReschedule;	 /* offset 8 */
+
+    /* The CPU the thread runs on, or whose run queue it waits in */
+    int cpu;
+
     int priority;
     DEFINE_LINK(Thread_Queue, Kernel_Thread);
     void* stackPage;
@@ -70,7 +83,46 @@ struct Kernel_Thread {
     int currentReadyQueue;
     bool blocked;
 
-    void* semaphores; /* Bitset of semaphores in use by this thread */
+    /* Ticks of CPU time used at the current MLF level */
+    int levelTicks;
+
+    /*
+     * MLF boost epoch the level above belongs to.  When the epoch has
+     * moved on, the thread was boosted and is really at level 0.
+     */
+    ulong_t boostEpoch;
+
+    /* Value of g_numTicks when the thread was last dispatched. */
+    ulong_t lastRunTime;
+
+    /*
+     * Fair-share scheduling: virtual runtime, and links in the
+     * leftist heap of runnable threads ordered by it.
+     */
+    ulong_t vruntime;
+    struct Kernel_Thread *fairLeft, *fairRight;
+    int fairRank;
+
+    /*
+     * Earliest-deadline-first real-time class; rtPeriod is zero
+     * for ordinary threads.  All times are in ticks.  Each period
+     * releases a job that may run for rtBudget ticks and should
+     * finish within rtDeadline ticks of its release.
+     */
+    int rtPeriod, rtBudget, rtDeadline;
+    int rtBudgetLeft;
+    ulong_t rtAbsDeadline;	/* deadline of the current job */
+    ulong_t rtNextRelease;	/* release time of the next job */
+    bool rtThrottled;		/* waiting for the next release */
+    bool rtJobDone;		/* current job called Real_Time_Wait_Period() */
+    int rtMisses;		/* number of jobs that missed their deadline */
+
+    /*
+     * System calls made, and TSC cycles spent in them; see sysstat.c.
+     * The child totals come from the threads this one has joined.
+     */
+    ulong_t syscallCount, childSyscallCount;
+    unsigned long long syscallCycles, childSyscallCycles;
 };
 
 /*
@@ -104,12 +156,31 @@ typedef void (*Thread_Start_Func)(ulong_t arg);
 /*
  * Number of ready queue levels.
  */
-#define MAX_QUEUE_LEVEL 4
+#define MAX_QUEUE_LEVEL MLF_LEVELS
+
+/*
+ * Fair-share scheduling.  Every tick a thread runs adds
+ * FAIR_TICK_COST / weight to its virtual runtime, and the runnable
+ * thread with the smallest virtual runtime runs next, so threads get
+ * CPU time in proportion to their weights.  FAIR_TICK_COST is
+ * divisible by every weight.
+ */
+#define FAIR_TICK_COST 27720
+
+static __inline__ int Fair_Weight(int priority)
+{
+    if (priority < PRIORITY_IDLE)
+	priority = PRIORITY_IDLE;
+    if (priority > PRIORITY_HIGH)
+	priority = PRIORITY_HIGH;
+    return priority + 1;
+}
 
 /*
  * Scheduler operations.
  */
 void Init_Scheduler(void);
+void Start_AP_Scheduler(int cpu, void* stackPage) __attribute__ ((noreturn));
 struct Kernel_Thread* Start_Kernel_Thread(
     Thread_Start_Func startFunc,
     ulong_t arg,
@@ -127,6 +198,22 @@ void Exit(int exitCode) __attribute__ ((noreturn));
 int Join(struct Kernel_Thread* kthread);
 struct Kernel_Thread* Lookup_Thread(int pid);
 
+/*
+ * Multi-level feedback policy.
+ */
+void MLF_Get_Params(struct MLF_Params* params);
+int MLF_Set_Params(const struct MLF_Params* params);
+void MLF_Tick(struct Kernel_Thread* kthread);
+int Get_Quantum(struct Kernel_Thread* kthread);
+
+/*
+ * Real-time (earliest deadline first) scheduling class.
+ */
+int Real_Time_Set_Params(int period, int budget, int deadline);
+int Real_Time_Wait_Period(void);
+void Real_Time_Tick(struct Kernel_Thread* kthread);
+void Real_Time_Release_Due(void);
+
 /*
  * Thread context switch function, defined in lowlevel.asm
  */
@@ -138,21 +225,24 @@ void Switch_To_Thread(struct Kernel_Thread*);
 void Wait(struct Thread_Queue* waitQueue);
 void Wake_Up(struct Thread_Queue* waitQueue);
 void Wake_Up_One(struct Thread_Queue* waitQueue);
+void Wake_Up_And_Switch(struct Thread_Queue* waitQueue);
+void Wake_Thread_And_Switch(struct Kernel_Thread* kthread);
+void Requeue_One(struct Thread_Queue* waitQueue, struct Thread_Queue* target);
 
 /*
  * Pointer to currently executing thread.
+ * The first word of every kernel stack page points to the thread
+ * that owns the stack (see Init_Thread()), so each CPU finds its
+ * current thread from its stack pointer.
  */
-extern struct Kernel_Thread* g_currentThread;
-
-/*
- * Boolean flag indicating that we need to choose a new runnable thread.
- */
-extern int g_needReschedule;
+static __inline__ struct Kernel_Thread* Current_Thread(void)
+{
+    ulong_t esp;
 
-/*
- * Boolean flag indicating that preemption should be disabled.
- */
-extern volatile int g_preemptionDisabled;
+    __asm__ ("movl %%esp, %0" : "=r" (esp));
+    return *((struct Kernel_Thread**) (esp & ~(PAGE_SIZE - 1)));
+}
+#define g_currentThread (Current_Thread())
 
 /*
  * Thread-local data information
@@ -0,0 +1,40 @@
+/*
+ * Multi-level feedback scheduling parameters
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_MLF_H
+#define GEEKOS_MLF_H
+
+/*
+ * Number of feedback levels; level 0 is served first.
+ */
+#define MLF_LEVELS 4
+
+/*
+ * Limits on the parameters, in ticks.
+ */
+#define MLF_MAX_QUANTUM 100
+#define MLF_MAX_DEMOTE_TICKS 10000
+#define MLF_MAX_BOOST_INTERVAL 100000
+
+/*
+ * Tunable parameters of the multi-level feedback policy.
+ * A thread runs at most quantum[level] ticks at a time.  It is moved
+ * down a level once it has used demoteTicks[level] ticks of CPU time
+ * at its level, however many times it blocked in between, so a thread
+ * can't stay on top by giving up the CPU just before its quantum ends.
+ * Every boostInterval ticks all threads are moved back to level 0,
+ * so that threads that turn interactive are served again, and
+ * threads in the lower levels don't starve.  The demotion threshold
+ * of the last level is not used.
+ */
+struct MLF_Params {
+    int quantum[MLF_LEVELS];
+    int demoteTicks[MLF_LEVELS];
+    int boostInterval;		/* 0 for no boost */
+};
+
+#endif  /* GEEKOS_MLF_H */
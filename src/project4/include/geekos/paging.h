@@ -89,8 +89,20 @@ typedef struct {
  */
 #define KINFO_PAGE_ON_DISK	0x4	 /* Page not present; contents in paging file */
 
+/*
+ * Memory-mapped device registers, such as the APICs, are mapped
+ * into the last 4MB of the kernel's half of the address space.
+ * Its page table is set up by Init_VM(), so every address space
+ * that copies the kernel's page directory entries sees them.
+ */
+#define DEVICE_VM_START 0x7FC00000
+#define DEVICE_VM_END   0x80000000
+
 void Init_VM(struct Boot_Info *bootInfo);
 void Init_Paging(void);
+void* Map_Device_Page(ulong_t paddr);
+
+extern pde_t* g_kernelPageDir;
 
 extern void Flush_TLB(void);
 extern void Set_PDBR(pde_t *pageDir);
@@ -1,22 +1,49 @@
+/*
+ * Named semaphores
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SEM_H
+#define GEEKOS_SEM_H
+
 #include <geekos/ktypes.h>
-#include <geekos/syscall.h>
 #include <geekos/kthread.h>
 #include <geekos/list.h>
 
-#define MAX_NUM_SEMAPHORES  20
 #define MAX_SEMAPHORE_NAME 25
 
+/* Most semaphores a process can have open at once */
+#define MAX_SEMAPHORE_HANDLES 4096
+
+struct Semaphore;
+struct User_Context;
+
+DEFINE_LIST(Semaphore_List, Semaphore);
+
 struct Semaphore {
     char name[MAX_SEMAPHORE_NAME+1]; /* '\0' terminated */
-    unsigned int resourcesCount;
-    bool available;
-    unsigned int refCounter;
-    struct Thread_Queue waitingThreads;
+    int count;
+    int refCount;		/* number of handles open on it */
+    struct Thread_Queue waitQueue;
+    DEFINE_LINK(Semaphore_List, Semaphore);	/* in the name hash table */
+};
+
+/*
+ * An entry in a process's table of open semaphores.  The handle
+ * returned to the process is the index of the entry.  Free entries
+ * are chained through nextFree.
+ */
+struct Semaphore_Handle {
+    struct Semaphore* sem;
+    int nextFree;
 };
 
-extern struct Semaphore g_Semaphores[MAX_NUM_SEMAPHORES];
+int Create_Semaphore(const char* name, int initCount);
+int P(int handle);
+int V(int handle);
+int Destroy_Semaphore(int handle);
+void Release_Semaphores(struct User_Context* context);
 
-extern int CreateSemaphore(char *name, int nameLenght, int ival);
-int P(int sem);
-int V(int sem);
-int DestroySemaphore(int sem);
+#endif  /* GEEKOS_SEM_H */
@@ -0,0 +1,81 @@
+/*
+ * Multiprocessor support
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SMP_H
+#define GEEKOS_SMP_H
+
+#include <geekos/ktypes.h>
+
+struct User_Context;
+
+/*
+ * Maximum number of processors we keep track of.
+ */
+#define MAX_CPUS 8
+
+/*
+ * Per-CPU data.  Entry 0 is always the bootstrap processor.
+ */
+struct CPU_Info {
+    int apicId;			/* local APIC id */
+    volatile bool online;	/* set by the CPU once it is running kernel code */
+    void* stack;		/* boot stack page of an application processor,
+				   then the stack of its idle thread */
+
+    /*
+     * User address space (LDT, and the TSS kernel stack of its
+     * thread) currently loaded on this CPU.  Kernel threads run in
+     * whatever address space is loaded, so it survives them.
+     */
+    struct User_Context* volatile activeUserContext;
+};
+
+extern struct CPU_Info g_cpuInfo[MAX_CPUS];
+extern int g_numCPUs;
+
+/*
+ * Set once interrupts are routed through the IO-APIC
+ * rather than the 8259 PICs.
+ */
+extern bool g_ioApicEnabled;
+
+/*
+ * Parameters passed to an application processor by Start_AP(),
+ * at AP_BOOT_PARAMS_OFFSET in the startup page.
+ * Keep this up to date with smpboot.asm.
+ */
+#define AP_BOOT_PARAMS_OFFSET 0xf00
+
+struct AP_Boot_Params {
+    ushort_t gdtLimit;		/* offset 0: kernel GDT pseudo-descriptor */
+    ulong_t gdtBase;
+    ushort_t idtLimit;		/* offset 6: kernel IDT pseudo-descriptor */
+    ulong_t idtBase;
+    ulong_t pageDir;		/* offset 12: kernel page directory */
+    ulong_t stack;		/* offset 16: initial stack pointer */
+    ulong_t entry;		/* offset 20: C function to call */
+    ulong_t cpu;		/* offset 24: argument to entry */
+} __attribute__ ((packed));
+
+/*
+ * Interrupt vectors of the interprocessor interrupts.  IPI_TIMER_VEC
+ * passes the timer tick on to the application processors, and
+ * IPI_RESCHEDULE_VEC makes the receiving CPU choose a new thread.
+ */
+#define IPI_TIMER_VEC      0xf0
+#define IPI_RESCHEDULE_VEC 0xf1
+
+void Init_SMP(void);
+int Get_CPU_ID(void);
+
+void Send_IPI_To_CPU(int cpu, int vector);
+void Send_IPI_To_Others(int vector);
+
+void Local_APIC_EOI(void);
+void IO_APIC_Mask_IRQ(int irq, bool masked);
+
+#endif  /* GEEKOS_SMP_H */
@@ -0,0 +1,81 @@
+/*
+ * Spin locks
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SPINLOCK_H
+#define GEEKOS_SPINLOCK_H
+
+#include <geekos/ktypes.h>
+#include <geekos/int.h>
+
+/*
+ * Ticket lock.  A CPU takes the next ticket and spins until the
+ * owner count reaches it, so waiting CPUs get the lock in the
+ * order they asked for it.
+ *
+ * Disabling interrupts only excludes other code on the same CPU;
+ * state shared between CPUs must also be protected by a spin lock.
+ * A lock that interrupt handlers take must be acquired with
+ * Spin_Lock_Irq_Save(), or the handler could spin forever on a
+ * lock held by the code it interrupted.
+ */
+struct Spin_Lock {
+    volatile ushort_t owner;
+    volatile ushort_t next;
+};
+
+#define SPIN_LOCK_INITIALIZER { 0, 0 }
+
+static __inline__ void Spin_Lock_Init(struct Spin_Lock* lock)
+{
+    lock->owner = 0;
+    lock->next = 0;
+}
+
+static __inline__ void Spin_Lock(struct Spin_Lock* lock)
+{
+    ushort_t ticket = 1;
+
+    __asm__ __volatile__ (
+	"lock; xaddw %0, %1"
+	: "+r" (ticket), "+m" (lock->next)
+	:
+	: "memory"
+    );
+    while (lock->owner != ticket)
+	__asm__ __volatile__ ("pause" : : : "memory");
+}
+
+static __inline__ void Spin_Unlock(struct Spin_Lock* lock)
+{
+    /* Only the holder writes owner, so a plain increment is enough */
+    __asm__ __volatile__ (
+	"incw %0"
+	: "+m" (lock->owner)
+	:
+	: "memory"
+    );
+}
+
+/*
+ * Acquire a spin lock with local interrupts disabled.
+ * Returns the previous interrupt state, which must be passed
+ * to Spin_Unlock_Irq_Restore().
+ */
+static __inline__ bool Spin_Lock_Irq_Save(struct Spin_Lock* lock)
+{
+    bool iflag = Begin_Int_Atomic();
+    Spin_Lock(lock);
+    return iflag;
+}
+
+static __inline__ void Spin_Unlock_Irq_Restore(struct Spin_Lock* lock, bool iflag)
+{
+    Spin_Unlock(lock);
+    End_Int_Atomic(iflag);
+}
+
+#endif  /* GEEKOS_SPINLOCK_H */
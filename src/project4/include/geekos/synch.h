@@ -27,6 +27,7 @@ struct Mutex {
 
 struct Condition {
     struct Thread_Queue waitQueue;
+    struct Mutex* mutex;	/* mutex passed to the last Cond_Wait() */
 };
 
 void Mutex_Init(struct Mutex* mutex);
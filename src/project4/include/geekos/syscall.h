@@ -53,6 +53,14 @@ enum {
     SYS_P,		 /* P (acquire semaphore) system call  */
     SYS_V,		 /* V (release semaphore) system call  */
     SYS_DESTROYSEMAPHORE,  /* Destroy semaphore system call  */
+    SYS_INTRTRACE,	 /* Interrupt latency report system call */
+    SYS_SYSCALLSTAT,	 /* Get system call statistics system call */
+    SYS_PROCSTAT,	 /* Get process system call totals system call */
+    SYS_MLFPARAMS,	 /* Get/set multi-level feedback parameters system call */
+    SYS_SWITCHSTAT,	 /* Get address space switch statistics system call */
+    SYS_MLFLEVEL,	 /* Get multi-level feedback level system call */
+    SYS_SETREALTIME,	 /* Set real-time scheduling parameters system call */
+    SYS_WAITPERIOD,	 /* Wait for next real-time period system call */
 };
 
 /*
@@ -0,0 +1,75 @@
+/*
+ * System call statistics
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SYSSTAT_H
+#define GEEKOS_SYSSTAT_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * Number of buckets in a latency histogram.
+ * Bucket n counts calls that took 2^n to 2^(n+1)-1 TSC cycles;
+ * bucket 0 also counts calls that took 0 cycles.
+ */
+#define SYSCALL_HIST_BUCKETS 32
+
+/*
+ * Statistics for one system call, over all processes.
+ * Times are measured around the call in Syscall_Handler(), so a
+ * call that blocks (Wait, P, Get_Key) includes the time it slept.
+ */
+struct Syscall_Stat {
+    ulong_t count;		/* calls made, including ones that never returned */
+    ulong_t numReturned;	/* calls that returned, which the times cover */
+    unsigned long long cycles;	/* total cycles */
+    ulong_t maxCycles;
+    ulong_t hist[SYSCALL_HIST_BUCKETS];
+};
+
+/*
+ * System call totals of one process.  The child totals are those
+ * of the children it has waited for, and their children.
+ */
+struct Process_Syscall_Stat {
+    ulong_t count;
+    unsigned long long cycles;
+    ulong_t childCount;
+    unsigned long long childCycles;
+};
+
+/*
+ * Returns to user mode, and how many of them loaded the user
+ * address space, with the cycles the loads took.  Comparing a kernel
+ * built with LAZY_USER_SWITCH=no, which loads it on every return,
+ * shows what skipping the reload saves.
+ */
+struct Switch_Stat {
+    ulong_t numSwitches;
+    ulong_t numReloads;
+    unsigned long long reloadCycles;
+    ulong_t maxReloadCycles;
+};
+
+#if defined(GEEKOS)
+
+struct Kernel_Thread;
+
+/*
+ * Largest number of system calls statistics are kept for.
+ */
+#define MAX_SYSCALL_STATS 64
+
+unsigned long long Syscall_Stat_Enter(int syscallNum);
+void Syscall_Stat_Leave(int syscallNum, unsigned long long start);
+void Syscall_Stat_Join(struct Kernel_Thread* kthread);
+
+int Syscall_Stat_Get(int syscallNum, struct Syscall_Stat* stat);
+void Syscall_Stat_Get_Process(struct Kernel_Thread* kthread, struct Process_Syscall_Stat* stat);
+
+#endif  /* defined(GEEKOS) */
+
+#endif  /* GEEKOS_SYSSTAT_H */
@@ -0,0 +1,21 @@
+/*
+ * Time stamp counter
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_TSC_H
+#define GEEKOS_TSC_H
+
+/*
+ * Read the processor's cycle counter.
+ */
+static __inline__ unsigned long long Read_TSC(void)
+{
+    unsigned long long tsc;
+    __asm__ __volatile__ ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+#endif  /* GEEKOS_TSC_H */
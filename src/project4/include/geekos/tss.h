@@ -84,6 +84,7 @@ struct TSS {
 };
 
 void Init_TSS(void);
+void Init_AP_TSS(int cpu);
 void Set_Kernel_Stack_Pointer(ulong_t esp0);
 
 #endif  /* GEEKOS_TSS_H */
@@ -17,6 +17,7 @@
 #include <geekos/paging.h>
 
 struct File;
+struct Semaphore_Handle;
 
 /* Number of files user process can have open. */
 #define USER_MAX_FILES		10
@@ -72,13 +73,15 @@ struct User_Context {
      */
     int refCount;
 
-#if 0
-    int *semaphores;
-#endif
+    /* Open semaphores, indexed by handle; see sem.c */
+    struct Semaphore_Handle* semHandles;
+    int numSemHandles;		/* size of the table */
+    int freeSemHandle;		/* first free entry, or -1 */
 };
 
 struct Kernel_Thread;
 struct Interrupt_State;
+struct Switch_Stat;
 
 /*
  * Common routines: these are in user.c
@@ -88,6 +91,7 @@ void Attach_User_Context(struct Kernel_Thread* kthread, struct User_Context* con
 void Detach_User_Context(struct Kernel_Thread* kthread);
 int Spawn(const char *program, const char *command, struct Kernel_Thread **pThread);
 void Switch_To_User_Context(struct Kernel_Thread* kthread, struct Interrupt_State* state);
+void Get_Switch_Stat(struct Switch_Stat* stat);
 
 /*
  * Implementation routines: these are in userseg.c or uservm.c
@@ -0,0 +1,19 @@
+/*
+ * Kernel statistics system calls
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef KSTAT_H
+#define KSTAT_H
+
+#include <geekos/intrtrace.h>
+#include <geekos/sysstat.h>
+
+int Intr_Latency(int flags);
+int Get_Syscall_Stat(int syscallNum, struct Syscall_Stat* stat);
+int Get_Process_Syscall_Stat(int pid, struct Process_Syscall_Stat* stat);
+int Get_Switch_Stat(struct Switch_Stat* stat);
+
+#endif  /* KSTAT_H */
@@ -11,8 +11,14 @@
 #ifndef SCHED_H
 #define SCHED_H
 
+#include <geekos/mlf.h>
+
 int Set_Scheduling_Policy(int policy, int quantum);
 int Get_Time_Of_Day(void);
+int Set_Real_Time(int period, int budget, int deadline);
+int Wait_Next_Period(void);
+int MLF_Params(const struct MLF_Params *params, struct MLF_Params *oldParams);
+int Get_MLF_Level(void);
 
 #endif  /* SCHED_H */
 
@@ -80,4 +80,8 @@ KERNEL_DS equ 2<<3	; kernel data segment is GDT entry 2
 KERN_THREAD_OBJ equ (1024*1024)
 KERN_STACK equ KERN_THREAD_OBJ + 4096
 
+; Page below 1MB where application processors start executing.
+; Keep this up to date with defs.h.
+AP_TRAMPOLINE_ADDR equ 0x7000
+
 %endif
@@ -11,6 +11,7 @@
 #include <geekos/segment.h>
 #include <geekos/int.h>
 #include <geekos/tss.h>
+#include <geekos/smp.h>
 #include <geekos/gdt.h>
 
 /*
@@ -23,9 +24,10 @@ extern void Load_GDTR(ushort_t* limitAndBase);
  * ---------------------------------------------------------------------- */
 
 /*
- * Number of entries in the kernel GDT.
+ * Number of entries in the kernel GDT, with room for
+ * the TSS of each application processor.
  */
-#define NUM_GDT_ENTRIES 16
+#define NUM_GDT_ENTRIES (16 + MAX_CPUS - 1)
 
 /*
  * This is the kernel's global descriptor table.
@@ -0,0 +1,223 @@
+/*
+ * Interrupts-disabled latency tracer
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/int.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/timer.h>
+#include <geekos/ksyms.h>
+#include <geekos/tsc.h>
+#include <geekos/intrtrace.h>
+
+/*
+ * NOTES:
+ * - Spans are measured per processor, not per thread: a thread
+ *   that disables interrupts and switches to another thread ends
+ *   its span when the other thread (or the iret into it) turns
+ *   interrupts back on.
+ * - The tracer state is shared by all processors.  That is safe
+ *   because the tracer only runs while the kernel lock is held:
+ *   spans start just after the lock is taken and end just before
+ *   it is released (see smp.c).
+ * - With more than one processor online, a CPU holds the kernel
+ *   lock exactly while it has interrupts disabled, and only one
+ *   CPU holds it at a time.  So spans measure how long the kernel
+ *   lock is held, not how long each CPU runs with interrupts off.
+ * - Durations are kept in 32 bits; a span longer than that
+ *   is recorded as 0xffffffff cycles.
+ */
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+/*
+ * A stretch of code run with interrupts disabled, identified by
+ * where interrupts were disabled and where they were enabled again.
+ */
+struct Intr_Span {
+    ulong_t offSite;
+    ulong_t onSite;
+    ulong_t maxCycles;		/* longest time seen between the two sites */
+    ulong_t count;
+};
+
+static struct Intr_Span s_worst[INTR_TRACE_WORST];
+static int s_numWorst;
+
+/* Total number of spans traced */
+static ulong_t s_numSpans;
+
+/* The span in progress, if any */
+static bool s_spanOpen;
+static unsigned long long s_spanStart;
+static ulong_t s_spanSite;
+
+/* TSC rate, measured by Init_Intr_Trace() */
+static ulong_t s_cyclesPerTick;
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+static void Record_Span(ulong_t offSite, ulong_t onSite, ulong_t cycles)
+{
+    int i, shortest = 0;
+
+    ++s_numSpans;
+
+    for (i = 0; i < s_numWorst; ++i) {
+	struct Intr_Span* span = &s_worst[i];
+	if (span->offSite == offSite && span->onSite == onSite) {
+	    ++span->count;
+	    if (cycles > span->maxCycles)
+		span->maxCycles = cycles;
+	    return;
+	}
+	if (span->maxCycles < s_worst[shortest].maxCycles)
+	    shortest = i;
+    }
+
+    /* New pair of sites: take a free slot, or evict the shortest entry */
+    if (s_numWorst < INTR_TRACE_WORST)
+	i = s_numWorst++;
+    else if (cycles > s_worst[shortest].maxCycles)
+	i = shortest;
+    else
+	return;
+
+    s_worst[i].offSite = offSite;
+    s_worst[i].onSite = onSite;
+    s_worst[i].maxCycles = cycles;
+    s_worst[i].count = 1;
+}
+
+static void Print_Site(ulong_t site)
+{
+    ulong_t offset;
+    const char* name = Find_Kernel_Symbol(site, &offset);
+
+    if (name != 0)
+	Print("%s+0x%lx", name, offset);
+    else
+	Print("0x%08lx", site);
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Measure the TSC rate against the timer.
+ * Must be called after the timer is set up, with interrupts enabled.
+ */
+void Init_Intr_Trace(void)
+{
+    ulong_t tick;
+    unsigned long long start;
+
+    KASSERT(Interrupts_Enabled());
+
+    /* Start on a tick boundary */
+    tick = g_numTicks;
+    while (g_numTicks == tick)
+	;
+    start = Read_TSC();
+    tick = g_numTicks;
+    while (g_numTicks == tick)
+	;
+    s_cyclesPerTick = (ulong_t) (Read_TSC() - start);
+
+    Print("Interrupt latency tracing enabled: %lu TSC cycles per tick, %d symbols\n",
+	s_cyclesPerTick, g_numKernelSymbols);
+}
+
+void Intr_Trace_Off_At(ulong_t site)
+{
+    /*
+     * If a span is already open, interrupts were turned on by code
+     * we don't see; start over.
+     */
+    s_spanOpen = true;
+    s_spanSite = site;
+    s_spanStart = Read_TSC();
+}
+
+void Intr_Trace_On_At(ulong_t site)
+{
+    unsigned long long cycles;
+
+    if (!s_spanOpen)
+	return;
+
+    cycles = Read_TSC() - s_spanStart;
+    s_spanOpen = false;
+    Record_Span(s_spanSite, site, cycles > 0xffffffffULL ? 0xffffffffUL : (ulong_t) cycles);
+}
+
+void Intr_Trace_Off(void)
+{
+    Intr_Trace_Off_At((ulong_t) __builtin_return_address(0));
+}
+
+void Intr_Trace_On(void)
+{
+    Intr_Trace_On_At((ulong_t) __builtin_return_address(0));
+}
+
+/*
+ * Print the worst interrupts-disabled spans seen, longest first.
+ * May be called with interrupts enabled or disabled.  The spans are
+ * copied with interrupts disabled, so an interrupt handler can't
+ * record one halfway through, and printed afterwards, so printing
+ * does not show up as a span of its own.
+ */
+void Intr_Trace_Report(void)
+{
+    struct Intr_Span worst[INTR_TRACE_WORST];
+    int numWorst, i, j;
+    ulong_t numSpans, cyclesPerTick;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    memcpy(worst, s_worst, sizeof(worst));
+    numWorst = s_numWorst;
+    numSpans = s_numSpans;
+    cyclesPerTick = s_cyclesPerTick;
+    End_Int_Atomic(iflag);
+
+    /* Sort longest first */
+    for (i = 1; i < numWorst; ++i) {
+	struct Intr_Span span = worst[i];
+	for (j = i; j > 0 && worst[j - 1].maxCycles < span.maxCycles; --j)
+	    worst[j] = worst[j - 1];
+	worst[j] = span;
+    }
+
+    Print("%lu interrupts-disabled spans traced (%lu cycles per tick)\n",
+	numSpans, cyclesPerTick);
+    Print("    cycles      count  disabled at -> enabled at\n");
+    for (i = 0; i < numWorst; ++i) {
+	Print("%10lu %10lu  ", worst[i].maxCycles, worst[i].count);
+	Print_Site(worst[i].offSite);
+	Print(" -> ");
+	Print_Site(worst[i].onSite);
+	Print("\n");
+    }
+}
+
+/*
+ * Forget all recorded spans.
+ * May be called with interrupts enabled or disabled.
+ */
+void Intr_Trace_Reset(void)
+{
+    bool iflag = Begin_Int_Atomic();
+    s_numWorst = 0;
+    s_numSpans = 0;
+    End_Int_Atomic(iflag);
+}
@@ -11,6 +11,7 @@
 #include <geekos/idt.h>
 #include <geekos/io.h>
 #include <geekos/irq.h>
+#include <geekos/smp.h>
 
 /* ----------------------------------------------------------------------
  * Private functions and data
@@ -58,6 +59,17 @@ ushort_t Get_IRQ_Mask(void)
 void Set_IRQ_Mask(ushort_t mask)
 {
     uchar_t oldMask, newMask;
+    int irq;
+
+    if (g_ioApicEnabled) {
+	/* The PICs stay masked; update the IO-APIC inputs instead */
+	for (irq = 0; irq < 16; ++irq) {
+	    if ((s_irqMask ^ mask) & (1 << irq))
+		IO_APIC_Mask_IRQ(irq, (mask & (1 << irq)) != 0);
+	}
+	s_irqMask = mask;
+	return;
+    }
 
     oldMask = MASTER(s_irqMask);
     newMask = MASTER(mask);
@@ -114,13 +126,19 @@ void Begin_IRQ(struct Interrupt_State* state)
 
 /*
  * Called by an IRQ handler to end the interrupt.
- * Sends an EOI command to the appropriate PIC(s).
+ * Sends an EOI command to the local APIC, or to the
+ * appropriate PIC(s) if the IO-APIC is not in use.
  */
 void End_IRQ(struct Interrupt_State* state)
 {
     int irq = state->intNum - FIRST_EXTERNAL_INT;
     uchar_t command = 0x60 | (irq & 0x7);
 
+    if (g_ioApicEnabled) {
+	Local_APIC_EOI();
+	return;
+    }
+
     if (irq < 8) {
 	/* Specific EOI to master PIC */
 	Out_Byte(0x20, command);
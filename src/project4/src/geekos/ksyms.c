@@ -0,0 +1,34 @@
+/*
+ * Kernel symbol table
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/ksyms.h>
+
+/*
+ * Find the function containing given code address.
+ * Returns the name of the function, and stores the offset of the
+ * address from its start in *offset; returns null if the address
+ * is below every known symbol.
+ */
+const char* Find_Kernel_Symbol(ulong_t addr, ulong_t* offset)
+{
+    int low = 0, high = g_numKernelSymbols;
+
+    /* Find the last symbol whose address is <= addr */
+    while (low < high) {
+	int mid = (low + high) / 2;
+	if (g_kernelSymbols[mid].addr <= addr)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    if (low == 0)
+	return 0;
+
+    *offset = addr - g_kernelSymbols[low - 1].addr;
+    return g_kernelSymbols[low - 1].name;
+}
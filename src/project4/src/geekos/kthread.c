@@ -17,25 +17,29 @@
 #include <geekos/kthread.h>
 #include <geekos/malloc.h>
 #include <geekos/user.h>
+#include <geekos/timer.h>
+#include <geekos/errno.h>
+#include <geekos/sysstat.h>
+#include <geekos/smp.h>
 
 
 /*
  * scheduling policies
  */
-#define RR  0
-#define MLF 1
+#define RR   0
+#define MLF  1
+#define FAIR 2
 
 
-#define TIME_TO_STARVATION_CHECK 100000
+/*
+ * Under MLF, a thread that has waited in a lower level queue
+ * for this many ticks without running is promoted one level.
+ */
+#define STARVATION_AGE_TICKS 100
 
-ulong_t starvation_mark= TIME_TO_STARVATION_CHECK + 1; //este es el valor que uso como marca para saber si un proceso se    
-                                                       //ejecuto desde el ultimo chequeo
 int g_currentSchedulingPolicy = RR;
 int g_prevSchedulingPolicy = RR;
 
-
-static struct Kernel_Thread *IdleThread;
-
 /* ----------------------------------------------------------------------
  * Private data
  * ---------------------------------------------------------------------- */
@@ -46,28 +50,100 @@ static struct Kernel_Thread *IdleThread;
 static struct All_Thread_List s_allThreadList;
 
 /*
- * Run queues.  0 is the highest priority queue.
+ * Number of FIFO queues in a run queue.
  */
-static struct Thread_Queue s_runQueue[MAX_QUEUE_LEVEL];
+#define NUM_RUN_QUEUES 32
 
 /*
- * Current thread.
+ * Run queue of one CPU.  Every runnable thread waits in the run
+ * queue of the CPU given by its cpu field, and each CPU only
+ * dispatches threads from its own, except that one with nothing
+ * but its idle thread to run steals a thread from the busiest
+ * other run queue.  A new thread starts on the least loaded CPU.
  */
-struct Kernel_Thread* g_currentThread;
+struct Run_Queue {
+    /*
+     * The current scheduling policy maps every runnable thread to
+     * one of these FIFO queues, and lower indices are always served
+     * first: under MLF the index is the feedback level (0 is the
+     * highest priority queue), under RR it is derived from the
+     * thread priority.
+     */
+    struct Thread_Queue queue[NUM_RUN_QUEUES];
+
+    /*
+     * Bit i is set iff queue[i] is not empty, so the best
+     * runnable thread can be found with a single bit scan.
+     */
+    ulong_t readyMask;
+
+    /*
+     * Under the fair-share policy, runnable threads other than the
+     * idle thread are kept in a leftist heap ordered by virtual
+     * runtime.  minVruntime follows the virtual runtime of the
+     * threads being dispatched; new and waking threads are placed
+     * relative to it.
+     */
+    struct Kernel_Thread* fairHeap;
+    ulong_t minVruntime;
+
+    /* Number of threads waiting here, not counting the idle thread */
+    int numQueued;
+
+    /* MLF boost epoch the queues were last boosted for */
+    ulong_t boostEpoch;
+
+    /*
+     * The CPU's idle thread, which only ever runs on it, and the
+     * thread it is running; null until the CPU schedules threads.
+     */
+    struct Kernel_Thread* idleThread;
+    struct Kernel_Thread* volatile running;
+};
+
+static struct Run_Queue s_runQueues[MAX_CPUS];
+
+/*
+ * How far behind minVruntime a thread that slept
+ * may be placed when it becomes runnable again.
+ */
+#define FAIR_SLEEP_CREDIT (2 * FAIR_TICK_COST)
+
+/*
+ * Real-time threads sit above every other policy.  Runnable ones wait
+ * in s_rtRunQueue, which all CPUs share, and the one with the
+ * earliest deadline runs first on whichever CPU schedules next;
+ * those that used up their budget or finished their job wait in
+ * s_rtThrottledQueue until their next release.  s_rtUtilization is
+ * the sum of budget/deadline over all admitted threads, in
+ * thousandths, and admission keeps it below RT_UTILIZATION_LIMIT so
+ * that ordinary threads are never locked out completely.
+ */
+static struct Thread_Queue s_rtRunQueue;
+static struct Thread_Queue s_rtThrottledQueue;
+static int s_rtUtilization;
+
+#define RT_UTILIZATION_LIMIT 900
+#define RT_MAX_PERIOD        (1 << 20)
 
 /*
- * Boolean flag indicating that we need to choose a new runnable thread.
- * It is checked by the interrupt return code (Handle_Interrupt,
- * in lowlevel.asm) before returning from an interrupt.
+ * Multi-level feedback parameters; see <geekos/mlf.h>.  Lower levels
+ * get longer quanta, and take more CPU time to leave.  The tables have
+ * MLF_LEVELS entries; keep up to date with mlf.h.
  */
-int g_needReschedule;
+static struct MLF_Params s_mlfParams = {
+    { 2, 4, 6, 8 },		/* quantum */
+    { 4, 12, 24, 0 },		/* demoteTicks */
+    90				/* boostInterval */
+};
 
 /*
- * Boolean flag indicating that preemption is disabled.
- * When set, external interrupts (such as the timer tick)
- * will not cause a new thread to be selected.
+ * Value of g_numTicks at the last MLF boost, and the number of boosts
+ * so far.  A thread whose boostEpoch lags behind s_mlfBoostEpoch is
+ * moved back to level 0 the next time it is queued or dispatched.
  */
-volatile int g_preemptionDisabled;
+static ulong_t s_mlfLastBoost;
+static ulong_t s_mlfBoostEpoch;
 
 /*
  * Queue of finished threads needing disposal,
@@ -89,6 +165,47 @@ static tlocal_destructor_t s_tlocalDestructors[MAX_TLOCAL_KEYS];
  * Private functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Is given thread the idle thread of its CPU?
+ */
+static __inline__ bool Is_Idle(struct Kernel_Thread* kthread)
+{
+    return kthread == s_runQueues[kthread->cpu].idleThread;
+}
+
+/*
+ * Is given CPU running its idle thread?
+ */
+static __inline__ bool Is_CPU_Idle(int cpu)
+{
+    struct Run_Queue* rq = &s_runQueues[cpu];
+    return rq->running != 0 && rq->running == rq->idleThread;
+}
+
+/*
+ * Pick the CPU a new thread starts on: the one with the fewest
+ * threads to run, counting the one it is running.
+ * Must be called with interrupts disabled!
+ */
+static int Least_Loaded_CPU(void)
+{
+    int cpu, load, best = 0, bestLoad = -1;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+	struct Run_Queue* rq = &s_runQueues[cpu];
+	if (rq->running == 0)
+	    continue;
+	load = rq->numQueued + (rq->running != rq->idleThread);
+	if (bestLoad < 0 || load < bestLoad) {
+	    best = cpu;
+	    bestLoad = load;
+	}
+    }
+    return best;
+}
+
 /*
  * Initialize a new Kernel_Thread.
  */
@@ -98,10 +215,14 @@ static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
     static int nextFreePid = 1;
 
     struct Kernel_Thread* owner = detached ? (struct Kernel_Thread*)0 : g_currentThread;
+    bool iflag;
 
     memset(kthread, '\0', sizeof(*kthread));
     kthread->stackPage = stackPage;
     kthread->esp = ((ulong_t) kthread->stackPage) + PAGE_SIZE;
+
+    /* Let the thread find itself from its stack; see Current_Thread() */
+    *((struct Kernel_Thread**) stackPage) = kthread;
     kthread->numTicks = 0;
     kthread->priority = priority;
     kthread->userContext = 0;
@@ -116,10 +237,23 @@ static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
 
     kthread->alive = true;
     Clear_Thread_Queue(&kthread->joinQueue);
-    kthread->pid = nextFreePid++;
 
     kthread->currentReadyQueue = 0;
+    kthread->levelTicks = 0;
     kthread->blocked = false;
+    kthread->lastRunTime = g_numTicks;
+
+    /*
+     * Threads may be created on several CPUs at once, with interrupts
+     * enabled; the pid counter and the run queues are only touched
+     * with the kernel lock held.
+     */
+    iflag = Begin_Int_Atomic();
+    kthread->pid = nextFreePid++;
+    kthread->boostEpoch = s_mlfBoostEpoch;
+    kthread->cpu = Least_Loaded_CPU();
+    kthread->vruntime = s_runQueues[kthread->cpu].minVruntime;
+    End_Int_Atomic(iflag);
 }
 
 /*
@@ -130,6 +264,7 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
 {
     struct Kernel_Thread* kthread;
     void* stackPage = 0;
+    bool iflag;
 
     /*
      * For now, just allocate one page each for the thread context
@@ -156,7 +291,9 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
     Init_Thread(kthread, stackPage, priority, detached);
 
     /* Add to the list of all threads in the system. */
+    iflag = Begin_Int_Atomic();
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, kthread);
+    End_Int_Atomic(iflag);
 
     return kthread;
 }
@@ -341,12 +478,10 @@ static void Setup_Kernel_Thread(
     /* Stack pointer */
     Push(kthread, (userContext->stackPointerAddr));
     /*
-     * The EFLAGS register will have all bits clear.
-     * The important constraint is that we want to have the IF
-     * bit clear, so that interrupts are disabled when the
-     * thread starts.
+     * User code always runs with interrupts enabled; the interrupt
+     * return code releases the kernel lock when it sees the IF bit.
      */
-    Push(kthread, 0UL); /* EFLAGS */
+    Push(kthread, EFLAGS_IF); /* EFLAGS */
 
     /* ushort_t csSelector */
     Push(kthread, userContext->csSelector);
@@ -377,15 +512,44 @@ static void Setup_Kernel_Thread(
 }
 
 
+/*
+ * Is there a thread the current CPU could run instead of its idle
+ * thread?  That is a real-time thread, one in its own run queue,
+ * or one it could steal.
+ * Must be called with interrupts disabled!
+ */
+static bool Have_Work(void)
+{
+    int cpu;
+
+    if (!Is_Thread_Queue_Empty(&s_rtRunQueue))
+	return true;
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+	if (s_runQueues[cpu].numQueued > 0)
+	    return true;
+    }
+    return false;
+}
+
 /*
  * This is the body of the idle thread.  Its job is to preserve
  * the invariant that a runnable thread always exists,
- * i.e., the run queue is never empty.
+ * i.e., the run queue is never empty.  Every CPU has one.
+ * It halts the CPU until the next interrupt when there is nothing
+ * else to run; a CPU that makes a thread runnable interrupts an
+ * idle one (see Make_Runnable()).
  */
 static void Idle(ulong_t arg)
 {
-    while (true)
-	Yield();
+    while (true) {
+	Disable_Interrupts();
+	if (Have_Work()) {
+	    Make_Runnable(g_currentThread);
+	    Schedule();
+	    Enable_Interrupts();
+	} else
+	    Enable_Interrupts_And_Halt();
+    }
 }
 
 /*
@@ -435,6 +599,526 @@ static void Reaper(ulong_t arg)
     }
 }
 
+/*
+ * Compare tick counts, allowing for wraparound.
+ */
+static __inline__ bool Ticks_Before(ulong_t a, ulong_t b)
+{
+    return (long) (a - b) < 0;
+}
+
+/*
+ * Find the real-time thread with the earliest deadline in given
+ * queue; among equal deadlines, the one that has waited longest.
+ * There are few real-time threads, so a scan is cheap enough.
+ */
+static struct Kernel_Thread* Find_Earliest_Deadline(struct Thread_Queue* queue)
+{
+    struct Kernel_Thread *kthread = Get_Front_Of_Thread_Queue(queue), *best = 0;
+
+    while (kthread != 0) {
+	if (best == 0 || Ticks_Before(kthread->rtAbsDeadline, best->rtAbsDeadline))
+	    best = kthread;
+	kthread = Get_Next_In_Thread_Queue(kthread);
+    }
+    return best;
+}
+
+/*
+ * Share of the CPU, in thousandths, reserved by a real-time
+ * thread with given budget and deadline.  Rounds up.
+ */
+static __inline__ int Real_Time_Density(int budget, int deadline)
+{
+    return (budget * 1000 + deadline - 1) / deadline;
+}
+
+/*
+ * Start the next job of a real-time thread.  A job that was not
+ * finished by the time of the next release missed its deadline.
+ * Releases that already lie in the past are skipped.
+ * Must be called with interrupts disabled!
+ */
+static void Real_Time_Release(struct Kernel_Thread* kthread)
+{
+    ulong_t release = kthread->rtNextRelease;
+
+    if (!kthread->rtJobDone)
+	++kthread->rtMisses;
+
+    if (g_numTicks - release >= (ulong_t) kthread->rtPeriod)
+	release += ((g_numTicks - release) / kthread->rtPeriod) * kthread->rtPeriod;
+
+    kthread->rtAbsDeadline = release + kthread->rtDeadline;
+    kthread->rtNextRelease = release + kthread->rtPeriod;
+    kthread->rtBudgetLeft = kthread->rtBudget;
+    kthread->rtJobDone = false;
+    kthread->rtThrottled = false;
+}
+
+/*
+ * Take a thread out of the real-time class and give back
+ * the CPU share it reserved.
+ * Must be called with interrupts disabled!
+ */
+static void Real_Time_Leave(struct Kernel_Thread* kthread)
+{
+    if (kthread->rtPeriod == 0)
+	return;
+
+    s_rtUtilization -= Real_Time_Density(kthread->rtBudget, kthread->rtDeadline);
+    KASSERT(s_rtUtilization >= 0);
+    kthread->rtPeriod = 0;
+    kthread->rtThrottled = false;
+}
+
+/*
+ * Return the index of the least significant set bit in mask,
+ * which must not be zero.
+ */
+static __inline__ int Find_First_Set(ulong_t mask)
+{
+    int bit;
+
+    KASSERT(mask != 0);
+    __asm__ ("bsfl %1, %0" : "=r" (bit) : "rm" (mask));
+    return bit;
+}
+
+/*
+ * Catch a thread up with the MLF boosts it missed: if there was a
+ * boost since it was last queued or dispatched, it starts afresh at
+ * level 0.
+ */
+static __inline__ void Apply_MLF_Boost(struct Kernel_Thread* kthread)
+{
+    if (kthread->boostEpoch != s_mlfBoostEpoch) {
+	kthread->currentReadyQueue = 0;
+	kthread->levelTicks = 0;
+	kthread->boostEpoch = s_mlfBoostEpoch;
+    }
+}
+
+/*
+ * Get the run queue a thread belongs on under the
+ * current scheduling policy.
+ */
+static __inline__ int Run_Queue_Index(struct Kernel_Thread* kthread)
+{
+    int priority;
+
+    if (g_currentSchedulingPolicy == MLF) {
+	/* The idle thread always waits in the last level */
+	if (Is_Idle(kthread))
+	    return MAX_QUEUE_LEVEL - 1;
+	Apply_MLF_Boost(kthread);
+	return kthread->currentReadyQueue;
+    }
+
+    /* Round robin: one queue per priority, highest priority first */
+    priority = kthread->priority;
+    if (priority < PRIORITY_IDLE)
+	priority = PRIORITY_IDLE;
+    if (priority > PRIORITY_HIGH)
+	priority = PRIORITY_HIGH;
+    return PRIORITY_HIGH - priority;
+}
+
+/*
+ * Compare virtual runtimes, allowing for wraparound.
+ */
+static __inline__ bool Vruntime_Before(ulong_t a, ulong_t b)
+{
+    return (long) (a - b) < 0;
+}
+
+static __inline__ int Fair_Rank(struct Kernel_Thread* kthread)
+{
+    return kthread != 0 ? kthread->fairRank : 0;
+}
+
+/*
+ * Merge two leftist heaps of threads ordered by virtual runtime.
+ * The recursion only follows right spines, whose length is
+ * logarithmic in the number of threads.
+ */
+static struct Kernel_Thread* Fair_Heap_Merge(struct Kernel_Thread* a, struct Kernel_Thread* b)
+{
+    struct Kernel_Thread* tmp;
+
+    if (a == 0)
+	return b;
+    if (b == 0)
+	return a;
+
+    if (Vruntime_Before(b->vruntime, a->vruntime)) {
+	tmp = a;
+	a = b;
+	b = tmp;
+    }
+
+    a->fairRight = Fair_Heap_Merge(a->fairRight, b);
+    if (Fair_Rank(a->fairLeft) < Fair_Rank(a->fairRight)) {
+	tmp = a->fairLeft;
+	a->fairLeft = a->fairRight;
+	a->fairRight = tmp;
+    }
+    a->fairRank = Fair_Rank(a->fairRight) + 1;
+
+    return a;
+}
+
+/*
+ * Add a thread to the fair-share heap of given run queue.  A thread
+ * that has been blocked for a long time is not allowed to bring back
+ * more than FAIR_SLEEP_CREDIT of unused CPU time.
+ */
+static void Fair_Heap_Insert(struct Run_Queue* rq, struct Kernel_Thread* kthread)
+{
+    if (Vruntime_Before(kthread->vruntime, rq->minVruntime - FAIR_SLEEP_CREDIT))
+	kthread->vruntime = rq->minVruntime - FAIR_SLEEP_CREDIT;
+
+    kthread->fairLeft = kthread->fairRight = 0;
+    kthread->fairRank = 1;
+    rq->fairHeap = Fair_Heap_Merge(rq->fairHeap, kthread);
+}
+
+/*
+ * Remove the thread with the smallest virtual runtime
+ * from the fair-share heap of given run queue.
+ */
+static struct Kernel_Thread* Fair_Heap_Pop(struct Run_Queue* rq)
+{
+    struct Kernel_Thread* kthread = rq->fairHeap;
+
+    KASSERT(kthread != 0);
+    rq->fairHeap = Fair_Heap_Merge(kthread->fairLeft, kthread->fairRight);
+    kthread->fairLeft = kthread->fairRight = 0;
+    --rq->numQueued;
+
+    return kthread;
+}
+
+/*
+ * Remove the thread with the smallest virtual runtime from the
+ * fair-share heap of given run queue, to be dispatched there.
+ */
+static struct Kernel_Thread* Fair_Heap_Remove_Min(struct Run_Queue* rq)
+{
+    struct Kernel_Thread* kthread = Fair_Heap_Pop(rq);
+
+    if (Vruntime_Before(rq->minVruntime, kthread->vruntime))
+	rq->minVruntime = kthread->vruntime;
+
+    return kthread;
+}
+
+/*
+ * Put a thread at the back of its run queue.
+ * Must be called with interrupts disabled!
+ */
+static __inline__ void Enqueue_Runnable(struct Kernel_Thread* kthread)
+{
+    struct Run_Queue* rq = &s_runQueues[kthread->cpu];
+    int index;
+
+    if (kthread->rtPeriod != 0) {
+	Enqueue_Thread(kthread->rtThrottled ? &s_rtThrottledQueue : &s_rtRunQueue, kthread);
+	return;
+    }
+
+    if (!Is_Idle(kthread))
+	++rq->numQueued;
+
+    if (g_currentSchedulingPolicy == FAIR && !Is_Idle(kthread)) {
+	Fair_Heap_Insert(rq, kthread);
+	return;
+    }
+
+    index = Run_Queue_Index(kthread);
+    KASSERT(index >= 0 && index < NUM_RUN_QUEUES);
+    Enqueue_Thread(&rq->queue[index], kthread);
+    rq->readyMask |= (1UL << index);
+}
+
+/*
+ * Take given thread out of one of the FIFO queues of a run queue.
+ * Must be called with interrupts disabled!
+ */
+static void Remove_From_Run_Queue(struct Run_Queue* rq, int index, struct Kernel_Thread* kthread)
+{
+    Remove_Thread(&rq->queue[index], kthread);
+    if (Is_Thread_Queue_Empty(&rq->queue[index]))
+	rq->readyMask &= ~(1UL << index);
+    if (!Is_Idle(kthread))
+	--rq->numQueued;
+}
+
+/*
+ * Remove the next thread to run from given run queue: the real-time
+ * thread with the earliest deadline if there is one, then the one
+ * with the least virtual runtime if the fair-share heap is in use,
+ * otherwise the thread at the front of the best nonempty FIFO queue.
+ * Returns null if no thread is runnable.
+ * Must be called with interrupts disabled!
+ */
+static struct Kernel_Thread* Dequeue_Runnable(struct Run_Queue* rq)
+{
+    struct Kernel_Thread* kthread;
+    int index;
+
+    if (!Is_Thread_Queue_Empty(&s_rtRunQueue)) {
+	kthread = Find_Earliest_Deadline(&s_rtRunQueue);
+	Remove_Thread(&s_rtRunQueue, kthread);
+	return kthread;
+    }
+
+    if (rq->fairHeap != 0)
+	return Fair_Heap_Remove_Min(rq);
+
+    if (rq->readyMask == 0)
+	return 0;
+
+    index = Find_First_Set(rq->readyMask);
+    kthread = Get_Front_Of_Thread_Queue(&rq->queue[index]);
+    Remove_From_Run_Queue(rq, index, kthread);
+
+    /*
+     * A boost may have carried the idle thread up with the rest of
+     * the last level; put it back there and look again.
+     */
+    if (Is_Idle(kthread) && index != Run_Queue_Index(kthread)) {
+	Enqueue_Runnable(kthread);
+	return Dequeue_Runnable(rq);
+    }
+
+    return kthread;
+}
+
+/*
+ * Find the run queue with the most threads waiting, other than
+ * given one.  Returns null if no other run queue has any.
+ * Must be called with interrupts disabled!
+ */
+static struct Run_Queue* Find_Busiest(struct Run_Queue* rq)
+{
+    struct Run_Queue *busiest = 0;
+    int cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+	struct Run_Queue* other = &s_runQueues[cpu];
+	if (other != rq && other->numQueued > 0 &&
+	    (busiest == 0 || other->numQueued > busiest->numQueued))
+	    busiest = other;
+    }
+    return busiest;
+}
+
+/*
+ * Steal a thread from the busiest other run queue, for a CPU that
+ * has nothing but its idle thread to run: the one that CPU would
+ * run next.  Its virtual runtime is moved over to the stealing run
+ * queue, to keep its place relative to the other threads.
+ * Returns null if there is nothing to steal.
+ * Must be called with interrupts disabled!
+ */
+static struct Kernel_Thread* Steal_Thread(struct Run_Queue* rq)
+{
+    struct Run_Queue* victim = Find_Busiest(rq);
+    struct Kernel_Thread* kthread;
+    ulong_t mask;
+    int index;
+
+    if (victim == 0)
+	return 0;
+
+    if (victim->fairHeap != 0) {
+	kthread = Fair_Heap_Pop(victim);
+	kthread->vruntime += rq->minVruntime - victim->minVruntime;
+	if (Vruntime_Before(rq->minVruntime, kthread->vruntime))
+	    rq->minVruntime = kthread->vruntime;
+	return kthread;
+    }
+
+    for (mask = victim->readyMask; mask != 0; mask &= mask - 1) {
+	index = Find_First_Set(mask);
+	kthread = Get_Front_Of_Thread_Queue(&victim->queue[index]);
+	if (Is_Idle(kthread))
+	    kthread = Get_Next_In_Thread_Queue(kthread);
+	if (kthread != 0) {
+	    Remove_From_Run_Queue(victim, index, kthread);
+	    return kthread;
+	}
+    }
+
+    KASSERT(false);  /* numQueued is out of step with the queues */
+    return 0;
+}
+
+/*
+ * Make given thread the one the given CPU runs.
+ * Must be called with interrupts disabled!
+ */
+static __inline__ void Dispatch(struct Kernel_Thread* kthread, int cpu)
+{
+    kthread->cpu = cpu;
+    kthread->needReschedule = false;
+    kthread->lastRunTime = g_numTicks;
+    s_runQueues[cpu].running = kthread;
+}
+
+/*
+ * Make given CPU choose a new thread to run.  Another CPU is
+ * sent an interrupt to do that.
+ * Must be called with interrupts disabled!
+ */
+static void Reschedule_CPU(int cpu)
+{
+    if (cpu == g_currentThread->cpu)
+	g_currentThread->needReschedule = true;
+    else
+	Send_IPI_To_CPU(cpu, IPI_RESCHEDULE_VEC);
+}
+
+/*
+ * A thread that was not running became runnable: if a CPU is idle,
+ * have it run the thread.  That is preferably the CPU whose run
+ * queue it is on; another one will steal it.
+ * Must be called with interrupts disabled!
+ */
+static void Wake_Idle_CPU(struct Kernel_Thread* kthread)
+{
+    int cpu;
+
+    if (kthread->rtPeriod != 0 && kthread->rtThrottled)
+	return;
+
+    if (Is_CPU_Idle(kthread->cpu)) {
+	Reschedule_CPU(kthread->cpu);
+	return;
+    }
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+	if (Is_CPU_Idle(cpu)) {
+	    Reschedule_CPU(cpu);
+	    return;
+	}
+    }
+}
+
+/*
+ * Move every runnable thread to the queue the current scheduling
+ * policy maps it to, on every CPU.  This is only needed when the
+ * policy changes, so it is the one place where the run queues are
+ * walked.
+ */
+static void Rebuild_Run_Queues(void)
+{
+    struct Thread_Queue runnable;
+    int cpu, i;
+
+    Clear_Thread_Queue(&runnable);
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+	struct Run_Queue* rq = &s_runQueues[cpu];
+	while (rq->fairHeap != 0)
+	    Enqueue_Thread(&runnable, Fair_Heap_Pop(rq));
+	for (i = 0; i < NUM_RUN_QUEUES; i++)
+	    Append_Thread_Queue(&runnable, &rq->queue[i]);
+	rq->readyMask = 0;
+	rq->numQueued = 0;
+    }
+
+    while (!Is_Thread_Queue_Empty(&runnable))
+	Enqueue_Runnable(Remove_From_Front_Of_Thread_Queue(&runnable));
+}
+
+/*
+ * Starvation avoidance for the MLF policy.  Queues are FIFO, so the
+ * thread at the front of a lower level queue is the one that has been
+ * waiting there longest; if it has not run for STARVATION_AGE_TICKS,
+ * promote it one level.  It starts afresh at its new level, so that it
+ * gets the full demoteTicks there before it moves down again.  Only the
+ * queue fronts are looked at, so the cost per scheduling decision is
+ * bounded by MAX_QUEUE_LEVEL.
+ */
+static void Age_Run_Queues(struct Run_Queue* rq)
+{
+    int i;
+
+    for (i = 1; i < MAX_QUEUE_LEVEL; i++) {
+	struct Kernel_Thread* kthread = Get_Front_Of_Thread_Queue(&rq->queue[i]);
+
+	/* The idle thread never moves; look at whoever is behind it */
+	if (kthread != 0 && Is_Idle(kthread))
+	    kthread = Get_Next_In_Thread_Queue(kthread);
+
+	if (kthread == 0 || g_numTicks - kthread->lastRunTime < STARVATION_AGE_TICKS)
+	    continue;
+
+	Remove_From_Run_Queue(rq, i, kthread);
+
+	KASSERT(kthread->currentReadyQueue == i);
+	--kthread->currentReadyQueue;
+	kthread->levelTicks = 0;
+	kthread->lastRunTime = g_numTicks;
+	Enqueue_Runnable(kthread);
+    }
+}
+
+/*
+ * Periodic boost for the MLF policy: move every thread back to
+ * level 0, and forget the CPU time it used at its level.  Only the
+ * boost epoch changes here, and each CPU splices the lower level
+ * queues of its run queue onto level 0 as they are when it next
+ * schedules (see Boost_Run_Queue()), so the cost does not grow with
+ * the number of threads; each thread picks up its new level from
+ * the epoch when it is next queued or dispatched.
+ */
+static void Boost_All_Threads(void)
+{
+    ++s_mlfBoostEpoch;
+    s_mlfLastBoost = g_numTicks;
+}
+
+/*
+ * Catch a run queue up with the last MLF boost.
+ */
+static void Boost_Run_Queue(struct Run_Queue* rq)
+{
+    int i;
+
+    for (i = 1; i < MAX_QUEUE_LEVEL; i++) {
+	Append_Thread_Queue(&rq->queue[0], &rq->queue[i]);
+	rq->readyMask &= ~(1UL << i);
+    }
+    if (!Is_Thread_Queue_Empty(&rq->queue[0]))
+	rq->readyMask |= 1UL;
+    rq->boostEpoch = s_mlfBoostEpoch;
+}
+
+/*
+ * Decide whether a thread may hand its CPU straight to a thread it
+ * has woken.  The woken thread must not be one the policy would run
+ * after the current thread: real-time threads are only ever chosen
+ * by deadline, and otherwise the woken thread must be in as good a
+ * run queue (or have no more virtual runtime) as the current one.
+ */
+static bool Can_Hand_Off(struct Kernel_Thread* current, struct Kernel_Thread* kthread)
+{
+    if (Is_Idle(current) || current->rtPeriod != 0 || kthread->rtPeriod != 0)
+	return false;
+
+    /* A pending policy change must go through Get_Next_Runnable() */
+    if (g_currentSchedulingPolicy != g_prevSchedulingPolicy)
+	return false;
+
+    /* Virtual runtimes only compare within one run queue */
+    if (g_currentSchedulingPolicy == FAIR)
+	return kthread->cpu == current->cpu &&
+	    !Vruntime_Before(current->vruntime, kthread->vruntime);
+
+    return Run_Queue_Index(kthread) <= Run_Queue_Index(current);
+}
+
 /*
  * Find the best (highest priority) thread in given
  * thread queue.  Returns null if queue is empty.
@@ -504,20 +1188,27 @@ static void Tlocal_Exit(struct Kernel_Thread* curr) {
 void Init_Scheduler(void)
 {
     struct Kernel_Thread* mainThread = (struct Kernel_Thread *) KERN_THREAD_OBJ;
+    struct Kernel_Thread* idleThread;
 
     /*
      * Create initial kernel thread context object and stack,
      * and make them current.
      */
     Init_Thread(mainThread, (void *) KERN_STACK, PRIORITY_NORMAL, true);
-    g_currentThread = mainThread;
+    KASSERT(mainThread->cpu == 0);
+    s_runQueues[0].running = mainThread;
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, mainThread);
 
     /*
-     * Create the idle thread.
+     * Create the idle thread of the bootstrap processor.  It must be
+     * known as the idle thread before it goes on the run queue.
      */
     /*Print("starting idle thread\n");*/
-    IdleThread = Start_Kernel_Thread(Idle, 0, PRIORITY_IDLE, true);
+    idleThread = Create_Thread(PRIORITY_IDLE, true);
+    KASSERT(idleThread != 0 && idleThread->cpu == 0);
+    Setup_Kernel_Thread(idleThread, Idle, 0);
+    s_runQueues[0].idleThread = idleThread;
+    Make_Runnable_Atomic(idleThread);
 
     /*
      * Create the reaper thread.
@@ -526,6 +1217,40 @@ void Init_Scheduler(void)
     Start_Kernel_Thread(Reaper, 0, PRIORITY_NORMAL, true);
 }
 
+/*
+ * Start scheduling threads on an application processor.  Called
+ * from AP_Main() with interrupts disabled, on the stack page the
+ * processor booted on: the code running on it becomes the idle
+ * thread of the CPU.
+ */
+void Start_AP_Scheduler(int cpu, void* stackPage)
+{
+    struct Run_Queue* rq = &s_runQueues[cpu];
+    struct Kernel_Thread* idleThread;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(cpu > 0 && cpu < MAX_CPUS);
+
+    idleThread = Alloc_Page();
+    KASSERT(idleThread != 0);
+    Init_Thread(idleThread, stackPage, PRIORITY_IDLE, true);
+    idleThread->cpu = cpu;
+    Add_To_Back_Of_All_Thread_List(&s_allThreadList, idleThread);
+
+    rq->idleThread = idleThread;
+    rq->minVruntime = s_runQueues[0].minVruntime;
+    rq->boostEpoch = s_mlfBoostEpoch;
+    Dispatch(idleThread, cpu);
+
+    Enable_Interrupts();
+    Idle(0);
+
+    /* Shouldn't get here */
+    KASSERT(false);
+    while (true)
+	;
+}
+
 /*
  * Start a kernel-mode-only thread, using given function as its body
  * and passing given argument as its parameter.  Returns pointer
@@ -599,14 +1324,11 @@ void Make_Runnable(struct Kernel_Thread* kthread)
 {
     KASSERT(!Interrupts_Enabled());
 
-    { int currentQ = kthread->currentReadyQueue;
-      
-      if(g_currentSchedulingPolicy == RR)currentQ=0;
-      else if(IdleThread->pid == kthread->pid)currentQ=MAX_QUEUE_LEVEL-1; //estoy en mlf
-      KASSERT(currentQ >= 0 && currentQ < MAX_QUEUE_LEVEL);
-      kthread->blocked = false;
-      Enqueue_Thread(&s_runQueue[currentQ], kthread);
-    }
+    kthread->blocked = false;
+    Enqueue_Runnable(kthread);
+
+    if (kthread != g_currentThread)
+	Wake_Idle_CPU(kthread);
 }
 
 /*
@@ -634,85 +1356,48 @@ struct Kernel_Thread* Get_Current(void)
  */
 struct Kernel_Thread* Get_Next_Runnable(void)
 {
-    struct Kernel_Thread * next = IdleThread;
-    static ulong_t counterStarvationCheck=0;
+    int cpu = g_currentThread->cpu;
+    struct Run_Queue* rq = &s_runQueues[cpu];
+    struct Kernel_Thread *next, *stolen;
     
-    KASSERT(g_currentSchedulingPolicy==RR || g_currentSchedulingPolicy==MLF); // schedule policy desconocido;
+    KASSERT(g_currentSchedulingPolicy==RR || g_currentSchedulingPolicy==MLF ||
+            g_currentSchedulingPolicy==FAIR); // schedule policy desconocido;
     
-    // si cambio de MLR a RR tengo que pegar las colas
+    /* Si cambio la politica, redistribuyo los hilos en las colas */
     if (g_currentSchedulingPolicy != g_prevSchedulingPolicy){
-        if (g_currentSchedulingPolicy == RR){
-            int i;
-            for (i=MAX_QUEUE_LEVEL-1; i>0; i--)
-            {
-                Append_Thread_Queue(&s_runQueue[i-1],&s_runQueue[i]);
-            }
-        }
-        else { //cambio de RR a MLF tengo todos los procesos en la primer cola, mando el Idle a la ultima
-            if(Is_Member_Of_Thread_Queue(&s_runQueue[0], IdleThread)) {
-                Remove_Thread(&s_runQueue[0], IdleThread);
-                Enqueue_Thread(&s_runQueue[MAX_QUEUE_LEVEL-1], IdleThread);
-            }
-        }
+        Rebuild_Run_Queues();
+        g_prevSchedulingPolicy = g_currentSchedulingPolicy;
     }
 
-    /*
-     * Round Robin
-     */
-    
-    if (g_currentSchedulingPolicy==RR){
-        next = Find_Best(&s_runQueue[0]);
-        if(next != NULL){
-            Remove_Thread(&s_runQueue[0], next);
-        }
+    if (g_currentSchedulingPolicy == MLF) {
+	/* Move everybody back to the top level every boostInterval ticks */
+	if (s_mlfParams.boostInterval != 0 &&
+	    g_numTicks - s_mlfLastBoost >= (ulong_t) s_mlfParams.boostInterval)
+	    Boost_All_Threads();
+	if (rq->boostEpoch != s_mlfBoostEpoch)
+	    Boost_Run_Queue(rq);
+
+	/* Promote threads starving in the lower MLF levels */
+	Age_Run_Queues(rq);
     }
 
     /*
-     * Multi-level Feedback
+     * Round Robin and Multi-level Feedback take the front of the best
+     * nonempty queue: the highest priority under Round Robin, the
+     * highest level under Multi-level Feedback.  The fair-share policy
+     * takes the thread with the least virtual runtime.
      */
-    else {
-        int i;
-        for(i=0; i<MAX_QUEUE_LEVEL; i++)
-        {
-            next = Get_Front_Of_Thread_Queue(&s_runQueue[i]);// no si usar (Find_Best(&s_runQueue[i])) porque me gusta mas ir rotando
-            if (next != NULL){
-                Remove_Thread(&s_runQueue[i], next);
-                break;
-            }
-        }
-    /* chequeo de procesos que no se ejecutan nunca */
-        ++counterStarvationCheck;
-        if(counterStarvationCheck > TIME_TO_STARVATION_CHECK){
-            counterStarvationCheck=0;//comoienza a contar de nuevo el tiempo para el proximo chequeo
-            struct Kernel_Thread* checked_Thread=Get_Front_Of_Thread_Queue(&s_runQueue[MAX_QUEUE_LEVEL-1]);
-            for(i=MAX_QUEUE_LEVEL-1; i>=0;--i)
-            {
-                while(checked_Thread!=NULL)
-                {
-                    if(checked_Thread==IdleThread)break; /* si es el Idle, no lo muevo */
-                    if(checked_Thread->numTicks== starvation_mark){ 
-                    /*si esta en -1 significa que no se ejecuto desde el ultimo chequeo, lo promociono un nivel de cola*/
-                        if(checked_Thread->currentReadyQueue>0){
-                            --checked_Thread->currentReadyQueue;
-                            Remove_Thread(&s_runQueue[i], checked_Thread);
-                            Enqueue_Thread(&s_runQueue[i-1], checked_Thread);
-                        }
-                    }
-                    else
-                        /* marco el hilo para saber si se ejecuto en el proximo chequeo */
-                        checked_Thread->numTicks=starvation_mark;               
-
-                    checked_Thread = Get_Next_In_Thread_Queue(checked_Thread);
-                }
-            }
-            
-        }
+    next = Dequeue_Runnable(rq);
+    KASSERT(next != NULL); /* the idle thread is always runnable */
+
+    /* Rather than idle, take over work from the busiest CPU */
+    if (Is_Idle(next) && (stolen = Steal_Thread(rq)) != 0) {
+	Enqueue_Runnable(next);
+	next = stolen;
     }
-    
-    next->numTicks=0; 
-    /* no esta mas en lowlevel, lo pongo en cero aca,es importante 
-    porque puede estar en marcado el chequeo de starvation
-    y contaria mal los tick de ejecucion*/
+    Apply_MLF_Boost(next);
+
+    Dispatch(next, cpu);
     return next;
 }
 
@@ -731,9 +1416,6 @@ void Schedule(void)
     /* Make sure interrupts really are disabled */
     KASSERT(!Interrupts_Enabled());
 
-    /* Preemption should not be disabled. */
-    KASSERT(!g_preemptionDisabled);
-
     /* Get next thread to run from the run queue */
     runnable = Get_Next_Runnable();
 
@@ -753,7 +1435,6 @@ void Schedule(void)
 void Yield(void)
 {
     Disable_Interrupts();
-    if(g_currentThread->pid != IdleThread->pid && g_currentThread->currentReadyQueue>0) --g_currentThread->currentReadyQueue;
     Make_Runnable(g_currentThread);
     Schedule();
     Enable_Interrupts();
@@ -777,6 +1458,9 @@ void Exit(int exitCode)
     /* Clean up any thread-local memory */
     Tlocal_Exit(g_currentThread);
 
+    /* Give back any real-time reservation */
+    Real_Time_Leave(current);
+
     /* Notify the thread's owner, if any */
     Wake_Up(&current->joinQueue);
 
@@ -818,6 +1502,9 @@ int Join(struct Kernel_Thread* kthread)
     /* Get thread exit code. */
     exitCode = kthread->exitCode;
 
+    /* Add its system calls to our child totals */
+    Syscall_Stat_Join(kthread);
+
     /* Release our reference to the thread */
     Detach_Thread(kthread);
 
@@ -858,6 +1545,238 @@ struct Kernel_Thread* Lookup_Thread(int pid)
 }
 
 
+/*
+ * Get the parameters of the multi-level feedback policy.
+ */
+void MLF_Get_Params(struct MLF_Params* params)
+{
+    bool iflag = Begin_Int_Atomic();
+    *params = s_mlfParams;
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Set the parameters of the multi-level feedback policy.  They take
+ * effect at the next tick; threads keep their levels, and the CPU
+ * time they have used at them.
+ * Returns 0 if successful, or EINVALID if a parameter is out of range.
+ */
+int MLF_Set_Params(const struct MLF_Params* params)
+{
+    bool iflag;
+    int i;
+
+    for (i = 0; i < MLF_LEVELS; ++i) {
+	if (params->quantum[i] < 1 || params->quantum[i] > MLF_MAX_QUANTUM)
+	    return EINVALID;
+	if (i < MLF_LEVELS - 1 &&
+	    (params->demoteTicks[i] < 1 || params->demoteTicks[i] > MLF_MAX_DEMOTE_TICKS))
+	    return EINVALID;
+    }
+    if (params->boostInterval < 0 || params->boostInterval > MLF_MAX_BOOST_INTERVAL)
+	return EINVALID;
+
+    iflag = Begin_Int_Atomic();
+    s_mlfParams = *params;
+    s_mlfLastBoost = g_numTicks;
+    End_Int_Atomic(iflag);
+
+    return 0;
+}
+
+/*
+ * Charge a tick to the running thread's MLF level, and move the
+ * thread down a level once it has used the CPU time allowed there.
+ * Called from the timer interrupt handler.
+ */
+void MLF_Tick(struct Kernel_Thread* kthread)
+{
+    int level = kthread->currentReadyQueue;
+
+    if (g_currentSchedulingPolicy != MLF || Is_Idle(kthread) || kthread->rtPeriod != 0)
+	return;
+    if (level == MAX_QUEUE_LEVEL - 1)
+	return;
+
+    if (++kthread->levelTicks >= s_mlfParams.demoteTicks[level]) {
+	++kthread->currentReadyQueue;
+	kthread->levelTicks = 0;
+	/* Threads still at the level it left come first */
+	kthread->needReschedule = true;
+    }
+}
+
+/*
+ * Get the number of ticks a thread may run before it is preempted.
+ */
+int Get_Quantum(struct Kernel_Thread* kthread)
+{
+    if (g_currentSchedulingPolicy == MLF && !Is_Idle(kthread) && kthread->rtPeriod == 0)
+	return s_mlfParams.quantum[kthread->currentReadyQueue];
+    return g_Quantum;
+}
+
+/*
+ * Put the current thread in the real-time scheduling class, or
+ * change its parameters.  All times are in ticks; a deadline of 0
+ * means the end of the period, and a period of 0 returns the thread
+ * to its ordinary scheduling policy.  The first job is released
+ * immediately.
+ * Returns 0 if successful, EINVALID if the parameters make no
+ * sense, or EBUSY if admitting the thread would overcommit the CPU.
+ */
+int Real_Time_Set_Params(int period, int budget, int deadline)
+{
+    struct Kernel_Thread* current = g_currentThread;
+    int density, reserved;
+    bool iflag;
+
+    if (period == 0) {
+	iflag = Begin_Int_Atomic();
+	Real_Time_Leave(current);
+	End_Int_Atomic(iflag);
+	return 0;
+    }
+
+    if (deadline == 0)
+	deadline = period;
+    if (period < 0 || period > RT_MAX_PERIOD || budget <= 0 ||
+	budget > deadline || deadline > period)
+	return EINVALID;
+    density = Real_Time_Density(budget, deadline);
+
+    iflag = Begin_Int_Atomic();
+
+    reserved = current->rtPeriod != 0
+	? Real_Time_Density(current->rtBudget, current->rtDeadline) : 0;
+    if (s_rtUtilization - reserved + density > RT_UTILIZATION_LIMIT) {
+	End_Int_Atomic(iflag);
+	return EBUSY;
+    }
+    s_rtUtilization += density - reserved;
+
+    current->rtPeriod = period;
+    current->rtBudget = budget;
+    current->rtDeadline = deadline;
+    current->rtBudgetLeft = budget;
+    current->rtAbsDeadline = g_numTicks + deadline;
+    current->rtNextRelease = g_numTicks + period;
+    current->rtThrottled = false;
+    current->rtJobDone = false;
+    current->rtMisses = 0;
+
+    End_Int_Atomic(iflag);
+
+    return 0;
+}
+
+/*
+ * Finish the current job of a real-time thread and wait
+ * for the release of the next one.
+ * Returns the number of deadlines the thread has missed so far,
+ * or EINVALID if it is not a real-time thread.
+ */
+int Real_Time_Wait_Period(void)
+{
+    struct Kernel_Thread* current = g_currentThread;
+    int misses;
+    bool iflag;
+
+    if (current->rtPeriod == 0)
+	return EINVALID;
+
+    iflag = Begin_Int_Atomic();
+
+    if (Ticks_Before(current->rtAbsDeadline, g_numTicks))
+	++current->rtMisses;
+    current->rtJobDone = true;
+
+    if (Ticks_Before(g_numTicks, current->rtNextRelease)) {
+	/* Sleep on the throttled queue until the tick handler releases us */
+	current->rtThrottled = true;
+	Make_Runnable(current);
+	Schedule();
+    } else {
+	Real_Time_Release(current);
+    }
+
+    misses = current->rtMisses;
+    End_Int_Atomic(iflag);
+
+    return misses;
+}
+
+/*
+ * Charge a tick to the budget of the thread running on this CPU,
+ * if it is a real-time thread, and throttle it once the budget is
+ * used up.
+ * Called from the timer interrupt handler.
+ */
+void Real_Time_Tick(struct Kernel_Thread* kthread)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (kthread->rtPeriod != 0 && !kthread->rtThrottled && --kthread->rtBudgetLeft <= 0) {
+	kthread->rtThrottled = true;
+	kthread->needReschedule = true;
+    }
+}
+
+/*
+ * Find a CPU for a real-time job that was just released, and make
+ * it reschedule: one that runs no real-time job if there is one,
+ * otherwise the one whose job has the latest deadline, if that is
+ * later than the new job's.
+ * Must be called with interrupts disabled!
+ */
+static void Preempt_For_Real_Time(struct Kernel_Thread* kthread)
+{
+    struct Kernel_Thread* running;
+    ulong_t latest = kthread->rtAbsDeadline;
+    int cpu, target = -1;
+
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+	running = s_runQueues[cpu].running;
+	if (running == 0)
+	    continue;
+	if (running->rtPeriod == 0 || running->rtThrottled) {
+	    target = cpu;
+	    break;
+	}
+	if (Ticks_Before(latest, running->rtAbsDeadline)) {
+	    latest = running->rtAbsDeadline;
+	    target = cpu;
+	}
+    }
+
+    if (target >= 0)
+	Reschedule_CPU(target);
+}
+
+/*
+ * Release the real-time jobs that are due, and have a CPU preempted
+ * for each, if one runs something less urgent.
+ * Called from the timer interrupt handler of the bootstrap processor.
+ */
+void Real_Time_Release_Due(void)
+{
+    struct Kernel_Thread *kthread, *next;
+
+    KASSERT(!Interrupts_Enabled());
+
+    kthread = Get_Front_Of_Thread_Queue(&s_rtThrottledQueue);
+    while (kthread != 0) {
+	next = Get_Next_In_Thread_Queue(kthread);
+	if (!Ticks_Before(g_numTicks, kthread->rtNextRelease)) {
+	    Remove_Thread(&s_rtThrottledQueue, kthread);
+	    Real_Time_Release(kthread);
+	    Enqueue_Thread(&s_rtRunQueue, kthread);
+	    Preempt_For_Real_Time(kthread);
+	}
+	kthread = next;
+    }
+}
+
 /*
  * Wait on given wait queue.
  * Must be called with interrupts disabled!
@@ -876,8 +1795,6 @@ void Wait(struct Thread_Queue* waitQueue)
 
     /* Add the thread to the wait queue. */
     current->blocked = true;
-    //el idle no hace wait, pero por si lo cambian...
-    if(current->pid != IdleThread->pid && current->currentReadyQueue>0) --current->currentReadyQueue;
     Enqueue_Thread(waitQueue, current);
 
     /* Find another thread to run. */
@@ -930,6 +1847,79 @@ void Wake_Up_One(struct Thread_Queue* waitQueue)
     }
 }
 
+/*
+ * Wake up the best thread waiting on given wait queue, and switch
+ * to it right away, handing it the rest of the current thread's
+ * quantum.  The current thread goes back on the run queue.
+ * This is for a thread passing work or a resource to a waiting
+ * partner, which would otherwise wait for the whole run queue.
+ * If switching would jump over the scheduling policy, this
+ * acts like Wake_Up_One().
+ * Interrupts must be disabled; must not be called from an
+ * interrupt handler.
+ */
+void Wake_Up_And_Switch(struct Thread_Queue* waitQueue)
+{
+    struct Kernel_Thread* best;
+
+    KASSERT(!Interrupts_Enabled());
+
+    best = Find_Best(waitQueue);
+    if (best == 0)
+	return;
+
+    Remove_Thread(waitQueue, best);
+    Wake_Thread_And_Switch(best);
+}
+
+/*
+ * Like Wake_Up_And_Switch(), for a thread the caller has already
+ * taken off its wait queue.  This lets the caller choose which
+ * waiter to wake.
+ * Interrupts must be disabled; must not be called from an
+ * interrupt handler.
+ */
+void Wake_Thread_And_Switch(struct Kernel_Thread* kthread)
+{
+    struct Kernel_Thread* current = g_currentThread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (!Can_Hand_Off(current, kthread)) {
+	Make_Runnable(kthread);
+	return;
+    }
+
+    /*
+     * The woken thread runs out the current quantum.  Switch_To_Thread()
+     * clears the current thread's count, so it starts a full one when
+     * it runs again.
+     */
+    kthread->blocked = false;
+    kthread->numTicks = current->numTicks;
+    Make_Runnable(current);
+    Dispatch(kthread, current->cpu);
+    Switch_To_Thread(kthread);
+}
+
+/*
+ * Move the thread Wake_Up_One() would wake from given wait queue
+ * to another one, without waking it.
+ * Interrupts must be disabled!
+ */
+void Requeue_One(struct Thread_Queue* waitQueue, struct Thread_Queue* target)
+{
+    struct Kernel_Thread* best;
+
+    KASSERT(!Interrupts_Enabled());
+
+    best = Find_Best(waitQueue);
+    if (best != 0) {
+	Remove_Thread(waitQueue, best);
+	Enqueue_Thread(target, best);
+    }
+}
+
 /*
  * Allocate a key for accessing thread-local data.
  */
@@ -23,6 +23,20 @@
 ; This is the size of the Interrupt_State struct in int.h
 INTERRUPT_STATE_SIZE equ 64
 
+; Offsets of fields in the Kernel_Thread struct in kthread.h.
+THREAD_ESP equ 0
+THREAD_NUM_TICKS equ 4
+THREAD_NEED_RESCHEDULE equ 8
+
+; Load a register with the current thread.  The first word of the
+; stack page points to the thread that owns it (see Current_Thread()
+; in kthread.h).
+%macro Get_Current_Thread 1
+	mov	%1, esp
+	and	%1, ~(4096-1)
+	mov	%1, [%1]
+%endmacro
+
 ; Save registers prior to calling a handler function.
 ; This must be kept up to date with:
 ;   - Interrupt_State struct in int.h
@@ -64,8 +78,9 @@ INTERRUPT_STATE_SIZE equ 64
 %macro Activate_User_Context 0
 	; If the new thread has a user context which is not the current
 	; one, activate it.
+	Get_Current_Thread eax
 	push    esp                     ; Interrupt_State pointer
-	push    dword [g_currentThread] ; Kernel_Thread pointer
+	push    eax                     ; Kernel_Thread pointer
 	call    Switch_To_User_Context
 	add     esp, 8                  ; clear 2 arguments
 %endmacro
@@ -75,6 +90,65 @@ INTERRUPT_STATE_SIZE equ 64
 ; registers have been saved.
 REG_SKIP equ (11*4)
 
+; Number of bytes between the top of the stack and the saved
+; eflags, after the registers have been saved.
+; This must be kept up to date with the Interrupt_State struct in int.h.
+EFLAGS_SKIP equ (REG_SKIP + 16)
+
+; The interrupt flag bit in the eflags register.
+EFLAGS_IF equ (1 << 9)
+
+; A CPU holds the kernel lock exactly while it has interrupts disabled
+; (see smp.c).  Take the lock on entry to an interrupt if the processor
+; turned interrupts off to deliver it, i.e., if they were on in the
+; interrupted code; otherwise the interrupted code holds it already.
+%macro Lock_Kernel_On_Entry 0
+	test	dword [esp+EFLAGS_SKIP], EFLAGS_IF
+	jz	%%done
+	call	Lock_Kernel
+%%done:
+%endmacro
+
+; Release the kernel lock if iret is about to turn interrupts
+; back on, i.e., if they are on in the saved eflags of the thread
+; being resumed.
+%macro Unlock_Kernel_On_Return 0
+	test	dword [esp+EFLAGS_SKIP], EFLAGS_IF
+	jz	%%done
+	call	Unlock_Kernel
+%%done:
+%endmacro
+
+%ifdef INTR_TRACE
+; Tell the interrupts-disabled latency tracer that the processor
+; turned off interrupts to deliver this one, if they were on in the
+; interrupted code.  The argument is a register (other than eax, ecx
+; or edx) holding the address of the C handler, which is recorded
+; as the place interrupts were disabled.
+%macro Trace_Interrupt_Entry 1
+	test	dword [esp+EFLAGS_SKIP], EFLAGS_IF
+	jz	%%done
+	push	%1
+	call	Intr_Trace_Off_At
+	add	esp, 4			; clear 1 argument
+%%done:
+%endmacro
+
+; Tell the tracer that iret is about to turn interrupts back on,
+; if they are on in the saved eflags of the thread being resumed.
+%macro Trace_Interrupt_Return 0
+	test	dword [esp+EFLAGS_SKIP], EFLAGS_IF
+	jz	%%done
+	call	Intr_Trace_On
+%%done:
+%endmacro
+%else
+%macro Trace_Interrupt_Entry 1
+%endmacro
+%macro Trace_Interrupt_Return 0
+%endmacro
+%endif
+
 ; Template for entry point code for interrupts that have
 ; an explicit processor-generated error code.
 ; The argument is the interrupt number.
@@ -104,15 +178,9 @@ align 8
 ; of C handler functions for interrupts.
 IMPORT g_interruptTable
 
-; Global variable pointing to context struct for current thread.
-IMPORT g_currentThread
-
-; Set to non-zero when we need to choose a new thread
-; in the interrupt return code.
-IMPORT g_needReschedule
-
-; Set to non-zero when preemption is disabled.
-IMPORT g_preemptionDisabled
+; The kernel lock.
+IMPORT Lock_Kernel
+IMPORT Unlock_Kernel
 
 ; This is the function that returns the next runnable thread.
 IMPORT Get_Next_Runnable
@@ -123,6 +191,12 @@ IMPORT Make_Runnable
 ; Function to activate a new user context (if needed).
 IMPORT Switch_To_User_Context
 
+%ifdef INTR_TRACE
+; Interrupts-disabled latency tracer hooks.
+IMPORT Intr_Trace_Off_At
+IMPORT Intr_Trace_On
+%endif
+
 ; Sizes of interrupt handler entry points for interrupts with
 ; and without error codes.  The code in idt.c uses this
 ; information to infer the layout of the table of interrupt
@@ -251,12 +325,16 @@ Handle_Interrupt:
 	mov	ds, ax
 	mov	es, ax
 
+	Lock_Kernel_On_Entry
+
 	; Get the address of the C handler function from the
 	; table of handler functions.
 	mov	eax, g_interruptTable	; get address of handler table
 	mov	esi, [esp+REG_SKIP]	; get interrupt number
 	mov	ebx, [eax+esi*4]	; get address of handler function
 
+	Trace_Interrupt_Entry ebx
+
 	; Call the handler.
 	; The argument passed is a pointer to an Interrupt_State struct,
 	; which describes the stack layout for all interrupts.
@@ -264,38 +342,35 @@ Handle_Interrupt:
 	call	ebx
 	add	esp, 4			; clear 1 argument
 
-	; If preemption is disabled, then the current thread
-	; keeps running.
-	cmp	[g_preemptionDisabled], dword 0
-	jne	.restore
-
 	; See if we need to choose a new thread to run.
-	cmp	[g_needReschedule], dword 0
+	; Get_Next_Runnable() clears the flag of the thread it picks.
+	Get_Current_Thread ebx
+	cmp	[ebx+THREAD_NEED_RESCHEDULE], dword 0
 	je	.restore
 
 	; Put current thread back on the run queue
-	push	dword [g_currentThread]
+	push	ebx
 	call	Make_Runnable
 	add	esp, 4			; clear 1 argument
 
 	; Save stack pointer in current thread context, and
 	; clear numTicks field.
-	mov	eax, [g_currentThread]
-	mov	[eax+0], esp		; esp field
-	mov	[eax+4], dword 0	; numTicks field
+	mov	[ebx+THREAD_ESP], esp
+	mov	[ebx+THREAD_NUM_TICKS], dword 0
 
-	; Pick a new thread to run, and switch to its stack
+	; Pick a new thread to run, and switch to its stack.
+	; That makes it the current thread.
 	call	Get_Next_Runnable
-	mov	[g_currentThread], eax
-	mov	esp, [eax+0]		; esp field
-
-	; Clear "need reschedule" flag
-	mov	[g_needReschedule], dword 0
+	mov	esp, [eax+THREAD_ESP]
 
 .restore:
 	; Activate the user context, if necessary.
 	Activate_User_Context
 
+	Trace_Interrupt_Return
+
+	Unlock_Kernel_On_Return
+
 	; Restore registers
 	Restore_Registers
 
@@ -347,25 +422,28 @@ Switch_To_Thread:
 	Save_Registers
 
 	; Save stack pointer in the thread context struct (at offset 0).
-	mov	eax, [g_currentThread]
-	mov	[eax+0], esp
+	Get_Current_Thread eax
+	mov	[eax+THREAD_ESP], esp
 
 	; Clear numTicks field in thread context, since this
 	; thread is being suspended.
-	mov	[eax+4], dword 0
+	mov	[eax+THREAD_NUM_TICKS], dword 0
 
 	; Load the pointer to the new thread context into eax.
 	; We skip over the Interrupt_State struct on the stack to
 	; get the parameter.
 	mov	eax, [esp+INTERRUPT_STATE_SIZE]
 
-	; Make the new thread current, and switch to its stack.
-	mov	[g_currentThread], eax
-	mov	esp, [eax+0]
+	; Switch to the stack of the new thread, which makes it current.
+	mov	esp, [eax+THREAD_ESP]
 
 	; Activate the user context, if necessary.
 	Activate_User_Context
 
+	Trace_Interrupt_Return
+
+	Unlock_Kernel_On_Return
+
 	; Restore general purpose and segment registers, and clear interrupt
 	; number and error code.
 	Restore_Registers
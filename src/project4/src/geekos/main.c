@@ -27,6 +27,8 @@
 #include <geekos/vfs.h>
 #include <geekos/user.h>
 #include <geekos/paging.h>
+#include <geekos/smp.h>
+#include <geekos/intrtrace.h>
 
 
 /*
@@ -68,6 +70,10 @@ void Main(struct Boot_Info* bootInfo)
     Init_Scheduler();
     Init_Traps();
     Init_Timer();
+    Init_SMP();
+#ifdef INTR_TRACE
+    Init_Intr_Trace();
+#endif
     Init_Keyboard();
     Init_DMA();
     Init_Floppy();
@@ -137,7 +137,8 @@ void Init_Mem(struct Boot_Info* bootInfo)
 
     /*
      * Memory looks like this:
-     * 0 - start: available (might want to preserve BIOS data area)
+     * 0 - start: available (might want to preserve BIOS data area),
+     *   except for the application processor startup page
      * start - end: kernel
      * end - ISA_HOLE_START: available
      * ISA_HOLE_START - ISA_HOLE_END: used by hardware (and ROM BIOS?)
@@ -148,7 +149,9 @@ void Init_Mem(struct Boot_Info* bootInfo)
      */
 
     Add_Page_Range(0, PAGE_SIZE, PAGE_UNUSED);
-    Add_Page_Range(PAGE_SIZE, KERNEL_START_ADDR, PAGE_AVAIL);
+    Add_Page_Range(PAGE_SIZE, AP_TRAMPOLINE_ADDR, PAGE_AVAIL);
+    Add_Page_Range(AP_TRAMPOLINE_ADDR, AP_TRAMPOLINE_ADDR + PAGE_SIZE, PAGE_ALLOCATED);
+    Add_Page_Range(AP_TRAMPOLINE_ADDR + PAGE_SIZE, KERNEL_START_ADDR, PAGE_AVAIL);
     Add_Page_Range(KERNEL_START_ADDR, kernEnd, PAGE_KERN);
     Add_Page_Range(kernEnd, ISA_HOLE_START, PAGE_AVAIL);
     Add_Page_Range(ISA_HOLE_START, ISA_HOLE_END, PAGE_HW);
@@ -27,6 +27,9 @@
  * Public data
  * ---------------------------------------------------------------------- */
 
+/* Page directory of the kernel, loaded when no user address space is */
+pde_t* g_kernelPageDir;
+
 /* ----------------------------------------------------------------------
  * Private functions/data
  * ---------------------------------------------------------------------- */
@@ -39,6 +42,13 @@
 int debugFaults = 0;
 #define Debug(args...) if (debugFaults) Print(args)
 
+/*
+ * Page table mapping DEVICE_VM_START to DEVICE_VM_END,
+ * and the next free page in it.
+ */
+static pte_t* s_devicePageTable;
+static ulong_t s_nextDeviceAddr = DEVICE_VM_START;
+
 
 void checkPaging()
 {
@@ -170,8 +180,17 @@ void Init_VM(struct Boot_Info *bootInfo)
         }
     }
 
+    /* Device registers get a page table of their own, shared by all address spaces */
+    KASSERT((ulong_t) bootInfo->memSizeKB * 1024 <= DEVICE_VM_START);
+    s_devicePageTable = (pte_t*)Alloc_Page();
+    memset(s_devicePageTable, '\0', PAGE_SIZE);
+    pageDir[PAGE_DIRECTORY_INDEX(DEVICE_VM_START)].present = 1;
+    pageDir[PAGE_DIRECTORY_INDEX(DEVICE_VM_START)].flags = VM_WRITE | VM_READ;
+    pageDir[PAGE_DIRECTORY_INDEX(DEVICE_VM_START)].pageTableBaseAddr = PAGE_ALLIGNED_ADDR(s_devicePageTable);
+
     /* Finally, let's enable paging and pray */
     /* Update: not enough faith, pray stronger */
+    g_kernelPageDir = pageDir;
     Enable_Paging(pageDir);
 
     /* It would be easy to blame this line for the death of my VM,
@@ -182,6 +201,34 @@ void Init_VM(struct Boot_Info *bootInfo)
 
 }
 
+/*
+ * Map a page of memory-mapped device registers, such as the
+ * local APIC, into the device area of the kernel's half of the
+ * address space, with caching disabled.  The mapping is the same
+ * in every address space.  Must be called after Init_VM().
+ * Returns the virtual address of the page.
+ */
+void* Map_Device_Page(ulong_t paddr)
+{
+    ulong_t vaddr = s_nextDeviceAddr;
+    pte_t* pte;
+
+    KASSERT((paddr & PAGE_MASK) == 0);
+    KASSERT(s_devicePageTable != 0);
+    KASSERT(vaddr < DEVICE_VM_END);
+
+    s_nextDeviceAddr += PAGE_SIZE;
+
+    pte = &s_devicePageTable[PAGE_TABLE_INDEX(vaddr)];
+    pte->present = 1;
+    pte->flags = VM_WRITE | VM_READ | VM_NOCACHE;
+    pte->pageBaseAddr = PAGE_ALLIGNED_ADDR(paddr);
+
+    Flush_TLB();
+
+    return (void*) vaddr;
+}
+
 /**
  * Initialize paging file data structures.
  * All filesystems should be mounted before this function
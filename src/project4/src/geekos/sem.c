@@ -1,154 +1,301 @@
+/*
+ * Named semaphores
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
 #include <geekos/sem.h>
 #include <geekos/ktypes.h>
 #include <geekos/string.h>
-#include <geekos/screen.h>
 #include <geekos/malloc.h>
 #include <geekos/kthread.h>
 #include <geekos/user.h>
 #include <geekos/errno.h>
-#include <geekos/bitset.h>
 #include <geekos/int.h>
 
+/*
+ * NOTES:
+ * - Semaphores are found by name through a hash table, and
+ *   processes refer to them by handles indexing a per-process
+ *   table, so no operation scans all semaphores.
+ * - A semaphore lives as long as some process has a handle on it;
+ *   creating it again by name while it lives opens another handle.
+ * - V() hands its unit straight to the thread that has waited
+ *   longest, rather than waking every waiter to race for it: the
+ *   count is only incremented when nobody waits, so a woken thread
+ *   owns the unit and does not check the count again.
+ */
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+/* Number of hash chains; must be a power of 2 */
+#define SEM_HASH_SIZE 1024
 
-/* Los semáforos */
-static struct Semaphore g_Semaphore[MAX_NUM_SEMAPHORES];
+/* Size of a process's handle table when it first opens a semaphore */
+#define SEM_HANDLES_INITIAL 8
 
-/* Funciones auxiliares */
-static int isSemaphoreCreated(char *namesem, int nameLength);
-static int getFreeSemaphore();
-/* static bool hasAccess(int sid); */
-static bool validateSID(int sid);
+IMPLEMENT_LIST(Semaphore_List, Semaphore);
 
+/* Semaphores by name; all zeroes is an empty chain */
+static struct Semaphore_List s_semHash[SEM_HASH_SIZE];
 
-int CreateSemaphore(char *name, int nameLength, int initCount)
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+static struct Semaphore_List* Hash_Chain(const char* name)
 {
-    int sid = 0;
-    int ret = -1;
-
-    /* Paranoico, soy entrypoint de userspace */
-    if (name==NULL || nameLength<=0 || initCount<0 ||
-        MAX_SEMAPHORE_NAME<nameLength ||
-        strnlen(name, MAX_SEMAPHORE_NAME)!=nameLength) {
-            return EINVALID;
-    }
+    ulong_t hash = 5381;
 
-    bool atomic = Begin_Int_Atomic();
-    sid = isSemaphoreCreated(name, nameLength);
-    Free(name);
-
-    /* sid es negativo si no fue creado, de lo contrario
-     * sid es el ID del semaforo ya creado
-     */
-    if (sid < 0) {
-        /* Semaforo ya creado */
-        g_Semaphore[sid].resourcesCount++;
-        Set_Bit(g_currentThread->semaphores, sid);
-        ret = sid;
-    }
+    while (*name != '\0')
+	hash = hash * 33 + (uchar_t) *name++;
+    return &s_semHash[hash & (SEM_HASH_SIZE - 1)];
+}
 
-    if (sid > 0) {
-        /* Semaforo no creado. Crear */
-        sid = getFreeSemaphore();
-        if (sid < 0) 
-            /* No hay semaforos disponibles nos vamos rapido */
-            return -1;
-
-        g_Semaphore[sid].available = false;
-        g_Semaphore[sid].resourcesCount++;
-        Set_Bit(g_currentThread->semaphores, sid);
-        ret = sid;
-    }
+static struct Semaphore* Lookup_Semaphore(struct Semaphore_List* chain, const char* name)
+{
+    struct Semaphore* sem;
 
-    End_Int_Atomic(atomic);
-    return ret;
+    for (sem = Get_Front_Of_Semaphore_List(chain); sem != 0; sem = Get_Next_In_Semaphore_List(sem)) {
+	if (strcmp(sem->name, name) == 0)
+	    return sem;
+    }
+    return 0;
 }
 
-int V(int sid)
+/*
+ * Take a free entry in the handle table of given process,
+ * doubling the table if it is full.
+ * Returns the handle, or ENOMEM or EMFILE if there is no room.
+ * Must be called with interrupts disabled!
+ */
+static int Alloc_Handle(struct User_Context* context)
 {
-    if (!validateSID(sid)) {
-        return EINVALID;
+    int handle;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (context->freeSemHandle < 0) {
+	int oldSize = context->numSemHandles;
+	int newSize = oldSize == 0 ? SEM_HANDLES_INITIAL : oldSize * 2;
+	struct Semaphore_Handle* table;
+	int i;
+
+	if (newSize > MAX_SEMAPHORE_HANDLES)
+	    return EMFILE;
+	table = Malloc(newSize * sizeof(struct Semaphore_Handle));
+	if (table == 0)
+	    return ENOMEM;
+
+	if (oldSize > 0) {
+	    memcpy(table, context->semHandles, oldSize * sizeof(struct Semaphore_Handle));
+	    Free(context->semHandles);
+	}
+	for (i = oldSize; i < newSize; ++i) {
+	    table[i].sem = 0;
+	    table[i].nextFree = i + 1 < newSize ? i + 1 : -1;
+	}
+	context->semHandles = table;
+	context->numSemHandles = newSize;
+	context->freeSemHandle = oldSize;
     }
 
-    bool atomic = Begin_Int_Atomic();
-    g_Semaphore[sid].resourcesCount++;
-    Wake_Up(&g_Semaphore[sid].waitingThreads);
-    End_Int_Atomic(atomic);
-    return 0;
+    handle = context->freeSemHandle;
+    context->freeSemHandle = context->semHandles[handle].nextFree;
+    return handle;
 }
 
-int P(int sid)
+static void Free_Handle(struct User_Context* context, int handle)
 {
-    KASSERT(g_Semaphore[sid].available == false);
+    context->semHandles[handle].sem = 0;
+    context->semHandles[handle].nextFree = context->freeSemHandle;
+    context->freeSemHandle = handle;
+}
 
-    if (!validateSID(sid)) {
-        return EINVALID;
-    }
+/*
+ * Find the semaphore the current process has open with given handle.
+ * Returns null if the handle is not valid.
+ */
+static struct Semaphore* Get_Semaphore(int handle)
+{
+    struct User_Context* context = g_currentThread->userContext;
 
-    bool atomic = Begin_Int_Atomic();
-    g_Semaphore[sid].resourcesCount--;
-    Wait(&g_Semaphore[sid].waitingThreads);
-    End_Int_Atomic(atomic);
+    if (context == 0 || handle < 0 || handle >= context->numSemHandles)
+	return 0;
+    return context->semHandles[handle].sem;
+}
 
-    return 0;
+/*
+ * Drop a reference to a semaphore, and free it when
+ * the last one is gone.
+ * Must be called with interrupts disabled!
+ */
+static void Put_Semaphore(struct Semaphore* sem)
+{
+    KASSERT(sem->refCount > 0);
+
+    if (--sem->refCount == 0) {
+	/* Waiters hold handles, so there can't be any */
+	KASSERT(Is_Thread_Queue_Empty(&sem->waitQueue));
+	Remove_From_Semaphore_List(Hash_Chain(sem->name), sem);
+	Free(sem);
+    }
 }
 
-int DestroySemaphore(int sid){
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
 
-    if (!validateSID(sid)) {
-        return EINVALID;
+/*
+ * Open the semaphore with given name for the current process,
+ * creating it with given count if it does not exist.
+ * Returns a handle for it, or an error code (< 0).
+ */
+int Create_Semaphore(const char* name, int initCount)
+{
+    struct User_Context* context = g_currentThread->userContext;
+    struct Semaphore_List* chain;
+    struct Semaphore* sem;
+    int handle;
+    bool iflag;
+
+    if (context == 0 || initCount < 0 || strnlen(name, MAX_SEMAPHORE_NAME + 1) > MAX_SEMAPHORE_NAME)
+	return EINVALID;
+
+    chain = Hash_Chain(name);
+
+    iflag = Begin_Int_Atomic();
+
+    handle = Alloc_Handle(context);
+    if (handle < 0)
+	goto done;
+
+    sem = Lookup_Semaphore(chain, name);
+    if (sem == 0) {
+	sem = Malloc(sizeof(*sem));
+	if (sem == 0) {
+	    Free_Handle(context, handle);
+	    handle = ENOMEM;
+	    goto done;
+	}
+	strcpy(sem->name, name);
+	sem->count = initCount;
+	sem->refCount = 0;
+	Clear_Thread_Queue(&sem->waitQueue);
+	Add_To_Back_Of_Semaphore_List(chain, sem);
     }
 
-    bool atomic = Begin_Int_Atomic();
-    g_Semaphore[sid].refCounter--;
+    ++sem->refCount;
+    context->semHandles[handle].sem = sem;
+
+done:
+    End_Int_Atomic(iflag);
+    return handle;
+}
 
-    if (g_Semaphore[sid].refCounter == 0)
-        g_Semaphore[sid].available = true;
+/*
+ * Acquire a unit of a semaphore, waiting for one if there is none.
+ * Returns 0 if successful, or EINVALID if the handle is not valid.
+ */
+int P(int handle)
+{
+    struct Semaphore* sem;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+
+    sem = Get_Semaphore(handle);
+    if (sem == 0) {
+	End_Int_Atomic(iflag);
+	return EINVALID;
+    }
 
-    End_Int_Atomic(atomic);
+    if (sem->count > 0)
+	--sem->count;
+    else
+	Wait(&sem->waitQueue);	/* V() hands us the unit */
 
+    End_Int_Atomic(iflag);
     return 0;
 }
 
+/*
+ * Release a unit of a semaphore, giving it to the thread
+ * that has waited longest, if any.
+ * Returns 0 if successful, or EINVALID if the handle is not valid.
+ */
+int V(int handle)
+{
+    struct Semaphore* sem;
+    struct Kernel_Thread* waiter;
+    bool iflag;
 
-/* --- Funciones auxiliares --- */
+    iflag = Begin_Int_Atomic();
 
-static bool validateSID(int sid) {
-    if (sid < 0 ||
-        sid >= MAX_NUM_SEMAPHORES ||
-        !g_Semaphore[sid].available ||
-        !Is_Bit_Set(g_currentThread->semaphores, sid))
+    sem = Get_Semaphore(handle);
+    if (sem == 0) {
+	End_Int_Atomic(iflag);
+	return EINVALID;
+    }
 
-        return false;
+    waiter = Get_Front_Of_Thread_Queue(&sem->waitQueue);
+    if (waiter != 0) {
+	Remove_Thread(&sem->waitQueue, waiter);
+	Wake_Thread_And_Switch(waiter);
+    } else
+	++sem->count;
 
-    return true; 
+    End_Int_Atomic(iflag);
+    return 0;
 }
 
-static int isSemaphoreCreated(char *namesem, int lengthName)
+/*
+ * Close a semaphore handle of the current process.  The semaphore
+ * is destroyed when no process has it open any more.
+ * Returns 0 if successful, or EINVALID if the handle is not valid.
+ */
+int Destroy_Semaphore(int handle)
 {
-    int sid = 0;
-    int ret = -1;
-
-    for (sid = 0; sid < MAX_NUM_SEMAPHORES; sid++) {
-        if (strncmp(g_Semaphore[sid].name, namesem, lengthName) == 0) {
-            ret = sid;
-            break;
-        }
+    struct Semaphore* sem;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+
+    sem = Get_Semaphore(handle);
+    if (sem == 0) {
+	End_Int_Atomic(iflag);
+	return EINVALID;
     }
 
-    return ret;
+    Free_Handle(g_currentThread->userContext, handle);
+    Put_Semaphore(sem);
+
+    End_Int_Atomic(iflag);
+    return 0;
 }
 
-static int getFreeSemaphore()
+/*
+ * Close all semaphores a process still has open, and free its
+ * handle table.  Called when the process is destroyed.
+ */
+void Release_Semaphores(struct User_Context* context)
 {
-    int sid = 0;
-    int ret = -1;
-
-    for (sid = 0; sid < MAX_NUM_SEMAPHORES; sid++) {
-        if (g_Semaphore[sid].available) {
-            ret = sid;
-            break;
-        }
+    int i;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    for (i = 0; i < context->numSemHandles; ++i) {
+	if (context->semHandles[i].sem != 0)
+	    Put_Semaphore(context->semHandles[i].sem);
     }
+    End_Int_Atomic(iflag);
 
-    return ret;
+    if (context->semHandles != 0)
+	Free(context->semHandles);
+    context->semHandles = 0;
+    context->numSemHandles = 0;
+    context->freeSemHandle = -1;
 }
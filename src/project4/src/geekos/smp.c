@@ -0,0 +1,646 @@
+/*
+ * Multiprocessor support
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/defs.h>
+#include <geekos/kassert.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/int.h>
+#include <geekos/idt.h>
+#include <geekos/io.h>
+#include <geekos/irq.h>
+#include <geekos/mem.h>
+#include <geekos/paging.h>
+#include <geekos/timer.h>
+#include <geekos/tss.h>
+#include <geekos/kthread.h>
+#include <geekos/spinlock.h>
+#include <geekos/smp.h>
+
+/*
+ * NOTES:
+ * - Processors and the IO-APIC are found through the Intel
+ *   MultiProcessor Specification tables, which QEMU provides
+ *   when started with -smp N.
+ * - With more than one processor, the 8259 PICs are masked and the
+ *   ISA interrupts are routed through the IO-APIC to the bootstrap
+ *   processor.
+ * - The APIC registers are mapped into the device area of the
+ *   kernel's half of the address space (see Map_Device_Page()), so
+ *   they can be reached whichever page directory is loaded.
+ * - The rest of the kernel relies on disabling interrupts for mutual
+ *   exclusion.  To keep that working, a CPU holds the kernel lock
+ *   exactly while it has interrupts disabled: Disable_Interrupts()
+ *   and Enable_Interrupts() take and release it, and so does the
+ *   interrupt entry and return code in lowlevel.asm whenever the
+ *   interrupted code had interrupts enabled.  Kernel code therefore
+ *   runs on several CPUs at once only where it has interrupts
+ *   enabled, and user code runs on all of them.
+ * - Each CPU schedules the threads on its own run queue, and one
+ *   that has nothing else to run steals from the busiest; see
+ *   kthread.c.  The current thread is found from the stack pointer.
+ * - Only the bootstrap processor gets the timer interrupt.  It passes
+ *   every tick on to the other processors with an IPI, so that each
+ *   one charges the thread it runs and enforces its quantum.
+ */
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+/*
+ * MP floating pointer structure.
+ */
+struct MP_Floating_Pointer {
+    char signature[4];		/* "_MP_" */
+    ulong_t configTable;
+    uchar_t length;		/* in 16 byte units */
+    uchar_t specRev;
+    uchar_t checksum;
+    uchar_t features[5];
+} __attribute__ ((packed));
+
+/*
+ * MP configuration table header.
+ */
+struct MP_Config_Header {
+    char signature[4];		/* "PCMP" */
+    ushort_t baseLength;
+    uchar_t specRev;
+    uchar_t checksum;
+    char oemId[8];
+    char productId[12];
+    ulong_t oemTable;
+    ushort_t oemTableSize;
+    ushort_t entryCount;
+    ulong_t localApicAddr;
+    ushort_t extLength;
+    uchar_t extChecksum;
+    uchar_t reserved;
+} __attribute__ ((packed));
+
+/*
+ * MP configuration table entries.
+ */
+enum { MP_PROCESSOR, MP_BUS, MP_IO_APIC, MP_IO_INTERRUPT, MP_LOCAL_INTERRUPT };
+
+struct MP_Processor {
+    uchar_t type;
+    uchar_t apicId;
+    uchar_t apicVersion;
+    uchar_t flags;
+    ulong_t signature;
+    ulong_t features;
+    ulong_t reserved[2];
+} __attribute__ ((packed));
+
+#define MP_PROC_ENABLED 0x01
+#define MP_PROC_BSP     0x02
+
+struct MP_Bus {
+    uchar_t type;
+    uchar_t busId;
+    char busType[6];
+} __attribute__ ((packed));
+
+struct MP_IO_APIC_Entry {
+    uchar_t type;
+    uchar_t apicId;
+    uchar_t version;
+    uchar_t flags;
+    ulong_t addr;
+} __attribute__ ((packed));
+
+struct MP_Interrupt {
+    uchar_t type;
+    uchar_t intType;		/* 0 for a vectored interrupt */
+    ushort_t flags;		/* polarity and trigger mode */
+    uchar_t srcBus;
+    uchar_t srcIrq;
+    uchar_t dstApic;
+    uchar_t dstPin;
+} __attribute__ ((packed));
+
+#define MP_POLARITY_LOW 0x3
+#define MP_TRIGGER_LEVEL (0x3 << 2)
+
+/*
+ * Local APIC registers (offsets from the base address).
+ */
+#define LAPIC_ID        0x020
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0b0
+#define LAPIC_SVR       0x0f0
+#define LAPIC_ICR_LOW   0x300
+#define LAPIC_ICR_HIGH  0x310
+
+#define LAPIC_SVR_ENABLE   0x100
+#define LAPIC_SPURIOUS_VEC 0xff
+
+#define ICR_FIXED        0x00000000
+#define ICR_INIT         0x00000500
+#define ICR_STARTUP      0x00000600
+#define ICR_LEVEL_ASSERT 0x00004000
+#define ICR_PENDING      0x00001000
+
+/*
+ * IO-APIC registers.  They are accessed indirectly: write the
+ * register number to IOREGSEL, then read or write IOWIN.
+ */
+#define IOAPIC_REGSEL   0x00
+#define IOAPIC_WIN      0x10
+#define IOAPIC_VER      0x01
+#define IOAPIC_REDTBL(pin) (0x10 + 2 * (pin))
+
+#define REDIR_ACTIVE_LOW 0x00002000
+#define REDIR_LEVEL      0x00008000
+#define REDIR_MASKED     0x00010000
+
+/*
+ * Number of ticks to wait for an application processor to come up.
+ */
+#define AP_START_TIMEOUT_TICKS 20
+
+struct CPU_Info g_cpuInfo[MAX_CPUS];
+int g_numCPUs = 1;
+bool g_ioApicEnabled;
+
+/* Physical addresses of the APICs, and where they are mapped */
+static ulong_t s_localApicAddr, s_ioApicAddr;
+static uchar_t* s_localApic;
+static uchar_t* s_ioApic;
+static int s_ioApicId;
+static int s_numIoApicPins;
+
+/* Protects the IO-APIC's select/window register pair. */
+static struct Spin_Lock s_ioApicLock = SPIN_LOCK_INITIALIZER;
+
+/*
+ * The kernel lock, which is only used once application
+ * processors are about to start.
+ */
+static struct Spin_Lock s_kernelLock = SPIN_LOCK_INITIALIZER;
+static volatile bool s_kernelLockActive;
+
+/*
+ * Bit n is set if MP bus n is an ISA bus.
+ */
+static ulong_t s_isaBusMask;
+
+/*
+ * IO-APIC input pin and MP interrupt flags of each ISA IRQ.
+ */
+static uchar_t s_irqPin[16];
+static ushort_t s_irqFlags[16];
+
+/*
+ * Startup code for application processors, in smpboot.asm.
+ */
+extern char AP_Trampoline_Start[], AP_Trampoline_End[];
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+static uchar_t Checksum(const void* data, ulong_t len)
+{
+    const uchar_t* p = data;
+    uchar_t sum = 0;
+
+    while (len-- > 0)
+	sum += *p++;
+    return sum;
+}
+
+/*
+ * Look for the MP floating pointer structure in given range.
+ */
+static struct MP_Floating_Pointer* Find_MP_Floating_Pointer(ulong_t start, ulong_t len)
+{
+    ulong_t addr;
+
+    for (addr = start; addr + sizeof(struct MP_Floating_Pointer) <= start + len; addr += 16) {
+	struct MP_Floating_Pointer* fp = (struct MP_Floating_Pointer*) addr;
+	if (memcmp(fp->signature, "_MP_", 4) == 0 &&
+	    Checksum(fp, fp->length * 16) == 0)
+	    return fp;
+    }
+    return 0;
+}
+
+static __inline__ ulong_t Local_APIC_Read(int reg)
+{
+    return *((volatile ulong_t*) (s_localApic + reg));
+}
+
+static __inline__ void Local_APIC_Write(int reg, ulong_t value)
+{
+    *((volatile ulong_t*) (s_localApic + reg)) = value;
+}
+
+static ulong_t IO_APIC_Read(int reg)
+{
+    *((volatile ulong_t*) (s_ioApic + IOAPIC_REGSEL)) = reg;
+    return *((volatile ulong_t*) (s_ioApic + IOAPIC_WIN));
+}
+
+static void IO_APIC_Write(int reg, ulong_t value)
+{
+    *((volatile ulong_t*) (s_ioApic + IOAPIC_REGSEL)) = reg;
+    *((volatile ulong_t*) (s_ioApic + IOAPIC_WIN)) = value;
+}
+
+/*
+ * Record the processors, ISA buses, IO-APIC and ISA interrupt
+ * routing described by the MP configuration table.
+ * Returns false if the table is not valid.
+ */
+static bool Parse_MP_Config(struct MP_Config_Header* config)
+{
+    uchar_t* entry;
+    int i;
+
+    if (memcmp(config->signature, "PCMP", 4) != 0 ||
+	Checksum(config, config->baseLength) != 0)
+	return false;
+
+    s_localApicAddr = config->localApicAddr;
+
+    /* ISA IRQs are identity mapped unless the table says otherwise */
+    for (i = 0; i < 16; ++i)
+	s_irqPin[i] = i;
+
+    g_numCPUs = 1;
+    entry = (uchar_t*) (config + 1);
+    for (i = 0; i < config->entryCount; ++i) {
+	switch (*entry) {
+	case MP_PROCESSOR: {
+	    struct MP_Processor* proc = (struct MP_Processor*) entry;
+	    if (!(proc->flags & MP_PROC_ENABLED))
+		;
+	    else if (proc->flags & MP_PROC_BSP)
+		g_cpuInfo[0].apicId = proc->apicId;
+	    else if (g_numCPUs < MAX_CPUS)
+		g_cpuInfo[g_numCPUs++].apicId = proc->apicId;
+	    entry += sizeof(*proc);
+	    break;
+	}
+
+	case MP_BUS: {
+	    struct MP_Bus* bus = (struct MP_Bus*) entry;
+	    if (memcmp(bus->busType, "ISA", 3) == 0 && bus->busId < 32)
+		s_isaBusMask |= (1UL << bus->busId);
+	    entry += sizeof(*bus);
+	    break;
+	}
+
+	case MP_IO_APIC: {
+	    struct MP_IO_APIC_Entry* ioApic = (struct MP_IO_APIC_Entry*) entry;
+	    /* We only drive the first IO-APIC, which has the ISA IRQs */
+	    if ((ioApic->flags & 1) && s_ioApicAddr == 0) {
+		s_ioApicAddr = ioApic->addr;
+		s_ioApicId = ioApic->apicId;
+	    }
+	    entry += sizeof(*ioApic);
+	    break;
+	}
+
+	case MP_IO_INTERRUPT: {
+	    struct MP_Interrupt* intr = (struct MP_Interrupt*) entry;
+	    if (intr->intType == 0 && intr->srcBus < 32 &&
+		(s_isaBusMask & (1UL << intr->srcBus)) && intr->srcIrq < 16) {
+		s_irqPin[intr->srcIrq] = intr->dstPin;
+		s_irqFlags[intr->srcIrq] = intr->flags;
+	    }
+	    entry += sizeof(*intr);
+	    break;
+	}
+
+	case MP_LOCAL_INTERRUPT:
+	    entry += sizeof(struct MP_Interrupt);
+	    break;
+
+	default:
+	    /* Unknown entry type; we can't tell how long it is */
+	    return true;
+	}
+    }
+
+    return true;
+}
+
+/*
+ * Enable the local APIC of the calling processor.
+ */
+static void Init_Local_APIC(void)
+{
+    Local_APIC_Write(LAPIC_TPR, 0);
+    Local_APIC_Write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+}
+
+/*
+ * Route the ISA IRQs through the IO-APIC to the bootstrap processor,
+ * on the same vectors the PICs used, and mask the PICs.
+ * The IRQ mask maintained by irq.c carries over.
+ */
+static void Init_IO_APIC(bool imcrPresent)
+{
+    ushort_t mask = Get_IRQ_Mask();
+    bool iflag = Begin_Int_Atomic();
+    int irq;
+
+    s_numIoApicPins = ((IO_APIC_Read(IOAPIC_VER) >> 16) & 0xff) + 1;
+
+    /* Mask everything on the PICs */
+    Out_Byte(0x21, 0xff);
+    Out_Byte(0xA1, 0xff);
+
+    /* Switch the IMCR, if there is one, from PIC mode to APIC mode */
+    if (imcrPresent) {
+	Out_Byte(0x22, 0x70);
+	Out_Byte(0x23, 0x01);
+    }
+
+    for (irq = 0; irq < 16; ++irq) {
+	ulong_t low = FIRST_EXTERNAL_INT + irq;
+	int pin = s_irqPin[irq];
+
+	/* IRQ 2 is the PIC cascade, which the IO-APIC does not need */
+	if (irq == 2 || pin >= s_numIoApicPins)
+	    continue;
+
+	if ((s_irqFlags[irq] & MP_POLARITY_LOW) == MP_POLARITY_LOW)
+	    low |= REDIR_ACTIVE_LOW;
+	if ((s_irqFlags[irq] & MP_TRIGGER_LEVEL) == MP_TRIGGER_LEVEL)
+	    low |= REDIR_LEVEL;
+	if (mask & (1 << irq))
+	    low |= REDIR_MASKED;
+
+	IO_APIC_Write(IOAPIC_REDTBL(pin) + 1, (ulong_t) g_cpuInfo[0].apicId << 24);
+	IO_APIC_Write(IOAPIC_REDTBL(pin), low);
+    }
+
+    g_ioApicEnabled = true;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Wait for given number of timer ticks to go by.
+ * Interrupts must be enabled.
+ */
+static void Wait_Ticks(int ticks)
+{
+    ulong_t start = g_numTicks;
+
+    KASSERT(Interrupts_Enabled());
+    while (g_numTicks - start < (ulong_t) ticks)
+	;
+}
+
+static void Send_IPI(int apicId, ulong_t command)
+{
+    Local_APIC_Write(LAPIC_ICR_HIGH, (ulong_t) apicId << 24);
+    Local_APIC_Write(LAPIC_ICR_LOW, command);
+    while (Local_APIC_Read(LAPIC_ICR_LOW) & ICR_PENDING)
+	;
+}
+
+/*
+ * Make the current thread choose a new thread to run
+ * on return from the interrupt.
+ */
+static void Reschedule_IPI_Handler(struct Interrupt_State* state)
+{
+    g_currentThread->needReschedule = true;
+    Local_APIC_EOI();
+}
+
+/*
+ * C entry point of an application processor, called from smpboot.asm
+ * on the CPU's boot stack with paging enabled and the kernel GDT and
+ * IDT loaded.  The boot stack becomes the stack of the CPU's idle
+ * thread, which starts scheduling threads.
+ */
+static void AP_Main(int cpu)
+{
+    Init_Local_APIC();
+
+    /* We start with interrupts disabled, so take the kernel lock */
+    Lock_Kernel();
+    INTR_TRACE_OFF();
+
+    Init_AP_TSS(cpu);
+    g_cpuInfo[cpu].online = true;
+
+    Start_AP_Scheduler(cpu, g_cpuInfo[cpu].stack);
+}
+
+/*
+ * Start application processor given by index into g_cpuInfo,
+ * using the INIT, STARTUP, STARTUP sequence from the MP spec.
+ * Returns true if the processor came online.
+ */
+static bool Start_AP(int cpu)
+{
+    struct AP_Boot_Params* params =
+	(struct AP_Boot_Params*) (AP_TRAMPOLINE_ADDR + AP_BOOT_PARAMS_OFFSET);
+    struct CPU_Info* info = &g_cpuInfo[cpu];
+    ulong_t startup = ICR_STARTUP | (AP_TRAMPOLINE_ADDR >> PAGE_POWER);
+    ulong_t start;
+
+    info->stack = Alloc_Page();
+    if (info->stack == 0)
+	return false;
+
+    params->pageDir = (ulong_t) Get_PDBR();
+    params->stack = (ulong_t) info->stack + PAGE_SIZE;
+    params->entry = (ulong_t) &AP_Main;
+    params->cpu = cpu;
+
+    /*
+     * The spec asks for 10ms after INIT and 200us between the STARTUPs;
+     * waiting for two tick boundaries gives at least one full tick.
+     */
+    Send_IPI(info->apicId, ICR_INIT | ICR_LEVEL_ASSERT);
+    Wait_Ticks(2);
+
+    /* The second STARTUP is only needed if the first one was missed */
+    Send_IPI(info->apicId, startup);
+    Wait_Ticks(2);
+    if (!info->online)
+	Send_IPI(info->apicId, startup);
+
+    start = g_numTicks;
+    while (!info->online && g_numTicks - start < AP_START_TIMEOUT_TICKS)
+	;
+
+    return info->online;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Find the other processors and the IO-APIC, switch interrupt
+ * delivery to the APICs, and start the application processors.
+ * Must be called after paging and the timer are set up, with
+ * interrupts enabled.  Does nothing on a uniprocessor.
+ */
+void Init_SMP(void)
+{
+    struct MP_Floating_Pointer* fp;
+    struct AP_Boot_Params* params;
+    int cpu, numOnline = 1;
+
+    g_cpuInfo[0].online = true;
+
+    /*
+     * The spec also allows the structure in the first KB of the EBDA,
+     * but the pointer to that lives in page 0, which isn't mapped.
+     */
+    fp = Find_MP_Floating_Pointer(0x9fc00, 0x400);
+    if (fp == 0)
+	fp = Find_MP_Floating_Pointer(0xf0000, 0x10000);
+
+    /* Nonzero features[0] means a default configuration, without a table */
+    if (fp == 0 || fp->configTable == 0 || fp->features[0] != 0 ||
+	!Parse_MP_Config((struct MP_Config_Header*) fp->configTable) ||
+	g_numCPUs == 1) {
+	g_numCPUs = 1;
+	return;
+    }
+
+    Print("Initializing SMP: %d processors\n", g_numCPUs);
+
+    s_localApic = Map_Device_Page(s_localApicAddr);
+    Init_Local_APIC();
+
+    if (s_ioApicAddr != 0) {
+	s_ioApic = Map_Device_Page(s_ioApicAddr);
+	Init_IO_APIC((fp->features[1] & 0x80) != 0);
+    }
+
+    /* Copy the startup code to where the processors can run it in real mode */
+    KASSERT(AP_Trampoline_End - AP_Trampoline_Start <= AP_BOOT_PARAMS_OFFSET);
+    memcpy((void*) AP_TRAMPOLINE_ADDR, AP_Trampoline_Start,
+	AP_Trampoline_End - AP_Trampoline_Start);
+
+    params = (struct AP_Boot_Params*) (AP_TRAMPOLINE_ADDR + AP_BOOT_PARAMS_OFFSET);
+    __asm__ __volatile__ ("sgdt (%0)" : : "r" (&params->gdtLimit) : "memory");
+    __asm__ __volatile__ ("sidt (%0)" : : "r" (&params->idtLimit) : "memory");
+
+    Install_Interrupt_Handler(IPI_RESCHEDULE_VEC, &Reschedule_IPI_Handler);
+
+    /*
+     * From now on disabling interrupts takes the kernel lock.  With
+     * interrupts enabled here, this CPU is not in the middle of
+     * anything that would have to release it.
+     */
+    KASSERT(Interrupts_Enabled());
+    s_kernelLockActive = true;
+
+    for (cpu = 1; cpu < g_numCPUs; ++cpu) {
+	if (Start_AP(cpu))
+	    ++numOnline;
+	else
+	    Print("CPU %d (APIC id %d) did not start\n", cpu, g_cpuInfo[cpu].apicId);
+    }
+
+    Print("%d of %d processors online\n", numOnline, g_numCPUs);
+}
+
+/*
+ * Get the index in g_cpuInfo of the calling processor.
+ * This is the CPU the current thread was dispatched on, so unless
+ * interrupts are disabled the thread may have moved on by the time
+ * the caller looks at the result.
+ */
+int Get_CPU_ID(void)
+{
+    return g_currentThread->cpu;
+}
+
+/*
+ * Acquire the kernel lock.  Called with interrupts disabled, by
+ * Disable_Interrupts() and the interrupt entry code.
+ */
+void Lock_Kernel(void)
+{
+    if (s_kernelLockActive)
+	Spin_Lock(&s_kernelLock);
+}
+
+/*
+ * Release the kernel lock, just before interrupts are enabled.
+ */
+void Unlock_Kernel(void)
+{
+    if (s_kernelLockActive)
+	Spin_Unlock(&s_kernelLock);
+}
+
+/*
+ * Send an interrupt with given vector to given CPU.
+ */
+void Send_IPI_To_CPU(int cpu, int vector)
+{
+    KASSERT(g_cpuInfo[cpu].online);
+    Send_IPI(g_cpuInfo[cpu].apicId, ICR_FIXED | vector);
+}
+
+/*
+ * Send an interrupt with given vector to every other CPU that is online.
+ * Interrupts must be disabled, so that the caller stays on one CPU.
+ */
+void Send_IPI_To_Others(int vector)
+{
+    int self, cpu;
+
+    KASSERT(!Interrupts_Enabled());
+    if (g_numCPUs == 1)
+	return;
+
+    self = Get_CPU_ID();
+    for (cpu = 0; cpu < g_numCPUs; ++cpu) {
+	if (cpu != self && g_cpuInfo[cpu].online)
+	    Send_IPI_To_CPU(cpu, vector);
+    }
+}
+
+/*
+ * Signal end of interrupt to the local APIC.
+ */
+void Local_APIC_EOI(void)
+{
+    Local_APIC_Write(LAPIC_EOI, 0);
+}
+
+/*
+ * Mask or unmask the IO-APIC input of given ISA IRQ.
+ */
+void IO_APIC_Mask_IRQ(int irq, bool masked)
+{
+    int pin = s_irqPin[irq];
+    ulong_t low;
+    bool iflag;
+
+    KASSERT(g_ioApicEnabled);
+    KASSERT(irq >= 0 && irq < 16);
+    if (irq == 2 || pin >= s_numIoApicPins)
+	return;
+
+    iflag = Spin_Lock_Irq_Save(&s_ioApicLock);
+    low = IO_APIC_Read(IOAPIC_REDTBL(pin));
+    if (masked)
+	low |= REDIR_MASKED;
+    else
+	low &= ~REDIR_MASKED;
+    IO_APIC_Write(IOAPIC_REDTBL(pin), low);
+    Spin_Unlock_Irq_Restore(&s_ioApicLock, iflag);
+}
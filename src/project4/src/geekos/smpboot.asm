@@ -0,0 +1,78 @@
+; Application processor startup code for GeekOS.
+
+; This is free software.  You are permitted to use,
+; redistribute, and modify it as specified in the file "COPYING".
+
+; Init_SMP() copies the code between AP_Trampoline_Start and
+; AP_Trampoline_End to AP_TRAMPOLINE_ADDR, and a STARTUP IPI starts
+; the application processor there in real mode, with CS set to
+; AP_TRAMPOLINE_ADDR >> 4 and IP 0.  The code switches to protected
+; mode with the kernel's GDT, turns on paging with the kernel's page
+; directory, loads the kernel's IDT and stack, and calls the C entry
+; point, all as given by Start_AP() in the boot parameter block.
+
+%include "defs.asm"
+%include "symbol.asm"
+
+; Offsets of the boot parameters in the startup page.
+; Keep these up to date with struct AP_Boot_Params in smp.h.
+AP_BOOT_PARAMS equ 0xf00
+AP_GDTR        equ AP_BOOT_PARAMS + 0
+AP_IDTR        equ AP_BOOT_PARAMS + 6
+AP_PAGE_DIR    equ AP_BOOT_PARAMS + 12
+AP_STACK       equ AP_BOOT_PARAMS + 16
+AP_ENTRY       equ AP_BOOT_PARAMS + 20
+AP_CPU         equ AP_BOOT_PARAMS + 24
+
+; Absolute address of a label once the code has been copied.
+%define RELOCATED(label) (AP_TRAMPOLINE_ADDR + (label - AP_Trampoline_Start))
+
+EXPORT AP_Trampoline_Start
+EXPORT AP_Trampoline_End
+
+[SECTION .text]
+
+[BITS 16]
+AP_Trampoline_Start:
+	cli
+	mov	ax, cs
+	mov	ds, ax
+
+	; Load the kernel GDT (with a 32 bit base) and enter protected mode
+	o32 lgdt [AP_GDTR]
+	mov	eax, cr0
+	or	al, 1
+	mov	cr0, eax
+
+	jmp	dword KERNEL_CS:RELOCATED(AP_Protected_Mode)
+
+[BITS 32]
+AP_Protected_Mode:
+	mov	ax, KERNEL_DS
+	mov	ds, ax
+	mov	es, ax
+	mov	fs, ax
+	mov	gs, ax
+	mov	ss, ax
+
+	; Turn on paging; the startup page is identity mapped
+	mov	eax, [AP_TRAMPOLINE_ADDR + AP_PAGE_DIR]
+	mov	cr3, eax
+	mov	eax, cr0
+	or	eax, 0x80000000
+	mov	cr0, eax
+
+	lidt	[AP_TRAMPOLINE_ADDR + AP_IDTR]
+	mov	esp, [AP_TRAMPOLINE_ADDR + AP_STACK]
+
+	; Call the entry point with the CPU index as its argument
+	push	dword [AP_TRAMPOLINE_ADDR + AP_CPU]
+	mov	eax, [AP_TRAMPOLINE_ADDR + AP_ENTRY]
+	call	eax
+
+.hang:
+	cli
+	hlt
+	jmp	.hang
+
+AP_Trampoline_End:
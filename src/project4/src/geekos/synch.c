@@ -27,37 +27,21 @@
  * Private functions
  * ---------------------------------------------------------------------- */
 
-/*
- * The mutex is currently locked.
- * Atomically reenable preemption and wait in the
- * mutex's wait queue.
- */
-static void Mutex_Wait(struct Mutex *mutex)
-{
-    KASSERT(mutex->state == MUTEX_LOCKED);
-    KASSERT(g_preemptionDisabled);
-
-    Disable_Interrupts();
-    g_preemptionDisabled = false;
-    Wait(&mutex->waitQueue);
-    g_preemptionDisabled = true;
-    Enable_Interrupts();
-}
-
 /*
  * Lock given mutex.
- * Preemption must be disabled.
+ * Interrupts must be disabled: that is what keeps threads on
+ * other CPUs from looking at the mutex at the same time.
  */
 static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
 {
-    KASSERT(g_preemptionDisabled);
+    KASSERT(!Interrupts_Enabled());
 
     /* Make sure we're not already holding the mutex */
     KASSERT(!IS_HELD(mutex));
 
     /* Wait until the mutex is in an unlocked state */
     while (mutex->state == MUTEX_LOCKED) {
-	Mutex_Wait(mutex);
+	Wait(&mutex->waitQueue);
     }
 
     /* Now it's ours! */
@@ -67,11 +51,13 @@ static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
 
 /*
  * Unlock given mutex.
- * Preemption must be disabled.
+ * Interrupts must be disabled.  If handOff is true, a waiting
+ * thread is switched to right away (see Wake_Up_And_Switch());
+ * otherwise it is just made runnable.
  */
-static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
+static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex, bool handOff)
 {
-    KASSERT(g_preemptionDisabled);
+    KASSERT(!Interrupts_Enabled());
 
     /* Make sure mutex was actually acquired by this thread. */
     KASSERT(IS_HELD(mutex));
@@ -82,16 +68,12 @@ static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
 
     /*
      * If there are threads waiting to acquire the mutex,
-     * wake one of them up.  Note that it is legal to inspect
-     * the queue with interrupts enabled because preemption
-     * is disabled, and therefore we know that no thread can
-     * concurrently add itself to the queue.
+     * wake one of them up.
      */
-    if (!Is_Thread_Queue_Empty(&mutex->waitQueue)) {
-	Disable_Interrupts();
+    if (handOff)
+	Wake_Up_And_Switch(&mutex->waitQueue);
+    else
 	Wake_Up_One(&mutex->waitQueue);
-	Enable_Interrupts();
-    }
 }
 
 /* ----------------------------------------------------------------------
@@ -115,9 +97,9 @@ void Mutex_Lock(struct Mutex* mutex)
 {
     KASSERT(Interrupts_Enabled());
 
-    g_preemptionDisabled = true;
+    Disable_Interrupts();
     Mutex_Lock_Imp(mutex);
-    g_preemptionDisabled = false;
+    Enable_Interrupts();
 }
 
 /*
@@ -127,9 +109,9 @@ void Mutex_Unlock(struct Mutex* mutex)
 {
     KASSERT(Interrupts_Enabled());
 
-    g_preemptionDisabled = true;
-    Mutex_Unlock_Imp(mutex);
-    g_preemptionDisabled = false;
+    Disable_Interrupts();
+    Mutex_Unlock_Imp(mutex, true);
+    Enable_Interrupts();
 }
 
 /*
@@ -138,6 +120,7 @@ void Mutex_Unlock(struct Mutex* mutex)
 void Cond_Init(struct Condition* cond)
 {
     Clear_Thread_Queue(&cond->waitQueue);
+    cond->mutex = 0;
 }
 
 /*
@@ -150,35 +133,24 @@ void Cond_Wait(struct Condition* cond, struct Mutex* mutex)
     /* Ensure mutex is held. */
     KASSERT(IS_HELD(mutex));
 
-    /* Turn off scheduling. */
-    g_preemptionDisabled = true;
-
-    /*
-     * Release the mutex, but leave preemption disabled.
-     * No other threads will be able to run before this thread
-     * is able to wait.  Therefore, this thread will not
-     * miss the eventual notification on the condition.
-     */
-    Mutex_Unlock_Imp(mutex);
+    /* Remember it, so Cond_Signal() can queue us on it directly */
+    cond->mutex = mutex;
 
     /*
-     * Atomically reenable preemption and wait in the condition wait queue.
-     * Other threads can run while this thread is waiting,
-     * and eventually one of them will call Cond_Signal() or Cond_Broadcast()
-     * to wake up this thread.
-     * On wakeup, disable preemption again.
+     * Release the mutex and wait in the condition wait queue, with
+     * interrupts disabled throughout, so that no other thread can
+     * signal the condition in between and this thread will not
+     * miss the notification.  Other threads can run while this
+     * thread is waiting, and eventually one of them will call
+     * Cond_Signal() or Cond_Broadcast() to wake up this thread.
      */
     Disable_Interrupts();
-    g_preemptionDisabled = false;
+    Mutex_Unlock_Imp(mutex, false);
     Wait(&cond->waitQueue);
-    g_preemptionDisabled = true;
-    Enable_Interrupts();
 
     /* Reacquire the mutex. */
     Mutex_Lock_Imp(mutex);
-
-    /* Turn scheduling back on. */
-    g_preemptionDisabled = false;
+    Enable_Interrupts();
 }
 
 /*
@@ -187,9 +159,21 @@ void Cond_Wait(struct Condition* cond, struct Mutex* mutex)
  */
 void Cond_Signal(struct Condition* cond)
 {
+    struct Mutex* mutex = cond->mutex;
+
     KASSERT(Interrupts_Enabled());
     Disable_Interrupts();  /* prevent scheduling */
-    Wake_Up_One(&cond->waitQueue);
+
+    if (mutex != 0 && IS_HELD(mutex)) {
+	/*
+	 * The woken thread would only block again on the mutex we hold,
+	 * so move it straight to the mutex's wait queue.  Unlocking the
+	 * mutex then switches to it.
+	 */
+	Requeue_One(&cond->waitQueue, &mutex->waitQueue);
+    } else
+	Wake_Up_And_Switch(&cond->waitQueue);
+
     Enable_Interrupts();  /* resume scheduling */
 }
 
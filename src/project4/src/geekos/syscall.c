@@ -21,6 +21,8 @@
 #include <geekos/timer.h>
 #include <geekos/vfs.h>
 #include <geekos/sem.h>
+#include <geekos/intrtrace.h>
+#include <geekos/sysstat.h>
 
 /*
  * Null system call.
@@ -183,10 +185,10 @@ static int Sys_Spawn(struct Interrupt_State* state)
     }
 
     Enable_Interrupts();
-    if ((retVal = Spawn(exeName, command, &kthread))) {
-        goto fail;
-    }
+    retVal = Spawn(exeName, command, &kthread);
     Disable_Interrupts();
+    if (retVal < 0)
+        goto fail;
 
     if (exeName!=NULL)
         Free(exeName);
@@ -241,8 +243,10 @@ static int Sys_GetPID(struct Interrupt_State* state)
 /*
  * Set the scheduling policy.
  * Params:
- *   state->ebx - policy,
- *   state->ecx - number of ticks in quantum
+ *   state->ebx - policy (0 round robin, 1 multi-level feedback,
+ *     2 fair share),
+ *   state->ecx - number of ticks in quantum, for round robin and
+ *     fair share (multi-level feedback has its own, see Sys_MLFParams)
  * Returns: 0 if successful, -1 otherwise
  */
 static int Sys_SetSchedulingPolicy(struct Interrupt_State* state)
@@ -250,7 +254,7 @@ static int Sys_SetSchedulingPolicy(struct Interrupt_State* state)
     int policy = state->ebx;
     int quantum = state->ecx;
     
-    if(policy!=0 && policy!=1)return -1;
+    if(policy<0 || policy>2)return -1;
     if(quantum<2 || quantum>100)return -1;
     
     if(g_currentSchedulingPolicy!=policy){
@@ -280,12 +284,23 @@ static int Sys_GetTimeOfDay(struct Interrupt_State* state)
  *   state->ebx - user address of name of semaphore
  *   state->ecx - length of semaphore name
  *   state->edx - initial semaphore count
- * Returns: the global semaphore id
+ * Returns: a handle for the semaphore if successful,
+ *   error code (< 0) if unsuccessful
  */
 static int Sys_CreateSemaphore(struct Interrupt_State* state)
 {
-    TODO("CreateSemaphore system call");
-    return -1;
+    char name[MAX_SEMAPHORE_NAME + 1];
+    ulong_t nameLen = state->ecx;
+
+    if (nameLen == 0)
+	return EINVALID;
+    if (nameLen > MAX_SEMAPHORE_NAME)
+	return ENAMETOOLONG;
+    if (!Copy_From_User(name, state->ebx, nameLen))
+	return EINVALID;
+    name[nameLen] = '\0';
+
+    return Create_Semaphore(name, (int) state->edx);
 }
 
 /*
@@ -293,42 +308,203 @@ static int Sys_CreateSemaphore(struct Interrupt_State* state)
  * Assume that the process has permission to access the semaphore,
  * the call will block until the semaphore count is >= 0.
  * Params:
- *   state->ebx - the semaphore id
+ *   state->ebx - the semaphore handle
  *
  * Returns: 0 if successful, error code (< 0) if unsuccessful
  */
 static int Sys_P(struct Interrupt_State* state)
 {
-    TODO("P (semaphore acquire) system call");
-    return -1;
+    return P(state->ebx);
 }
 
 /*
  * Release a semaphore.
  * Params:
- *   state->ebx - the semaphore id
+ *   state->ebx - the semaphore handle
  *
  * Returns: 0 if successful, error code (< 0) if unsuccessful
  */
 static int Sys_V(struct Interrupt_State* state)
 {
-    TODO("V (semaphore release) system call");
-    return -1;
+    return V(state->ebx);
 }
 
 /*
  * Destroy a semaphore.
  * Params:
- *   state->ebx - the semaphore id
+ *   state->ebx - the semaphore handle
  *
  * Returns: 0 if successful, error code (< 0) if unsuccessful
  */
 static int Sys_DestroySemaphore(struct Interrupt_State* state)
 {
-    TODO("DestroySemaphore system call");
-    return -1;
+    return Destroy_Semaphore(state->ebx);
+}
+
+/*
+ * Report on how long the kernel has run with interrupts disabled.
+ * Params:
+ *   state->ebx - INTR_TRACE_PRINT to print the report to the console,
+ *     INTR_TRACE_CLEAR to forget the recorded spans (after printing)
+ *
+ * Returns: 0 if successful, EUNSUPPORTED if the kernel was built
+ *   without INTR_TRACE
+ */
+static int Sys_IntrTrace(struct Interrupt_State* state)
+{
+#ifdef INTR_TRACE
+    /*
+     * Printing is slow, so do it with interrupts enabled; the tracer
+     * disables them itself while it copies or clears the spans.
+     */
+    Enable_Interrupts();
+    if (state->ebx & INTR_TRACE_PRINT)
+	Intr_Trace_Report();
+    if (state->ebx & INTR_TRACE_CLEAR)
+	Intr_Trace_Reset();
+    Disable_Interrupts();
+    return 0;
+#else
+    return EUNSUPPORTED;
+#endif
+}
+
+/*
+ * Get the statistics of a system call.
+ * Params:
+ *   state->ebx - the system call number
+ *   state->ecx - user pointer of struct Syscall_Stat to fill in
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_SyscallStat(struct Interrupt_State* state)
+{
+    struct Syscall_Stat stat;
+    int rc;
+
+    rc = Syscall_Stat_Get(state->ebx, &stat);
+    if (rc != 0)
+	return rc;
+
+    if (!Copy_To_User(state->ecx, &stat, sizeof(stat)))
+	return EINVALID;
+    return 0;
+}
+
+/*
+ * Get the system call totals of a process.
+ * Params:
+ *   state->ebx - pid of the process: 0 for the caller, else one of
+ *     its children
+ *   state->ecx - user pointer of struct Process_Syscall_Stat to fill in
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_ProcStat(struct Interrupt_State* state)
+{
+    struct Process_Syscall_Stat stat;
+    struct Kernel_Thread* kthread = g_currentThread;
+
+    if (state->ebx != 0) {
+	kthread = Lookup_Thread(state->ebx);
+	if (kthread == 0)
+	    return ENOTFOUND;
+    }
+
+    Syscall_Stat_Get_Process(kthread, &stat);
+
+    if (!Copy_To_User(state->ecx, &stat, sizeof(stat)))
+	return EINVALID;
+    return 0;
+}
+
+/*
+ * Get and set the parameters of the multi-level feedback policy.
+ * Params:
+ *   state->ebx - user pointer of struct MLF_Params with the new
+ *     parameters, or 0 to leave them as they are
+ *   state->ecx - user pointer of struct MLF_Params to fill in with
+ *     the old parameters, or 0
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_MLFParams(struct Interrupt_State* state)
+{
+    struct MLF_Params params, oldParams;
+    int rc;
+
+    if (state->ebx != 0 && !Copy_From_User(&params, state->ebx, sizeof(params)))
+	return EINVALID;
+
+    MLF_Get_Params(&oldParams);
+
+    if (state->ebx != 0) {
+	rc = MLF_Set_Params(&params);
+	if (rc != 0)
+	    return rc;
+    }
+
+    if (state->ecx != 0 && !Copy_To_User(state->ecx, &oldParams, sizeof(oldParams)))
+	return EINVALID;
+    return 0;
+}
+
+/*
+ * Get the counts of returns to user mode and of the ones
+ * that loaded the user address space.
+ * Params:
+ *   state->ebx - user pointer of struct Switch_Stat to fill in
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_SwitchStat(struct Interrupt_State* state)
+{
+    struct Switch_Stat stat;
+
+    Get_Switch_Stat(&stat);
+
+    if (!Copy_To_User(state->ebx, &stat, sizeof(stat)))
+	return EINVALID;
+    return 0;
+}
+
+/*
+ * Get the multi-level feedback level of the current thread.
+ * Params:
+ *   none
+ * Returns: the level, 0 being the top
+ */
+static int Sys_MLFLevel(struct Interrupt_State* state)
+{
+    return g_currentThread->currentReadyQueue;
+}
+
+/*
+ * Put the current process in the earliest-deadline-first
+ * real-time scheduling class.
+ * Params:
+ *   state->ebx - period, in ticks (0 to leave the real-time class)
+ *   state->ecx - budget: ticks of CPU time per period
+ *   state->edx - relative deadline, in ticks (0 for the period)
+ * Returns: 0 if successful, EBUSY if the process could not be
+ *   admitted, error code (< 0) otherwise
+ */
+static int Sys_SetRealTime(struct Interrupt_State* state)
+{
+    return Real_Time_Set_Params(state->ebx, state->ecx, state->edx);
 }
 
+/*
+ * Finish the current real-time job and wait for the next period.
+ * Params:
+ *   state - processor registers from user mode
+ * Returns: number of deadlines missed so far, or error code (< 0)
+ *   if the process is not a real-time process
+ */
+static int Sys_WaitPeriod(struct Interrupt_State* state)
+{
+    return Real_Time_Wait_Period();
+}
 
 /*
  * Global table of system call handler functions.
@@ -351,6 +527,14 @@ const Syscall g_syscallTable[] = {
     Sys_P,
     Sys_V,
     Sys_DestroySemaphore,
+    Sys_IntrTrace,
+    Sys_SyscallStat,
+    Sys_ProcStat,
+    Sys_MLFParams,
+    Sys_SwitchStat,
+    Sys_MLFLevel,
+    Sys_SetRealTime,
+    Sys_WaitPeriod,
 };
 
 /*
@@ -0,0 +1,129 @@
+/*
+ * System call statistics
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/syscall.h>
+#include <geekos/tsc.h>
+#include <geekos/sysstat.h>
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+static struct Syscall_Stat s_syscallStats[MAX_SYSCALL_STATS];
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Histogram bucket for a call taking given number of cycles.
+ */
+static int Hist_Bucket(unsigned long long cycles)
+{
+    ulong_t bucket;
+
+    if (cycles >> 32)
+	return SYSCALL_HIST_BUCKETS - 1;
+    if (cycles == 0)
+	return 0;
+
+    /* Index of the most significant set bit */
+    __asm__ ("bsrl %1, %0" : "=r" (bucket) : "rm" ((ulong_t) cycles));
+    return bucket;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Count a system call made by the current thread.
+ * Called from the system call handler, with interrupts disabled.
+ * Returns the time stamp to pass to Syscall_Stat_Leave() when the
+ * call returns.
+ */
+unsigned long long Syscall_Stat_Enter(int syscallNum)
+{
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(syscallNum >= 0 && syscallNum < MAX_SYSCALL_STATS);
+
+    ++s_syscallStats[syscallNum].count;
+    ++g_currentThread->syscallCount;
+    return Read_TSC();
+}
+
+/*
+ * Charge the time taken by a system call that has returned.
+ * Called with interrupts disabled.
+ */
+void Syscall_Stat_Leave(int syscallNum, unsigned long long start)
+{
+    struct Syscall_Stat* stat = &s_syscallStats[syscallNum];
+    unsigned long long cycles = Read_TSC() - start;
+
+    KASSERT(!Interrupts_Enabled());
+
+    ++stat->numReturned;
+    stat->cycles += cycles;
+    if (cycles > stat->maxCycles)
+	stat->maxCycles = (cycles >> 32) ? 0xffffffffUL : (ulong_t) cycles;
+    ++stat->hist[Hist_Bucket(cycles)];
+
+    g_currentThread->syscallCycles += cycles;
+}
+
+/*
+ * Add the system call totals of a dead thread, and those of its
+ * children, to the child totals of the current thread, which is
+ * its owner.  Called from Join() with interrupts disabled.
+ */
+void Syscall_Stat_Join(struct Kernel_Thread* kthread)
+{
+    struct Kernel_Thread* current = g_currentThread;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(kthread->owner == current);
+
+    current->childSyscallCount += kthread->syscallCount + kthread->childSyscallCount;
+    current->childSyscallCycles += kthread->syscallCycles + kthread->childSyscallCycles;
+}
+
+/*
+ * Get a snapshot of the statistics for given system call.
+ * Returns 0 if successful, EINVALID if there is no such system call.
+ */
+int Syscall_Stat_Get(int syscallNum, struct Syscall_Stat* stat)
+{
+    bool iflag;
+
+    if (syscallNum < 0 || syscallNum >= g_numSyscalls)
+	return EINVALID;
+
+    iflag = Begin_Int_Atomic();
+    *stat = s_syscallStats[syscallNum];
+    End_Int_Atomic(iflag);
+
+    return 0;
+}
+
+/*
+ * Get a snapshot of the system call totals of given thread.
+ */
+void Syscall_Stat_Get_Process(struct Kernel_Thread* kthread, struct Process_Syscall_Stat* stat)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    stat->count = kthread->syscallCount;
+    stat->cycles = kthread->syscallCycles;
+    stat->childCount = kthread->childSyscallCount;
+    stat->childCycles = kthread->childSyscallCycles;
+
+    End_Int_Atomic(iflag);
+}
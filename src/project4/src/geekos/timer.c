@@ -12,7 +12,9 @@
 #include <geekos/io.h>
 #include <geekos/int.h>
 #include <geekos/irq.h>
+#include <geekos/idt.h>
 #include <geekos/kthread.h>
+#include <geekos/smp.h>
 #include <geekos/timer.h>
 
 #define MAX_TIMER_EVENTS	100
@@ -44,7 +46,8 @@ static int s_spinCountPerTick;
 #define DEFAULT_MAX_TICKS 4
 
 /*
- * Settable quantum.
+ * Settable quantum, for the policies other than multi-level
+ * feedback; that one has a quantum per level (see kthread.c).
  */
 int g_Quantum = DEFAULT_MAX_TICKS;
 
@@ -65,16 +68,47 @@ int g_Quantum = DEFAULT_MAX_TICKS;
  * Private functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Charge a tick to the thread running on this CPU.
+ */
+static void Tick_Current_Thread(void)
+{
+    struct Kernel_Thread* current = g_currentThread;
+
+    /* Update per-thread number of ticks */
+    ++current->numTicks;
+    current->vruntime += FAIR_TICK_COST / Fair_Weight(current->priority);
+
+    /* Enforce real-time budgets */
+    Real_Time_Tick(current);
+
+    /* Charge the tick to the thread's feedback level */
+    MLF_Tick(current);
+
+    /*
+     * If thread has been running for an entire quantum,
+     * inform the interrupt return code that we want
+     * to choose a new thread.
+     */
+    if (current->numTicks >= Get_Quantum(current))
+	current->needReschedule = true;
+}
+
 static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 {
     int i;
-    struct Kernel_Thread* current = g_currentThread;
 
     Begin_IRQ(state);
 
-    /* Update global and per-thread number of ticks */
+    /* Update global number of ticks */
     ++g_numTicks;
-    ++current->numTicks;
+
+    /* The other processors charge their own threads */
+    Send_IPI_To_Others(IPI_TIMER_VEC);
+    Tick_Current_Thread();
+
+    /* Release real-time jobs */
+    Real_Time_Release_Due();
 
     /* update timer events */
     for (i=0; i < timeEventCount; i++) {
@@ -87,28 +121,19 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 	}
     }
 
-    /*
-     * If thread has been running for an entire quantum,
-     * inform the interrupt return code that we want
-     * to choose a new thread.
-     */
-    if (current->numTicks >= g_Quantum) {
-	g_needReschedule = true;
-	/*
-	 * The current process is moved to a lower priority queue,
-	 * since it consumed a full quantum.
-	 */
-        if (current->currentReadyQueue < (MAX_QUEUE_LEVEL - 1)) {
-            /*Print("process %d moved to ready queue %d\n", current->pid, current->currentReadyQueue); */
-            current->currentReadyQueue++;
-        }
-
-    }
-
-
     End_IRQ(state);
 }
 
+/*
+ * Timer tick passed on by the bootstrap processor
+ * to an application processor.
+ */
+static void Timer_IPI_Handler(struct Interrupt_State* state)
+{
+    Tick_Current_Thread();
+    Local_APIC_EOI();
+}
+
 /*
  * Temporary timer interrupt handler used to calibrate
  * the delay loop.
@@ -216,6 +241,9 @@ void Init_Timer(void)
     /* Install an interrupt handler for the timer IRQ */
     Install_IRQ(TIMER_IRQ, &Timer_Interrupt_Handler);
     Enable_IRQ(TIMER_IRQ);
+
+    /* ...and for the ticks it passes on to other processors */
+    Install_Interrupt_Handler(IPI_TIMER_VEC, &Timer_IPI_Handler);
 }
 
 int Start_Timer(int ticks, timerCallback cb)
@@ -12,6 +12,7 @@
 #include <geekos/defs.h>
 #include <geekos/syscall.h>
 #include <geekos/trap.h>
+#include <geekos/sysstat.h>
 
 /*
  * TODO: need to add handlers for other exceptions (such as bounds
@@ -42,6 +43,7 @@ static void Syscall_Handler(struct Interrupt_State* state)
 {
     /* The system call number is specified in the eax register. */
     uint_t syscallNum = state->eax;
+    unsigned long long start;
 
     /* Make sure the the system call number refers to a legal value. */
     if (syscallNum < 0 || syscallNum >= g_numSyscalls) {
@@ -57,7 +59,9 @@ static void Syscall_Handler(struct Interrupt_State* state)
      * Call the appropriate syscall function.
      * Return code of system call is returned in EAX.
      */
+    start = Syscall_Stat_Enter(syscallNum);
     state->eax = g_syscallTable[syscallNum](state);
+    Syscall_Stat_Leave(syscallNum, start);
 }
 
 /*
@@ -65,6 +69,8 @@ static void Syscall_Handler(struct Interrupt_State* state)
  */
 void Init_Traps(void)
 {
+    KASSERT(g_numSyscalls <= MAX_SYSCALL_STATS);
+
     Install_Interrupt_Handler(12, &GPF_Handler);  /* stack exception */
     Install_Interrupt_Handler(13, &GPF_Handler);  /* general protection fault */
     Install_Interrupt_Handler(SYSCALL_INT, &Syscall_Handler);
@@ -17,6 +17,10 @@
 #include <geekos/vfs.h>
 #include <geekos/tss.h>
 #include <geekos/user.h>
+#include <geekos/smp.h>
+#include <geekos/tsc.h>
+#include <geekos/sysstat.h>
+#include <geekos/sem.h>
 
 /*
  * This module contains common functions for implementation of user
@@ -42,6 +46,53 @@ void Attach_User_Context(struct Kernel_Thread* kthread, struct User_Context* con
 
     ++context->refCount;
     Enable_Interrupts();
+
+    /* The process starts with no semaphores open */
+    context->semHandles = 0;
+    context->numSemHandles = 0;
+    context->freeSemHandle = -1;
+}
+
+/*
+ * Make sure no CPU still has the given user context loaded, now
+ * that its last thread is gone, so that its page directory can be
+ * freed.  A CPU keeps the address space loaded if only kernel threads
+ * ran there since the process last did.  This CPU goes back to the
+ * kernel page directory itself; the others are kicked with a
+ * reschedule IPI, and drop the context on their way out of it (see
+ * Switch_To_User_Context()).  Forgetting the context also keeps a new
+ * one allocated at the same address from being mistaken for it.
+ * Interrupts must be disabled.
+ */
+static void Unload_User_Context(struct User_Context* context)
+{
+    int self = Get_CPU_ID(), cpu;
+    bool loaded = false;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(context->refCount == 0);
+
+    if (g_cpuInfo[self].activeUserContext == context) {
+	Set_PDBR(g_kernelPageDir);
+	g_cpuInfo[self].activeUserContext = 0;
+    }
+
+    for (cpu = 0; cpu < g_numCPUs; ++cpu) {
+	if (cpu != self && g_cpuInfo[cpu].activeUserContext == context) {
+	    Send_IPI_To_CPU(cpu, IPI_RESCHEDULE_VEC);
+	    loaded = true;
+	}
+    }
+    if (!loaded)
+	return;
+
+    /* Let the other CPUs into the kernel while waiting for them */
+    Enable_Interrupts();
+    for (cpu = 0; cpu < g_numCPUs; ++cpu) {
+	while (g_cpuInfo[cpu].activeUserContext == context)
+	    ;
+    }
+    Disable_Interrupts();
 }
 
 /*
@@ -61,11 +112,15 @@ void Detach_User_Context(struct Kernel_Thread* kthread)
 	Disable_Interrupts();
         --old->refCount;
 	refCount = old->refCount;
+	if (refCount == 0)
+	    Unload_User_Context(old);
 	Enable_Interrupts();
 
 	/*Print("User context refcount == %d\n", refCount);*/
-        if (refCount == 0)
+        if (refCount == 0) {
+	    Release_Semaphores(old);
             Destroy_User_Context(old);
+	}
     }
 }
 
@@ -144,9 +199,19 @@ error:
     return ret;
 }
 
+/* Returns to user mode, and the ones that loaded the address space */
+static struct Switch_Stat s_switchStat;
+
 /*
  * If the given thread has a User_Context,
  * switch to its memory space.
+ * This runs on every return from an interrupt, so it does nothing
+ * unless the context differs from the one already loaded on this
+ * CPU: resuming the same process after a tick or a system call
+ * reloads neither the LDT nor the TSS kernel stack.  Kernel threads
+ * leave the previous user address space loaded, unless its process
+ * has exited (see Unload_User_Context()).  A kernel built
+ * with LAZY_USER_SWITCH=no reloads it every time, for comparison.
  *
  * Params:
  *   kthread - the thread that is about to execute
@@ -160,9 +225,46 @@ void Switch_To_User_Context(struct Kernel_Thread* kthread, struct Interrupt_Stat
      * the Set_Kernel_Stack_Pointer() and Switch_To_Address_Space()
      * functions.
      */
-    if (kthread->userContext != NULL) {
-        Switch_To_Address_Space(kthread->userContext);
-        Set_Kernel_Stack_Pointer(((ulong_t) kthread->stackPage) + PAGE_SIZE);
+    struct CPU_Info* cpu;
+    unsigned long long start;
+    ulong_t cycles;
+
+    cpu = &g_cpuInfo[kthread->cpu];
+
+    if (kthread->userContext == NULL) {
+	if (cpu->activeUserContext != 0 && cpu->activeUserContext->refCount == 0) {
+	    Set_PDBR(g_kernelPageDir);
+	    cpu->activeUserContext = 0;
+	}
+	return;
     }
+
+    ++s_switchStat.numSwitches;
+
+#ifndef EAGER_USER_SWITCH
+    if (kthread->userContext == cpu->activeUserContext)
+	return;
+#endif
+
+    start = Read_TSC();
+    Switch_To_Address_Space(kthread->userContext);
+    Set_Kernel_Stack_Pointer(((ulong_t) kthread->stackPage) + PAGE_SIZE);
+    cpu->activeUserContext = kthread->userContext;
+    cycles = (ulong_t) (Read_TSC() - start);
+
+    ++s_switchStat.numReloads;
+    s_switchStat.reloadCycles += cycles;
+    if (cycles > s_switchStat.maxReloadCycles)
+	s_switchStat.maxReloadCycles = cycles;
+}
+
+/*
+ * Get the counts of returns to user mode and address space loads.
+ */
+void Get_Switch_Stat(struct Switch_Stat* stat)
+{
+    bool iflag = Begin_Int_Atomic();
+    *stat = s_switchStat;
+    End_Int_Atomic(iflag);
 }
 
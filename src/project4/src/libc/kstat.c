@@ -0,0 +1,20 @@
+/*
+ * Kernel statistics system calls
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/syscall.h>
+#include <kstat.h>
+
+DEF_SYSCALL(Intr_Latency,SYS_INTRTRACE,int,(int flags),int arg0 = flags;,SYSCALL_REGS_1)
+DEF_SYSCALL(Get_Syscall_Stat,SYS_SYSCALLSTAT,int,(int syscallNum, struct Syscall_Stat* stat),
+    int arg0 = syscallNum; struct Syscall_Stat* arg1 = stat;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Get_Process_Syscall_Stat,SYS_PROCSTAT,int,(int pid, struct Process_Syscall_Stat* stat),
+    int arg0 = pid; struct Process_Syscall_Stat* arg1 = stat;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Get_Switch_Stat,SYS_SWITCHSTAT,int,(struct Switch_Stat* stat),
+    struct Switch_Stat* arg0 = stat;,
+    SYSCALL_REGS_1)
@@ -10,9 +10,19 @@
 
 #include <geekos/syscall.h>
 #include <string.h>
+#include <sched.h>
 
 DEF_SYSCALL(Set_Scheduling_Policy,SYS_SETSCHEDULINGPOLICY,int, (int policy, int quantum),
     int arg0 = policy; int arg1 = quantum;,
     SYSCALL_REGS_2)
 DEF_SYSCALL(Get_Time_Of_Day,SYS_GETTIMEOFDAY,int,(void),,SYSCALL_REGS_0)
+DEF_SYSCALL(Set_Real_Time,SYS_SETREALTIME,int,(int period, int budget, int deadline),
+    int arg0 = period; int arg1 = budget; int arg2 = deadline;,
+    SYSCALL_REGS_3)
+DEF_SYSCALL(Wait_Next_Period,SYS_WAITPERIOD,int,(void),,SYSCALL_REGS_0)
+DEF_SYSCALL(MLF_Params,SYS_MLFPARAMS,int,
+    (const struct MLF_Params *params, struct MLF_Params *oldParams),
+    const struct MLF_Params *arg0 = params; struct MLF_Params *arg1 = oldParams;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Get_MLF_Level,SYS_MLFLEVEL,int,(void),,SYSCALL_REGS_0)
 
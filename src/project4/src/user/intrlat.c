@@ -0,0 +1,70 @@
+/*
+ * Interrupt latency report
+ *
+ * Prints the longest stretches the kernel has spent with interrupts
+ * disabled, and where they started and ended.  If a program is given,
+ * the recorded spans are cleared first and the report covers just
+ * that program's run.  The kernel must be built with INTR_TRACE=yes.
+ *
+ * usage: intrlat [-r] [program [args...]]
+ *   -r  clear the recorded spans after reporting
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <string.h>
+#include <kstat.h>
+
+#define CMDLEN 79
+
+int main(int argc, char **argv)
+{
+    char command[CMDLEN + 1];
+    int flags = INTR_TRACE_PRINT, arg = 1, rc;
+
+    if (arg < argc && !strcmp(argv[arg], "-r")) {
+	flags |= INTR_TRACE_CLEAR;
+	++arg;
+    }
+
+    if (arg < argc) {
+	int pid, i;
+
+	/* Rebuild the command line of the program to run */
+	command[0] = '\0';
+	for (i = arg; i < argc; ++i) {
+	    if (strlen(command) + strlen(argv[i]) + 1 > CMDLEN) {
+		Print("intrlat: command line too long\n");
+		Exit(1);
+	    }
+	    if (i > arg)
+		strcat(command, " ");
+	    strcat(command, argv[i]);
+	}
+
+	/* Throw away what was recorded before the run */
+	rc = Intr_Latency(INTR_TRACE_CLEAR);
+	if (rc < 0) {
+	    Print("intrlat: %s\n", Get_Error_String(rc));
+	    Exit(1);
+	}
+
+	pid = Spawn_With_Path(argv[arg], command, "/c:/a");
+	if (pid < 0) {
+	    Print("intrlat: could not spawn %s: %s\n", argv[arg], Get_Error_String(pid));
+	    Exit(1);
+	}
+	Wait(pid);
+    }
+
+    rc = Intr_Latency(flags);
+    if (rc < 0) {
+	Print("intrlat: %s\n", Get_Error_String(rc));
+	Exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ * Interactive response time under multi-level feedback
+ *
+ * Runs an interactive process against CPU-bound copies of itself
+ * (started as "resptime hog") under the MLF policy, and reports how
+ * long the interactive process took to get the CPU after each event.
+ * Events come from a real-time ticker (started as "resptime tick"),
+ * which is released every period and wakes the interactive process
+ * with a semaphore.  The interactive process does a little work for
+ * each event and waits for the next one.
+ *
+ * usage: resptime [-q q0,q1,...] [-d d0,d1,...] [-b boost] [hogs [events]]
+ *   -q  quantum of each level, in ticks
+ *   -d  CPU ticks a thread may use at each level before demotion
+ *   -b  ticks between boosts to the top level (0 for none)
+ *
+ * Each hog reports whether it was demoted early after a promotion.
+ * Starved hogs are promoted by aging when they wait long enough at
+ * a low level, e.g. "resptime -q 2,4,6,40 -b 0 4".
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <sema.h>
+#include <string.h>
+
+#define DEFAULT_HOGS	2
+#define DEFAULT_EVENTS	40
+#define MAX_HOGS	8
+#define MAX_EVENTS	200
+
+/* Ticks between events */
+#define PERIOD		9
+
+/* Iterations of the work loop run for each event */
+#define WORK_LOOPS	10000
+
+/* Number of histogram buckets, in ticks; the last takes the rest */
+#define HIST_BUCKETS	10
+
+#define CMDLEN 79
+
+static int s_response[MAX_EVENTS];
+
+static void Usage(void)
+{
+    Print("usage: resptime [-q q0,q1,...] [-d d0,d1,...] [-b boost] [hogs [events]]\n");
+    Exit(1);
+}
+
+/*
+ * Spin without ever blocking, like long.c, for the given number of ticks.
+ * Also check that a hog moved up a level, by aging or by a boost, stays
+ * there until it has used the CPU time allowed at the level: count the
+ * ticks it runs at each level it was promoted to, and report the stays
+ * that ended in a demotion before the allowance was used up.  A tick
+ * of slack covers the one it was switched in part way through.
+ */
+static void Hog(int ticks)
+{
+    struct MLF_Params params;
+    int start = Get_Time_Of_Day();
+    int now, last = start, level = Get_MLF_Level(), newLevel;
+    int promoted = 0, run = 0, stays = 0, early = 0;
+
+    MLF_Params(0, &params);
+    while ((now = Get_Time_Of_Day()) - start < ticks) {
+	newLevel = Get_MLF_Level();
+	if (newLevel != level) {
+	    if (promoted && newLevel > level) {
+		++stays;
+		if (run < params.demoteTicks[level] - 1) {
+		    Print("resptime hog: demoted from level %d after %d of %d ticks\n",
+			level, run, params.demoteTicks[level]);
+		    ++early;
+		}
+	    }
+	    promoted = newLevel < level;
+	    level = newLevel;
+	    run = 0;
+	}
+	if (now != last) {
+	    ++run;
+	    last = now;
+	}
+    }
+
+    Print("resptime hog: %d stays at a promoted level, %d cut short\n", stays, early);
+}
+
+/*
+ * Signal the interactive process once per period, for the given
+ * number of events.
+ */
+static void Ticker(int events)
+{
+    int sem = Create_Semaphore("resptime", 0);
+    int i;
+
+    if (Set_Real_Time(PERIOD, 1, 0) < 0) {
+	Print("resptime: ticker not admitted\n");
+	Exit(1);
+    }
+    for (i = 0; i < events; ++i) {
+	V(sem);
+	Wait_Next_Period();
+    }
+    Set_Real_Time(0, 0, 0);
+    Destroy_Semaphore(sem);
+}
+
+/*
+ * Parse a comma separated list of up to MLF_LEVELS numbers.
+ * Returns the number of values parsed.
+ */
+static int Parse_List(const char *s, int *values)
+{
+    int n = 0;
+
+    while (n < MLF_LEVELS) {
+	values[n++] = atoi(s);
+	while (*s >= '0' && *s <= '9')
+	    ++s;
+	if (*s != ',')
+	    break;
+	++s;
+    }
+    return n;
+}
+
+static void Print_Params(const struct MLF_Params *params)
+{
+    int i;
+
+    Print("quantum/demote ticks per level:");
+    for (i = 0; i < MLF_LEVELS - 1; ++i)
+	Print(" %d/%d", params->quantum[i], params->demoteTicks[i]);
+    Print(" %d/-, boost every %d ticks\n", params->quantum[i], params->boostInterval);
+}
+
+static int Spawn_Self(const char *mode, int arg)
+{
+    char command[CMDLEN + 1];
+    int pid;
+
+    snprintf(command, sizeof(command), "resptime %s %d", mode, arg);
+    pid = Spawn_With_Path("resptime", command, "/c:/a");
+    if (pid < 0) {
+	Print("resptime: could not start %s: %d\n", mode, pid);
+	Exit(1);
+    }
+    return pid;
+}
+
+int main(int argc, char **argv)
+{
+    struct MLF_Params params;
+    int hogs = DEFAULT_HOGS, events = DEFAULT_EVENTS;
+    int hist[HIST_BUCKETS];
+    int pids[MAX_HOGS];
+    int arg = 1, sem, ticker, base, total, worst, i, rc;
+    volatile int j;
+
+    if (argc == 3 && !strcmp(argv[1], "hog")) {
+	Hog(atoi(argv[2]));
+	return 0;
+    }
+    if (argc == 3 && !strcmp(argv[1], "tick")) {
+	Ticker(atoi(argv[2]));
+	return 0;
+    }
+
+    MLF_Params(0, &params);
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+	if (!strcmp(argv[arg], "-q"))
+	    Parse_List(argv[arg + 1], params.quantum);
+	else if (!strcmp(argv[arg], "-d"))
+	    Parse_List(argv[arg + 1], params.demoteTicks);
+	else if (!strcmp(argv[arg], "-b"))
+	    params.boostInterval = atoi(argv[arg + 1]);
+	else
+	    Usage();
+	arg += 2;
+    }
+    if (arg < argc)
+	hogs = atoi(argv[arg++]);
+    if (arg < argc)
+	events = atoi(argv[arg++]);
+    if (arg < argc || hogs < 0 || hogs > MAX_HOGS || events < 1 || events > MAX_EVENTS)
+	Usage();
+
+    rc = MLF_Params(&params, 0);
+    if (rc < 0) {
+	Print("resptime: bad MLF parameters: %d\n", rc);
+	Exit(1);
+    }
+    Set_Scheduling_Policy(1, 4);
+    Print_Params(&params);
+
+    sem = Create_Semaphore("resptime", 0);
+
+    /* The hogs run for the whole test, and then some */
+    for (i = 0; i < hogs; ++i)
+	pids[i] = Spawn_Self("hog", PERIOD * (events + 2));
+    ticker = Spawn_Self("tick", events);
+
+    /*
+     * Event i is released at start + i * PERIOD.  We don't know start,
+     * so we take the earliest it can have been: the response to an
+     * event is the time it was handled, less i * PERIOD, less the
+     * smallest such difference seen.
+     */
+    for (i = 0; i < events; ++i) {
+	P(sem);
+	s_response[i] = Get_Time_Of_Day() - i * PERIOD;
+	for (j = 0; j < WORK_LOOPS; ++j)
+	    ;			/* a little work for the event */
+    }
+
+    base = s_response[0];
+    for (i = 1; i < events; ++i) {
+	if (s_response[i] < base)
+	    base = s_response[i];
+    }
+
+    memset(hist, '\0', sizeof(hist));
+    total = worst = 0;
+    for (i = 0; i < events; ++i) {
+	int response = s_response[i] - base;
+	total += response;
+	if (response > worst)
+	    worst = response;
+	++hist[response < HIST_BUCKETS ? response : HIST_BUCKETS - 1];
+    }
+
+    Print("%d events against %d hogs: response avg %d.%02d, max %d ticks\n",
+	events, hogs, total / events, (total % events) * 100 / events, worst);
+    Print("ticks:");
+    for (i = 0; i < HIST_BUCKETS; ++i)
+	Print(" %d%s:%d", i, i == HIST_BUCKETS - 1 ? "+" : "", hist[i]);
+    Print("\n");
+
+    Wait(ticker);
+    for (i = 0; i < hogs; ++i)
+	Wait(pids[i]);
+    Destroy_Semaphore(sem);
+
+    return 0;
+}
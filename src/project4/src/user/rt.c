@@ -0,0 +1,77 @@
+/*
+ * Real-time scheduling test
+ *
+ * Runs a periodic job in the earliest-deadline-first class while
+ * a CPU-bound copy of itself (started as "rt hog") competes for the
+ * processor, and reports how many deadlines were missed.
+ *
+ * usage: rt [period budget [jobs]]
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+#define DEFAULT_PERIOD	10
+#define DEFAULT_BUDGET	3
+#define DEFAULT_JOBS	50
+
+/* Wall-clock ticks of work done by each job; must fit in the budget */
+#define WORK_TICKS	1
+
+/*
+ * Spin without ever blocking, like long.c, for the given number of ticks.
+ */
+static void Hog(int ticks)
+{
+    int start = Get_Time_Of_Day();
+
+    while (Get_Time_Of_Day() - start < ticks)
+	;
+}
+
+int main(int argc, char **argv)
+{
+    int period = DEFAULT_PERIOD, budget = DEFAULT_BUDGET, jobs = DEFAULT_JOBS;
+    int hog, misses = 0, rc, i;
+
+    if (argc == 2 && !strcmp(argv[1], "hog")) {
+	Hog(DEFAULT_PERIOD * (DEFAULT_JOBS + 10));
+	return 0;
+    }
+
+    if (argc >= 3) {
+	period = atoi(argv[1]);
+	budget = atoi(argv[2]);
+	if (argc >= 4)
+	    jobs = atoi(argv[3]);
+    }
+
+    hog = Spawn_Program("/c/rt.exe", "/c/rt.exe hog");
+    if (hog < 0) {
+	Print("rt: could not start CPU hog: %d\n", hog);
+	Exit(1);
+    }
+
+    rc = Set_Real_Time(period, budget, 0);
+    if (rc < 0) {
+	Print("rt: not admitted (period %d, budget %d): %d\n", period, budget, rc);
+	Exit(1);
+    }
+
+    for (i = 0; i < jobs; i++) {
+	Hog(WORK_TICKS);
+	misses = Wait_Next_Period();
+    }
+
+    Set_Real_Time(0, 0, 0);
+    Print("rt: %d jobs (period %d, budget %d), %d deadline misses\n",
+	jobs, period, budget, misses);
+
+    Wait(hog);
+    return misses != 0;
+}
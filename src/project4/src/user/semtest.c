@@ -0,0 +1,87 @@
+/*
+ * Semaphore test
+ *
+ * Checks named semaphores and their handles, and times creating,
+ * using and destroying many of them at once.
+ *
+ * usage: semtest [count]
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <sema.h>
+#include <string.h>
+#include <geekos/errno.h>
+
+#define MAX_COUNT 4000
+
+static int s_handles[MAX_COUNT];
+
+static void Check(bool cond, const char *what)
+{
+    if (!cond) {
+	Print("semtest: FAILED: %s\n", what);
+	Exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int count = 2000, i, a, b, start;
+    char name[32];
+
+    if (argc > 1)
+	count = atoi(argv[1]);
+    if (count < 1 || count > MAX_COUNT) {
+	Print("semtest: count must be between 1 and %d\n", MAX_COUNT);
+	Exit(1);
+    }
+
+    /* Opening a name twice gives two handles on one semaphore */
+    a = Create_Semaphore("semtest", 1);
+    b = Create_Semaphore("semtest", 0);
+    Check(a >= 0 && b >= 0 && a != b, "open a semaphore twice");
+    Check(P(a) == 0, "P with count 1");
+    Check(V(b) == 0, "V through the other handle");
+    Check(P(b) == 0, "P after V");
+    Check(Destroy_Semaphore(a) == 0, "close first handle");
+    Check(P(a) == EINVALID, "P on a closed handle");
+    Check(V(b) == 0, "V on a semaphore with a handle left");
+    Check(Destroy_Semaphore(b) == 0, "close second handle");
+    Check(V(12345) == EINVALID, "V on a bad handle");
+    Check(Create_Semaphore("a name much too long for a semaphore", 1) == ENAMETOOLONG,
+	"create with a long name");
+    Check(Create_Semaphore("semtest", -1) == EINVALID, "create with a negative count");
+
+    Print("semtest: checks passed\n");
+
+    /* Times are in ticks */
+    start = Get_Time_Of_Day();
+    for (i = 0; i < count; ++i) {
+	snprintf(name, sizeof(name), "semtest%d", i);
+	s_handles[i] = Create_Semaphore(name, 1);
+	Check(s_handles[i] >= 0, "create many");
+    }
+    Print("created %d semaphores: %d ticks\n", count, Get_Time_Of_Day() - start);
+
+    /* Look them all up again by name */
+    start = Get_Time_Of_Day();
+    for (i = 0; i < count; ++i) {
+	snprintf(name, sizeof(name), "semtest%d", i);
+	a = Create_Semaphore(name, 0);
+	Check(a >= 0 && P(a) == 0, "reopen many");
+	Check(V(s_handles[i]) == 0 && Destroy_Semaphore(a) == 0, "release many");
+    }
+    Print("reopened %d semaphores: %d ticks\n", count, Get_Time_Of_Day() - start);
+
+    start = Get_Time_Of_Day();
+    for (i = 0; i < count; ++i)
+	Check(Destroy_Semaphore(s_handles[i]) == 0, "destroy many");
+    Print("destroyed %d semaphores: %d ticks\n", count, Get_Time_Of_Day() - start);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Spawn/exit stress test for multiprocessor kernels
+ *
+ * Spawns rounds of short-lived processes that each burn some CPU
+ * time and hit a shared semaphore, waits for them, and checks that
+ * every one got its own pid and exited with the code it was given.
+ * Run it on a kernel booted with several processors (for example
+ * "make run SMP=4"), alone or next to workload or rt.
+ *
+ * usage: smpstress [rounds [width]]
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <sema.h>
+#include <string.h>
+
+#define MAX_WIDTH 32
+
+static int s_pids[MAX_WIDTH];
+
+static void Check(bool cond, const char *what)
+{
+    if (!cond) {
+	Print("smpstress: FAILED: %s\n", what);
+	Exit(1);
+    }
+}
+
+/*
+ * Body of a child: spin for a while, taking and releasing the
+ * shared semaphore, then exit with the given code.
+ */
+static int Child(int code)
+{
+    int sem = Create_Semaphore("smpstress", 1);
+    volatile int sink = 0;
+    int i, j;
+
+    for (i = 0; i < 50; ++i) {
+	for (j = 0; j < 2000; ++j)
+	    sink += j;
+	P(sem);
+	V(sem);
+    }
+    Destroy_Semaphore(sem);
+    return code;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 20, width = 8, round, i, j, rc, start;
+    int lastPid = Get_PID();
+    char command[64];
+
+    if (argc == 3 && !strcmp(argv[1], "child"))
+	return Child(atoi(argv[2]));
+
+    if (argc > 1)
+	rounds = atoi(argv[1]);
+    if (argc > 2)
+	width = atoi(argv[2]);
+    if (rounds < 1 || width < 1 || width > MAX_WIDTH) {
+	Print("usage: %s [rounds [width]], width at most %d\n", argv[0], MAX_WIDTH);
+	Exit(1);
+    }
+
+    start = Get_Time_Of_Day();
+    for (round = 0; round < rounds; ++round) {
+	for (i = 0; i < width; ++i) {
+	    snprintf(command, sizeof(command), "/c/smpstress.exe child %d", i + 1);
+	    s_pids[i] = Spawn_Program("/c/smpstress.exe", command);
+	    Check(s_pids[i] > 0, "spawn a child");
+	    for (j = 0; j < i; ++j)
+		Check(s_pids[j] != s_pids[i], "children get distinct pids");
+	}
+	for (i = 0; i < width; ++i) {
+	    Check(s_pids[i] > lastPid, "pids keep increasing");
+	    rc = Wait(s_pids[i]);
+	    Check(rc == i + 1, "child exit code");
+	}
+	for (i = 0; i < width; ++i) {
+	    if (s_pids[i] > lastPid)
+		lastPid = s_pids[i];
+	}
+    }
+
+    Print("smpstress: %d processes in %d rounds, %d ticks\n",
+	rounds * width, rounds, Get_Time_Of_Day() - start);
+    Print("smpstress: checks passed\n");
+    return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * System call statistics
+ *
+ * Prints how often each system call was made and how long it took,
+ * with a log2 histogram of its latency in TSC cycles, and how many
+ * returns to user mode had to load the user address space.  If a
+ * program is given, it is run and the report covers just that run.
+ *
+ * usage: sysstat [program [args...]]
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <string.h>
+#include <kstat.h>
+#include <geekos/syscall.h>
+
+#define CMDLEN 79
+
+/* Room for every system call the kernel keeps statistics for */
+#define MAX_STATS 64
+
+static const char *s_syscallNames[MAX_STATS] = {
+    [SYS_NULL] = "Null",
+    [SYS_EXIT] = "Exit",
+    [SYS_PRINTSTRING] = "PrintString",
+    [SYS_GETKEY] = "GetKey",
+    [SYS_SETATTR] = "SetAttr",
+    [SYS_GETCURSOR] = "GetCursor",
+    [SYS_PUTCURSOR] = "PutCursor",
+    [SYS_SPAWN] = "Spawn",
+    [SYS_WAIT] = "Wait",
+    [SYS_GETPID] = "GetPID",
+    [SYS_SETSCHEDULINGPOLICY] = "SetSchedulingPolicy",
+    [SYS_GETTIMEOFDAY] = "GetTimeOfDay",
+    [SYS_CREATESEMAPHORE] = "CreateSemaphore",
+    [SYS_P] = "P",
+    [SYS_V] = "V",
+    [SYS_DESTROYSEMAPHORE] = "DestroySemaphore",
+    [SYS_INTRTRACE] = "IntrTrace",
+    [SYS_SYSCALLSTAT] = "SyscallStat",
+    [SYS_PROCSTAT] = "ProcStat",
+    [SYS_MLFPARAMS] = "MLFParams",
+    [SYS_SWITCHSTAT] = "SwitchStat",
+    [SYS_MLFLEVEL] = "MLFLevel",
+    [SYS_SETREALTIME] = "SetRealTime",
+    [SYS_WAITPERIOD] = "WaitPeriod",
+};
+
+static struct Syscall_Stat s_before[MAX_STATS], s_after[MAX_STATS];
+
+/*
+ * Get the statistics of every system call.
+ * Returns the number of system calls.
+ */
+static int Snapshot(struct Syscall_Stat *stats)
+{
+    int num;
+
+    for (num = 0; num < MAX_STATS; ++num) {
+	if (Get_Syscall_Stat(num, &stats[num]) != 0)
+	    break;
+    }
+    return num;
+}
+
+/*
+ * Divide a 64 bit total by a count, without 64 bit division
+ * (there is no libgcc), dropping low bits of the total as needed.
+ */
+static ulong_t Average(unsigned long long total, ulong_t count)
+{
+    int shift = 0;
+
+    if (count == 0)
+	return 0;
+    while (total >> 32) {
+	total >>= 1;
+	++shift;
+    }
+    return ((ulong_t) total / count) << shift;
+}
+
+static void Print_Stat(int num, const struct Syscall_Stat *before, const struct Syscall_Stat *after)
+{
+    ulong_t count = after->count - before->count;
+    ulong_t returned = after->numReturned - before->numReturned;
+    unsigned long long cycles = after->cycles - before->cycles;
+    int i;
+
+    if (count == 0)
+	return;
+
+    if (s_syscallNames[num] != 0)
+	Print("%-20s", s_syscallNames[num]);
+    else
+	Print("%-20d", num);
+    Print("%8lu %12lu %10lu %10lu\n", count, (ulong_t) (cycles >> 10),
+	Average(cycles, returned), after->maxCycles);
+
+    /* Histogram: log2 of the cycles, and the number of calls */
+    Print("   ");
+    for (i = 0; i < SYSCALL_HIST_BUCKETS; ++i) {
+	ulong_t n = after->hist[i] - before->hist[i];
+	if (n != 0)
+	    Print(" 2^%d:%lu", i, n);
+    }
+    Print("\n");
+}
+
+/*
+ * Report how many returns to user mode had to load the address
+ * space, and what the loads cost.
+ */
+static void Print_Switch_Stat(const struct Switch_Stat *before, const struct Switch_Stat *after)
+{
+    ulong_t reloads = after->numReloads - before->numReloads;
+    unsigned long long cycles = after->reloadCycles - before->reloadCycles;
+
+    Print("\n%lu returns to user mode, %lu address space loads, avg %lu, max %lu cycles,"
+	" %lu kcycles in all\n",
+	after->numSwitches - before->numSwitches, reloads, Average(cycles, reloads),
+	after->maxReloadCycles, (ulong_t) (cycles >> 10));
+}
+
+int main(int argc, char **argv)
+{
+    char command[CMDLEN + 1];
+    struct Process_Syscall_Stat self;
+    struct Switch_Stat switchBefore, switchAfter;
+    int numStats, num;
+
+    memset(s_before, '\0', sizeof(s_before));
+    memset(&switchBefore, '\0', sizeof(switchBefore));
+
+    if (argc > 1) {
+	int pid, i;
+
+	/* Rebuild the command line of the program to run */
+	command[0] = '\0';
+	for (i = 1; i < argc; ++i) {
+	    if (strlen(command) + strlen(argv[i]) + 1 > CMDLEN) {
+		Print("sysstat: command line too long\n");
+		Exit(1);
+	    }
+	    if (i > 1)
+		strcat(command, " ");
+	    strcat(command, argv[i]);
+	}
+
+	Snapshot(s_before);
+	Get_Switch_Stat(&switchBefore);
+	pid = Spawn_With_Path(argv[1], command, "/c:/a");
+	if (pid < 0) {
+	    Print("sysstat: could not spawn %s: %s\n", argv[1], Get_Error_String(pid));
+	    Exit(1);
+	}
+	Wait(pid);
+    }
+
+    numStats = Snapshot(s_after);
+    Get_Switch_Stat(&switchAfter);
+
+    /* The max column is since boot; the rest cover the run */
+    Print("%-20s%8s %12s %10s %10s\n", "syscall", "calls", "kcycles", "avg", "max");
+    for (num = 0; num < numStats; ++num)
+	Print_Stat(num, &s_before[num], &s_after[num]);
+
+    Print_Switch_Stat(&switchBefore, &switchAfter);
+
+    if (argc > 1 && Get_Process_Syscall_Stat(0, &self) == 0) {
+	Print("%s: %lu system calls, %lu kcycles (including its children)\n",
+	    argv[1], self.childCount, (ulong_t) (self.childCycles >> 10));
+    }
+
+    return 0;
+}
@@ -94,6 +94,7 @@ int Open_Block_Device(const char *name, struct Block_Device **pDev);
 int Close_Block_Device(struct Block_Device *dev);
 struct Block_Request *Create_Request(struct Block_Device *dev, enum Request_Type type,
     int blockNum, void *buf);
+void Destroy_Request(struct Block_Request *request);
 void Post_Request_And_Wait(struct Block_Request *request);
 struct Block_Request *Dequeue_Request(struct Block_Request_List *requestQueue,
     struct Thread_Queue *waitQueue);
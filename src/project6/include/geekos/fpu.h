@@ -0,0 +1,25 @@
+/*
+ * Lazy x87/SSE context switching
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_FPU_H
+#define GEEKOS_FPU_H
+
+struct Kernel_Thread;
+
+/*
+ * Thread whose state is currently loaded in the FPU/SSE registers,
+ * or null.  Switch_To_Thread() and Handle_Interrupt() in lowlevel.asm
+ * set CR0.TS whenever any other thread is switched in, so its first
+ * FPU or SSE instruction traps to the device-not-available handler,
+ * which moves the register state over.
+ */
+extern struct Kernel_Thread* g_fpuOwner;
+
+void Init_FPU(void);
+void FPU_Release(struct Kernel_Thread* kthread);
+
+#endif  /* GEEKOS_FPU_H */
@@ -0,0 +1,16 @@
+/*
+ * Futexes: wait queues keyed by the address of a user word
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_FUTEX_H
+#define GEEKOS_FUTEX_H
+
+#include <geekos/ktypes.h>
+
+int Futex_Wait(ulong_t userAddr, int expected);
+int Futex_Wake(ulong_t userAddr, int count);
+
+#endif  /* GEEKOS_FUTEX_H */
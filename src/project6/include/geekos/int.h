@@ -126,6 +126,21 @@ do {					\
     __Enable_Interrupts();		\
 } while (0)
 
+/*
+ * Unblock interrupts and halt the CPU until the next one arrives.
+ * The sti only takes effect after the following instruction, so
+ * an interrupt cannot slip in between the two and be missed.
+ */
+static __inline__ void __Enable_Interrupts_And_Halt(void)
+{
+    __asm__ __volatile__ ("sti; hlt");
+}
+#define Enable_Interrupts_And_Halt()	\
+do {					\
+    KASSERT(!Interrupts_Enabled());	\
+    __Enable_Interrupts_And_Halt();	\
+} while (0)
+
 /*
  * Dump interrupt state struct to screen
  */
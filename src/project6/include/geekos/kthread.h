@@ -14,6 +14,7 @@
 #include <geekos/list.h>
 
 struct Kernel_Thread;
+struct Mutex;
 struct User_Context;
 struct Interrupt_State;
 
@@ -56,9 +57,12 @@ struct Kernel_Thread {
     /* Link fields for list of all threads in the system. */
     DEFINE_LINK(All_Thread_List, Kernel_Thread);
 
-    /* Array of MAX_TLOCAL_KEYS pointers to thread-local data. */
+    /*
+     * Array of MAX_TLOCAL_KEYS pointers to thread-local data.
+     * Allocated the first time the thread stores a value.
+     */
 #define MAX_TLOCAL_KEYS 128
-    const void* tlocalData[MAX_TLOCAL_KEYS];
+    const void** tlocalData;
 
     /*
      * The run queue level that the thread should be put on
@@ -66,6 +70,29 @@ struct Kernel_Thread {
      */
     int currentReadyQueue;
     bool blocked;
+
+    /*
+     * Priority inheritance.  priority is the effective priority,
+     * basePriority the one the thread was created with.  While a
+     * waiter on one of its mutexes lends the thread a higher run
+     * queue level, baseReadyQueue is the level the thread would be
+     * at otherwise; it is -1 when no level is lent.  While blocked
+     * on a mutex, waitingOn points to it; heldMutexes lists the
+     * mutexes the thread currently owns.
+     */
+    int basePriority;
+    int baseReadyQueue;
+    struct Mutex* waitingOn;
+    struct Mutex* heldMutexes;
+
+    /*
+     * Save area for the FPU/SSE registers, allocated the first
+     * time the thread uses them (see fpu.c).
+     */
+    void* fpuState;
+
+    /* Physical address of the futex word the thread is waiting on */
+    ulong_t futexKey;
 };
 
 /*
@@ -114,6 +141,7 @@ struct Kernel_Thread* Start_Kernel_Thread(
 struct Kernel_Thread* Start_User_Thread(struct User_Context* userContext, bool detached);
 void Make_Runnable(struct Kernel_Thread* kthread);
 void Make_Runnable_Atomic(struct Kernel_Thread* kthread);
+void Set_Ready_Queue(struct Kernel_Thread* kthread, int level);
 struct Kernel_Thread* Get_Current(void);
 struct Kernel_Thread* Get_Next_Runnable(void);
 void Schedule(void);
@@ -158,7 +186,7 @@ typedef void (*tlocal_destructor_t)(void *);
 typedef unsigned int tlocal_key_t;
 
 extern int Tlocal_Create(tlocal_key_t *, tlocal_destructor_t);
-extern void Tlocal_Put(tlocal_key_t, const void *);
+extern int Tlocal_Put(tlocal_key_t, const void *);
 extern void *Tlocal_Get(tlocal_key_t);
 
 /* Print list of all threads, for debugging. */
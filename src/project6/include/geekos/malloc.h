@@ -15,5 +15,6 @@
 void Init_Heap(ulong_t start, ulong_t size);
 void* Malloc(ulong_t size);
 void Free(void* buf);
+ulong_t Get_Heap_Pages(void);
 
 #endif  /* GEEKOS_MALLOC_H */
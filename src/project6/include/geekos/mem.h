@@ -15,6 +15,7 @@
 #include <geekos/defs.h>
 #include <geekos/list.h>
 #include <geekos/paging.h>
+#include <geekos/pagestat.h>
 
 struct Boot_Info;
 
@@ -29,6 +30,10 @@ struct Boot_Info;
 #define PAGE_HEAP      0x0010	 /* page is in kernel heap */
 #define PAGE_PAGEABLE  0x0020	 /* page can be paged out */
 #define PAGE_LOCKED    0x0040    /* page is taken should not be freed */
+#define PAGE_PINNED    0x0080	 /* pageable page kept in memory for now */
+#define PAGE_BUDDY     0x0100	 /* page heads a free block of the buddy allocator */
+#define PAGE_ACTIVE    0x0200	 /* page is on the active list */
+#define PAGE_INACTIVE  0x0400	 /* page is on the inactive list */
 
 /*
  * PC memory map
@@ -61,9 +66,10 @@ DEFINE_LIST(Page_List, Page);
 struct Page {
     unsigned flags;			 /* Flags indicating state of page */
     DEFINE_LINK(Page_List, Page);	 /* Link fields for Page_List */
-    int clock;
+    int order;				 /* log2 of the size of the block it heads, in pages */
     ulong_t vaddr;			 /* User virtual address where page is mapped */
     pte_t *entry;			 /* Page table entry referring to the page */
+    int pinCount;			 /* number of Pin_Page() calls not yet undone */
 };
 
 IMPLEMENT_LIST(Page_List, Page);
@@ -71,8 +77,29 @@ IMPLEMENT_LIST(Page_List, Page);
 void Init_Mem(struct Boot_Info* bootInfo);
 void Init_BSS(void);
 void* Alloc_Page(void);
+void* Alloc_Pages(int order);
+void* Alloc_Zeroed_Page(void);
+bool Zero_Free_Page(void);
 void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr);
+void Activate_Page(struct Page* page);
+void Pin_Page(struct Page* page);
+void Unpin_Page(struct Page* page);
 void Free_Page(void* pageAddr);
+void Free_Pages(void* pageAddr, int order);
+void Free_Heap_Pages(void* start, ulong_t size);
+
+/*
+ * Get the smallest order of a block of pages holding given number
+ * of bytes, or BUDDY_ORDERS if no block is that large.
+ */
+static __inline__ int Pages_Order(ulong_t numBytes)
+{
+    int order = 0;
+
+    while (order < BUDDY_ORDERS && ((ulong_t) PAGE_SIZE << order) < numBytes)
+	++order;
+    return order;
+}
 
 /*
  * Determine if given address is a multiple of the page size.
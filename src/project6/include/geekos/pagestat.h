@@ -0,0 +1,39 @@
+/*
+ * Physical memory statistics
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_PAGESTAT_H
+#define GEEKOS_PAGESTAT_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * Number of block sizes in the buddy allocator: blocks of
+ * 2^0 to 2^(BUDDY_ORDERS-1) pages (4KB to 4MB).
+ */
+#define BUDDY_ORDERS 11
+
+/*
+ * A snapshot of free physical memory.  Free pages are either in
+ * the buddy allocator's free blocks or in the zeroed page pool.
+ */
+struct Page_Stats {
+    ulong_t numPages;			/* pages of physical memory */
+    ulong_t freePages;			/* free pages, including the zeroed ones */
+    ulong_t zeroedPages;		/* pages in the zeroed page pool */
+    ulong_t heapPages;			/* pages held by the kernel heap */
+    ulong_t activePages;		/* pageable pages on the active list */
+    ulong_t inactivePages;		/* pageable pages on the inactive list */
+    ulong_t freeBlocks[BUDDY_ORDERS];	/* free blocks of 2^k pages */
+};
+
+#if defined(GEEKOS)
+
+void Get_Page_Stats(struct Page_Stats* stats);
+
+#endif  /* defined(GEEKOS) */
+
+#endif  /* GEEKOS_PAGESTAT_H */
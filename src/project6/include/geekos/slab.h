@@ -0,0 +1,83 @@
+/*
+ * Slab allocator for kernel objects
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SLAB_H
+#define GEEKOS_SLAB_H
+
+#include <geekos/ktypes.h>
+
+/* Longest cache name reported in statistics */
+#define SLAB_NAME_LEN 23
+
+/*
+ * Usage statistics of a slab cache.
+ */
+struct Slab_Stats {
+    char name[SLAB_NAME_LEN+1];
+    ulong_t objSize;		/* bytes per object, as requested */
+    ulong_t objsPerSlab;	/* objects that fit in a slab */
+    ulong_t pagesPerSlab;
+    ulong_t numSlabs;		/* slabs the cache holds now */
+    ulong_t inUse;		/* objects allocated now */
+    ulong_t maxInUse;		/* most objects ever allocated at once */
+    ulong_t numAllocs;		/* calls to Slab_Alloc() */
+    ulong_t numFrees;		/* calls to Slab_Free() */
+    ulong_t numGrows;		/* slabs taken from the page allocator */
+    ulong_t numShrinks;		/* slabs given back to it */
+};
+
+#if defined(GEEKOS)
+
+#include <geekos/list.h>
+
+struct Slab;
+struct Slab_Cache;
+
+DEFINE_LIST(Slab_List, Slab);
+DEFINE_LIST(Slab_Cache_List, Slab_Cache);
+
+/*
+ * A cache of objects of one type.  Objects are carved out of slabs,
+ * which are blocks of pages from the page allocator, and freed
+ * objects are kept in their slab to be handed out again.
+ *
+ * If the cache has a constructor, it is run once on each object when
+ * its slab is made, not on every allocation: users must give objects
+ * back in their constructed state.
+ */
+struct Slab_Cache {
+    const char* name;
+    ulong_t objSize;
+    void (*ctor)(void* obj);
+
+    /* Layout of a slab; set up when the first one is made */
+    ulong_t bufSize;		/* object, free link and padding */
+    int order;			/* slab is 2^order pages */
+    ulong_t objsPerSlab;
+
+    /* Slabs with free objects, partly used ones first */
+    struct Slab_List freeSlabs;
+    struct Slab_List fullSlabs;
+    int numEmptySlabs;
+
+    struct Slab_Stats stats;
+
+    DEFINE_LINK(Slab_Cache_List, Slab_Cache);
+};
+
+/*
+ * Initializer for a statically allocated cache of objects of given type.
+ */
+#define SLAB_CACHE_INITIALIZER(name, type, ctor) { (name), sizeof(type), (ctor) }
+
+void* Slab_Alloc(struct Slab_Cache* cache);
+void Slab_Free(struct Slab_Cache* cache, void* obj);
+int Get_Slab_Stats(int index, struct Slab_Stats* stats);
+
+#endif  /* defined(GEEKOS) */
+
+#endif  /* GEEKOS_SLAB_H */
@@ -21,9 +21,10 @@ struct Mutex {
     int state;
     struct Kernel_Thread* owner;
     struct Thread_Queue waitQueue;
+    struct Mutex* nextHeld;	/* next in owner's list of held mutexes */
 };
 
-#define MUTEX_INITIALIZER { MUTEX_UNLOCKED, 0, THREAD_QUEUE_INITIALIZER }
+#define MUTEX_INITIALIZER { MUTEX_UNLOCKED, 0, THREAD_QUEUE_INITIALIZER, 0 }
 
 struct Condition {
     struct Thread_Queue waitQueue;
@@ -68,6 +68,11 @@ enum {
     SYS_SYNC,		 /* Sync filesystems system call  */
     SYS_FORMAT,		 /* Format filesystem system call  */
     SYS_CREATEPIPE,	 /* CreatePipe system call. */
+    SYS_SLEEP,		 /* Sleep system call  */
+    SYS_FUTEXWAIT,	 /* Wait on a futex system call */
+    SYS_FUTEXWAKE,	 /* Wake futex waiters system call */
+    SYS_PAGESTAT,	 /* Get physical memory statistics system call */
+    SYS_SLABSTAT,	 /* Get slab cache statistics system call */
 };
 
 /*
@@ -12,6 +12,14 @@
 
 #define TIMER_IRQ 0
 
+/*
+ * Ticks per second.  The makefile normally sets this;
+ * the 8254 PIT can't go slower than about 18.2 Hz.
+ */
+#ifndef TICKS_PER_SEC
+#  define TICKS_PER_SEC 100
+#endif
+
 extern volatile ulong_t g_numTicks;
 
 typedef void (*timerCallback)(int);
@@ -20,16 +28,13 @@ void Init_Timer(void);
 
 void Micro_Delay(int us);
 
-typedef struct {
-    int ticks;				 /* timer code decrements this */
-    int id;				 /* unqiue id for this timer even */
-    timerCallback callBack;		 /* Queue to wakeup on timer expire */
-    int origTicks;
-} timerEvent;
-
 int Start_Timer(int ticks, timerCallback);
 int Get_Remaing_Timer_Ticks(int id);
 int Cancel_Timer(int id);
+int Sleep(int ticks);
+
+void Timer_Stop_Tick(void);
+void Timer_Restart_Tick(void);
 
 void Micro_Delay(int us);
 
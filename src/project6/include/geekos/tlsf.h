@@ -0,0 +1,58 @@
+/*
+ * Two-level segregated fit (TLSF) memory allocator
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_TLSF_H
+#define GEEKOS_TLSF_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * Free blocks are kept in lists by size class.  The first level
+ * splits sizes by powers of 2, and the second level splits each
+ * power of 2 into 2^TLSF_SL_LOG2 equal ranges.  Sizes below
+ * TLSF_SMALL_SIZE go into first level 0, split linearly.
+ */
+#define TLSF_ALIGN_LOG2 3
+#define TLSF_ALIGN (1 << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2 5
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_SIZE (1 << TLSF_FL_SHIFT)
+
+/* Largest block is just under 2^TLSF_FL_MAX bytes */
+#define TLSF_FL_MAX 30
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+struct TLSF_Block;
+
+/*
+ * A heap made of one or more pools of memory.
+ * All zeroes is an empty heap.
+ */
+struct TLSF_Heap {
+    ulong_t flBitmap;			/* first levels with free blocks */
+    ulong_t slBitmap[TLSF_FL_COUNT];	/* second levels with free blocks */
+    struct TLSF_Block* freeLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+};
+
+/*
+ * Free space in a heap.
+ */
+struct TLSF_Stats {
+    ulong_t freeBytes;
+    ulong_t largestFree;
+    ulong_t numFreeBlocks;
+};
+
+void TLSF_Add_Pool(struct TLSF_Heap* heap, void* start, ulong_t size);
+void* TLSF_Alloc(struct TLSF_Heap* heap, ulong_t size);
+void* TLSF_Free(struct TLSF_Heap* heap, void* buf);
+void TLSF_Remove_Pool(struct TLSF_Heap* heap, void* pool);
+ulong_t TLSF_Pool_Size(ulong_t size);
+void TLSF_Get_Stats(struct TLSF_Heap* heap, struct TLSF_Stats* stats);
+
+#endif  /* GEEKOS_TLSF_H */
@@ -101,6 +101,7 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
     struct User_Context **pUserContext);
 bool Copy_From_User(void* destInKernel, ulong_t srcInUser, ulong_t bufSize);
 bool Copy_To_User(ulong_t destInUser, void* srcInKernel, ulong_t bufSize);
+bool User_To_Physical(struct User_Context* context, ulong_t userAddr, ulong_t* paddr);
 void Switch_To_Address_Space(struct User_Context *userContext);
 
 
@@ -119,6 +119,7 @@ int Sync(void);
 /* File operations. */
 struct File *Allocate_File(struct File_Ops *ops, int filePos, int endPos, void *fsData,
     int mode, struct Mount_Point *mountPoint);
+void Free_File(struct File *file);
 int FStat(struct File *file, struct VFS_File_Stat *stat);
 int Read(struct File *file, void *buf, ulong_t len);
 int Write(struct File *file, void *buf, ulong_t len);
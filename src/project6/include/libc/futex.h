@@ -0,0 +1,44 @@
+/*
+ * Futexes, and mutexes and semaphores built on them
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <geekos/ktypes.h>
+
+int Futex_Wait(volatile int *addr, int expected);
+int Futex_Wake(volatile int *addr, int count);
+
+/*
+ * Mutex and semaphore that only enter the kernel when a thread
+ * has to sleep, or has to wake a sleeping one.  They work between
+ * any threads that can see the same memory.
+ */
+struct Fast_Mutex {
+    volatile int state;		/* 0 unlocked, 1 locked, 2 locked with waiters */
+};
+
+#define FAST_MUTEX_INITIALIZER { 0 }
+
+struct Fast_Semaphore {
+    volatile int count;
+    volatile int numWaiters;
+};
+
+#define FAST_SEMAPHORE_INITIALIZER(count) { (count), 0 }
+
+void Fast_Mutex_Init(struct Fast_Mutex *mutex);
+void Fast_Mutex_Lock(struct Fast_Mutex *mutex);
+bool Fast_Mutex_Trylock(struct Fast_Mutex *mutex);
+void Fast_Mutex_Unlock(struct Fast_Mutex *mutex);
+
+void Fast_Sem_Init(struct Fast_Semaphore *sem, int count);
+void Fast_Sem_P(struct Fast_Semaphore *sem);
+bool Fast_Sem_Try_P(struct Fast_Semaphore *sem);
+void Fast_Sem_V(struct Fast_Semaphore *sem);
+
+#endif  /* FUTEX_H */
@@ -0,0 +1,17 @@
+/*
+ * Kernel statistics system calls
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef KSTAT_H
+#define KSTAT_H
+
+#include <geekos/pagestat.h>
+#include <geekos/slab.h>
+
+int Get_Memory_Stats(struct Page_Stats* stats);
+int Get_Slab_Cache_Stats(int index, struct Slab_Stats* stats);
+
+#endif  /* KSTAT_H */
@@ -13,6 +13,7 @@
 
 int Set_Scheduling_Policy(int policy, int quantum);
 int Get_Time_Of_Day(void);
+int Sleep(int ms);
 
 #endif  /* SCHED_H */
 
@@ -446,7 +446,7 @@
 					 memory more efficiently, but
 					 allocation will be much slower. */
 
-/*#define BECtl	    1*/		      /* Define this symbol to enable the
+#define BECtl	    1		      /* Define this symbol to enable the
 					 bectl() function for automatic
 					 pool space control.  */
 
@@ -14,6 +14,7 @@
 #include <geekos/int.h>
 #include <geekos/kthread.h>
 #include <geekos/synch.h>
+#include <geekos/slab.h>
 #include <geekos/blockdev.h>
 
 /*#define BLOCKDEV_DEBUG */
@@ -44,6 +45,21 @@ IMPLEMENT_LIST(Block_Device_List, Block_Device);
  */
 static struct Block_Device_List s_deviceList;
 
+static void Construct_Request(void *obj);
+
+/*
+ * Cache of block requests.  A request is given back with
+ * its wait queue empty, so the queue is set up only once.
+ */
+static struct Slab_Cache s_requestCache =
+    SLAB_CACHE_INITIALIZER("block request", struct Block_Request, &Construct_Request);
+
+static void Construct_Request(void *obj)
+{
+    struct Block_Request *request = obj;
+    Clear_Thread_Queue(&request->waitQueue);
+}
+
 /*
  * Perform a block IO request.
  * Returns 0 if successful, error code on failure.
@@ -58,7 +74,7 @@ static int Do_Request(struct Block_Device *dev, enum Request_Type type, int bloc
 	return ENOMEM;
     Post_Request_And_Wait(request);
     rc = request->errorCode;
-    Free(request);
+    Destroy_Request(request);
     return rc;
 }
 
@@ -164,18 +180,27 @@ int Close_Block_Device(struct Block_Device *dev)
 struct Block_Request *Create_Request(struct Block_Device *dev, enum Request_Type type,
     int blockNum, void *buf)
 {
-    struct Block_Request *request = Malloc(sizeof(*request));
+    struct Block_Request *request = Slab_Alloc(&s_requestCache);
     if (request != 0) {
 	request->dev = dev;
 	request->type = type;
 	request->blockNum = blockNum;
 	request->buf = buf;
 	request->state = PENDING;
-	Clear_Thread_Queue(&request->waitQueue);
+	KASSERT(Is_Thread_Queue_Empty(&request->waitQueue));
     }
     return request;
 }
 
+/*
+ * Free a block device request once it has been completed.
+ */
+void Destroy_Request(struct Block_Request *request)
+{
+    KASSERT(request->state != PENDING);
+    Slab_Free(&s_requestCache, request);
+}
+
 /*
  * Send a block IO request to a device and wait for it to be handled.
  * Returns when the driver completes the requests or signals
@@ -11,6 +11,7 @@
 #include <geekos/kassert.h>
 #include <geekos/mem.h>
 #include <geekos/malloc.h>
+#include <geekos/slab.h>
 #include <geekos/blockdev.h>
 #include <geekos/bufcache.h>
 
@@ -19,6 +20,12 @@
  */
 #define FS_BUFFER_CACHE_MAX_BLOCKS 128
 
+/*
+ * Buffer objects for all filesystems.
+ */
+static struct Slab_Cache s_bufferCache =
+    SLAB_CACHE_INITIALIZER("fs buffer", struct FS_Buffer, 0);
+
 /* ----------------------------------------------------------------------
  * Private functions
  * ---------------------------------------------------------------------- */
@@ -130,11 +137,11 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
      * limit, allocate a new one.
      */
     if (cache->numCached < FS_BUFFER_CACHE_MAX_BLOCKS) {
-	buf = (struct FS_Buffer*) Malloc(sizeof(*buf));
+	buf = (struct FS_Buffer*) Slab_Alloc(&s_bufferCache);
 	if (buf != 0) {
 	    buf->data = Alloc_Page();
 	    if (buf->data == 0)
-		Free(buf);
+		Slab_Free(&s_bufferCache, buf);
 	    else {
 		/* Successful creation */
 		buf->fsBlockNum = fsBlockNum;
@@ -214,7 +221,7 @@ static void Free_Buffer(struct FS_Buffer *buf)
 {
     KASSERT(!(buf->flags & (FS_BUFFER_DIRTY | FS_BUFFER_INUSE)));
     Free_Page(buf->data);
-    Free(buf);
+    Slab_Free(&s_bufferCache, buf);
 }
 
 /* ----------------------------------------------------------------------
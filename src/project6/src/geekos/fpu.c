@@ -0,0 +1,172 @@
+/*
+ * Lazy x87/SSE context switching
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/screen.h>
+#include <geekos/int.h>
+#include <geekos/idt.h>
+#include <geekos/malloc.h>
+#include <geekos/kthread.h>
+#include <geekos/fpu.h>
+
+/*
+ * NOTES:
+ * - Threads get no FPU state until they execute their first
+ *   FPU or SSE instruction, so threads that never use the FPU
+ *   cost nothing beyond a CR0 check on each context switch.
+ * - The registers are only saved when another thread traps on
+ *   them, so a thread that is the only FPU user keeps its state
+ *   in the registers across any number of context switches.
+ */
+
+/* ----------------------------------------------------------------------
+ * Private data and functions
+ * ---------------------------------------------------------------------- */
+
+#define CR0_MP 0x00000002	/* monitor coprocessor: WAIT traps on TS too */
+#define CR0_EM 0x00000004	/* emulate FPU */
+#define CR0_TS 0x00000008	/* task switched */
+#define CR0_NE 0x00000020	/* native FPU error reporting */
+
+#define CR4_OSFXSR     0x00000200	/* enable FXSAVE/FXRSTOR and SSE */
+#define CR4_OSXMMEXCPT 0x00000400	/* report SIMD exceptions as #XM */
+
+#define CPUID_FXSR 0x01000000
+#define CPUID_SSE  0x02000000
+
+/*
+ * An FXSAVE area is 512 bytes and must be 16 byte aligned;
+ * the older FNSAVE format only needs 108 bytes.
+ */
+#define FPU_STATE_SIZE  512
+#define FPU_STATE_ALIGN 16
+
+#define MXCSR_DEFAULT 0x1f80
+
+/* Interrupt raised by FPU/SSE instructions while CR0.TS is set. */
+#define DEVICE_NOT_AVAILABLE_INT 7
+
+struct Kernel_Thread* g_fpuOwner;
+
+static bool s_haveFxsr;
+static bool s_haveSse;
+
+/*
+ * Get the save area of given thread, aligned as FXSAVE needs.
+ */
+static __inline__ void* FPU_State_Area(struct Kernel_Thread* kthread)
+{
+    return (void*) (((ulong_t) kthread->fpuState + FPU_STATE_ALIGN - 1) & ~(FPU_STATE_ALIGN - 1));
+}
+
+static void Save_FPU_State(void* area)
+{
+    if (s_haveFxsr)
+	__asm__ __volatile__ ("fxsave (%0)" : : "r" (area) : "memory");
+    else
+	__asm__ __volatile__ ("fnsave (%0)" : : "r" (area) : "memory");
+}
+
+static void Restore_FPU_State(void* area)
+{
+    if (s_haveFxsr)
+	__asm__ __volatile__ ("fxrstor (%0)" : : "r" (area) : "memory");
+    else
+	__asm__ __volatile__ ("frstor (%0)" : : "r" (area) : "memory");
+}
+
+/*
+ * Handler for the device-not-available trap: the current thread
+ * used the FPU while CR0.TS was set.  Save the owner's registers,
+ * load the current thread's (giving it a clean state the first
+ * time), and make it the owner.
+ */
+static void Device_Not_Available_Handler(struct Interrupt_State* state)
+{
+    struct Kernel_Thread* current = g_currentThread;
+    bool firstUse = false;
+
+    KASSERT(!Interrupts_Enabled());
+
+    __asm__ __volatile__ ("clts");
+
+    if (g_fpuOwner == current)
+	return;
+
+    if (current->fpuState == 0) {
+	current->fpuState = Malloc(FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+	if (current->fpuState == 0) {
+	    Print("Out of memory for FPU state of thread %d\n", current->pid);
+	    Exit(-1);
+	}
+	firstUse = true;
+    }
+
+    if (g_fpuOwner != 0)
+	Save_FPU_State(FPU_State_Area(g_fpuOwner));
+
+    if (firstUse) {
+	__asm__ __volatile__ ("fninit");
+	if (s_haveSse) {
+	    ulong_t mxcsr = MXCSR_DEFAULT;
+	    __asm__ __volatile__ ("ldmxcsr %0" : : "m" (mxcsr));
+	}
+    } else {
+	Restore_FPU_State(FPU_State_Area(current));
+    }
+
+    g_fpuOwner = current;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Enable the FPU, and SSE if the processor has it, with
+ * CR0.TS set so the first use by any thread traps.
+ */
+void Init_FPU(void)
+{
+    ulong_t eax = 1, ebx, ecx, edx;
+    ulong_t cr0, cr4;
+
+    __asm__ __volatile__ ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    s_haveFxsr = (edx & CPUID_FXSR) != 0;
+    s_haveSse = s_haveFxsr && (edx & CPUID_SSE) != 0;
+
+    __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE | CR0_TS;
+    __asm__ __volatile__ ("mov %0, %%cr0" : : "r" (cr0));
+
+    if (s_haveFxsr) {
+	__asm__ __volatile__ ("mov %%cr4, %0" : "=r" (cr4));
+	cr4 |= CR4_OSFXSR;
+	if (s_haveSse)
+	    cr4 |= CR4_OSXMMEXCPT;
+	__asm__ __volatile__ ("mov %0, %%cr4" : : "r" (cr4));
+    }
+
+    Install_Interrupt_Handler(DEVICE_NOT_AVAILABLE_INT, &Device_Not_Available_Handler);
+}
+
+/*
+ * Forget the FPU state of a thread that is being destroyed.
+ * Must be called with interrupts disabled!
+ */
+void FPU_Release(struct Kernel_Thread* kthread)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (g_fpuOwner == kthread)
+	g_fpuOwner = 0;
+    if (kthread->fpuState != 0) {
+	Free(kthread->fpuState);
+	kthread->fpuState = 0;
+    }
+}
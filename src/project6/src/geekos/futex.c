@@ -0,0 +1,142 @@
+/*
+ * Futexes: wait queues keyed by the address of a user word
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/mem.h>
+#include <geekos/user.h>
+#include <geekos/futex.h>
+
+/*
+ * NOTES:
+ * - User code does the fast path itself, with atomic instructions
+ *   on a word in its memory; it only calls Futex_Wait() to sleep
+ *   when the word says it must, and Futex_Wake() when the word says
+ *   someone is sleeping.  See src/libc/futex.c.
+ * - A futex is identified by the physical address of its word, so
+ *   processes sharing the page share the futex.  Each waiter pins
+ *   the page, so it stays in memory and the address stays valid;
+ *   the pin is undone when the waiter is woken.
+ * - Waiters are hashed by page, so all waiters on one page are in
+ *   the same queue.
+ */
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+#define FUTEX_HASH_SIZE 64
+
+/* Wait queues; all zeroes is an empty queue */
+static struct Thread_Queue s_futexQueues[FUTEX_HASH_SIZE];
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+static __inline__ struct Thread_Queue* Futex_Queue(ulong_t paddr)
+{
+    return &s_futexQueues[Page_Index(paddr) % FUTEX_HASH_SIZE];
+}
+
+/*
+ * Find the physical address of the futex word at given user address,
+ * paging it in if necessary.  On success, returns 0 with interrupts
+ * disabled and the page present; it stays present until interrupts
+ * are enabled again.
+ */
+static int Find_Futex(ulong_t userAddr, ulong_t* paddr)
+{
+    struct User_Context* context = g_currentThread->userContext;
+    int value;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (context == 0 || (userAddr & (sizeof(int) - 1)) != 0)
+	return EINVALID;
+
+    while (!User_To_Physical(context, userAddr, paddr)) {
+	/* Touching the word brings the page in; this may block */
+	if (!Copy_From_User(&value, userAddr, sizeof(value)))
+	    return EINVALID;
+	if (Interrupts_Enabled())
+	    Disable_Interrupts();
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Wait on the futex at given user address, if it still holds the
+ * expected value.  Checking the value and going to sleep are atomic
+ * with respect to Futex_Wake(), so a wakeup can't be missed.
+ * Must be called with interrupts disabled.
+ * Returns 0 when woken up, EAGAIN if the value was not the
+ * expected one, or EINVALID if the address is bad.
+ */
+int Futex_Wait(ulong_t userAddr, int expected)
+{
+    ulong_t paddr;
+    int rc;
+
+    rc = Find_Futex(userAddr, &paddr);
+    if (rc != 0)
+	return rc;
+
+    /* The kernel maps physical memory one to one */
+    if (*((volatile int*) paddr) != expected)
+	return EAGAIN;
+
+    Pin_Page(Get_Page(paddr));
+    g_currentThread->futexKey = paddr;
+    Wait(Futex_Queue(paddr));
+
+    return 0;
+}
+
+/*
+ * Wake up to given number of threads waiting on the futex at
+ * given user address, in the order they started waiting.
+ * Must be called with interrupts disabled.
+ * Returns the number of threads woken, or EINVALID if the
+ * address is bad.
+ */
+int Futex_Wake(ulong_t userAddr, int count)
+{
+    struct Thread_Queue* queue;
+    struct Kernel_Thread *kthread, *next;
+    ulong_t paddr;
+    int woken = 0;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (g_currentThread->userContext == 0 || (userAddr & (sizeof(int) - 1)) != 0)
+	return EINVALID;
+
+    /* Waiters keep their page in memory, so if it is out, there are none */
+    if (!User_To_Physical(g_currentThread->userContext, userAddr, &paddr))
+	return 0;
+
+    queue = Futex_Queue(paddr);
+    for (kthread = queue->head; kthread != 0 && woken < count; kthread = next) {
+	next = Get_Next_In_Thread_Queue(kthread);
+	if (kthread->futexKey == paddr) {
+	    Remove_Thread(queue, kthread);
+	    kthread->futexKey = 0;
+	    Make_Runnable(kthread);
+	    Unpin_Page(Get_Page(paddr));
+	    ++woken;
+	}
+    }
+
+    return woken;
+}
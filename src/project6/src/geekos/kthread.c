@@ -15,7 +15,10 @@
 #include <geekos/symbol.h>
 #include <geekos/string.h>
 #include <geekos/kthread.h>
+#include <geekos/fpu.h>
 #include <geekos/malloc.h>
+#include <geekos/timer.h>
+#include <geekos/errno.h>
 
 
 /* ----------------------------------------------------------------------
@@ -59,6 +62,40 @@ volatile int g_preemptionDisabled;
 static struct Thread_Queue s_graveyardQueue;
 static struct Thread_Queue s_reaperWaitQueue;
 
+/*
+ * Cache of thread context pages, each still paired with its
+ * stack page, left behind by destroyed threads.  Reusing them
+ * lets thread creation and destruction skip the page allocator.
+ */
+#define THREAD_CACHE_SIZE 16
+static struct Thread_Queue s_threadCache;
+static int s_threadCacheCount;
+
+/*
+ * Table mapping pids to threads.  A pid is made of a slot index
+ * in its low PID_SLOT_BITS bits and the slot's generation number
+ * above them.  Slots are reused once their thread is destroyed,
+ * but the generation is bumped first, so a stale pid never finds
+ * the new thread.  Slot 0 is never used, so the first generation
+ * of pids are just 1, 2, 3...  The table doubles when it fills up.
+ */
+#define PID_SLOT_BITS		16
+#define MAX_PID_SLOTS		(1 << PID_SLOT_BITS)
+#define PID_GENERATION_MASK	0x7fff
+#define MIN_PID_SLOTS		64
+
+struct Pid_Slot {
+    struct Kernel_Thread* kthread;	/* null if the slot is free */
+    int generation;
+    int nextFree;			/* next free slot, or 0 */
+};
+
+static struct Pid_Slot s_initialPidTable[MIN_PID_SLOTS];
+static struct Pid_Slot* s_pidTable = s_initialPidTable;
+static int s_numPidSlots = MIN_PID_SLOTS;
+static int s_nextUnusedPidSlot = 1;	/* first slot never handed out */
+static int s_freePidSlot;		/* head of the free slot list, or 0 */
+
 /*
  * Counter for keys that access thread-local data, and an array
  * of destructors for freeing that data when the thread dies.  This is
@@ -72,20 +109,89 @@ static tlocal_destructor_t s_tlocalDestructors[MAX_TLOCAL_KEYS];
  * ---------------------------------------------------------------------- */
 
 /*
- * Initialize a new Kernel_Thread.
+ * Double the size of the pid table.
+ * Returns false if the table can't grow.
+ */
+static bool Grow_Pid_Table(void)
+{
+    int numSlots = s_numPidSlots * 2;
+    struct Pid_Slot* table;
+
+    if (numSlots > MAX_PID_SLOTS)
+	return false;
+
+    table = Malloc(numSlots * sizeof(struct Pid_Slot));
+    if (table == 0)
+	return false;
+
+    memcpy(table, s_pidTable, s_numPidSlots * sizeof(struct Pid_Slot));
+    memset(&table[s_numPidSlots], '\0', (numSlots - s_numPidSlots) * sizeof(struct Pid_Slot));
+    if (s_pidTable != s_initialPidTable)
+	Free(s_pidTable);
+
+    s_pidTable = table;
+    s_numPidSlots = numSlots;
+    return true;
+}
+
+/*
+ * Give a thread a pid, and enter it in the pid table.
+ * Returns false if no pid is available.
+ * Must be called with interrupts disabled!
+ */
+static bool Assign_Pid(struct Kernel_Thread* kthread)
+{
+    int slot;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (s_freePidSlot != 0) {
+	slot = s_freePidSlot;
+	s_freePidSlot = s_pidTable[slot].nextFree;
+    } else {
+	if (s_nextUnusedPidSlot == s_numPidSlots && !Grow_Pid_Table())
+	    return false;
+	slot = s_nextUnusedPidSlot++;
+    }
+
+    KASSERT(s_pidTable[slot].kthread == 0);
+    s_pidTable[slot].kthread = kthread;
+    kthread->pid = (s_pidTable[slot].generation << PID_SLOT_BITS) | slot;
+    return true;
+}
+
+/*
+ * Remove a thread from the pid table, so its slot can be reused.
+ * Must be called with interrupts disabled!
+ */
+static void Release_Pid(struct Kernel_Thread* kthread)
+{
+    int slot = kthread->pid & (MAX_PID_SLOTS - 1);
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(slot > 0 && slot < s_numPidSlots);
+    KASSERT(s_pidTable[slot].kthread == kthread);
+
+    s_pidTable[slot].kthread = 0;
+    s_pidTable[slot].generation = (s_pidTable[slot].generation + 1) & PID_GENERATION_MASK;
+    s_pidTable[slot].nextFree = s_freePidSlot;
+    s_freePidSlot = slot;
+}
+
+/*
+ * Initialize a new Kernel_Thread, which must be filled with zeroes.
+ * The caller is responsible for giving it a pid.
  */
 static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
 	int priority, bool detached)
 {
-    static int nextFreePid = 1;
-
     struct Kernel_Thread* owner = detached ? (struct Kernel_Thread*)0 : g_currentThread;
 
-    memset(kthread, '\0', sizeof(*kthread));
     kthread->stackPage = stackPage;
     kthread->esp = ((ulong_t) kthread->stackPage) + PAGE_SIZE;
     kthread->numTicks = 0;
     kthread->priority = priority;
+    kthread->basePriority = priority;
     kthread->userContext = 0;
     kthread->owner = owner;
 
@@ -98,9 +204,9 @@ static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
 
     kthread->alive = true;
     Clear_Thread_Queue(&kthread->joinQueue);
-    kthread->pid = nextFreePid++;
 
     kthread->currentReadyQueue = 0;
+    kthread->baseReadyQueue = -1;
     kthread->blocked = false;
 }
 
@@ -112,21 +218,38 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
 {
     struct Kernel_Thread* kthread;
     void* stackPage = 0;
+    bool iflag;
 
     /*
-     * For now, just allocate one page each for the thread context
-     * object and the thread's stack.
+     * Reuse a cached thread context and stack if there is one.
+     * Otherwise, allocate one page each for the thread context
+     * object and the thread's stack.  The context page comes from
+     * the pool the idle thread zeroes, so that in the common case
+     * it need not be cleared here.
      */
-    kthread = Alloc_Page();
-    if (kthread != 0)
-        stackPage = Alloc_Page();    
+    iflag = Begin_Int_Atomic();
+    kthread = 0;
+    if (s_threadCacheCount > 0) {
+	kthread = Remove_From_Front_Of_Thread_Queue(&s_threadCache);
+	--s_threadCacheCount;
+	stackPage = kthread->stackPage;
+    }
+    End_Int_Atomic(iflag);
 
-    /* Make sure that the memory allocations succeeded. */
-    if (kthread == 0)
-	return 0;
-    if (stackPage == 0) {
-	Free_Page(kthread);
-	return 0;
+    if (kthread != 0)
+	memset(kthread, '\0', sizeof(*kthread));
+    else {
+	kthread = Alloc_Zeroed_Page();
+	if (kthread != 0)
+	    stackPage = Alloc_Page();
+
+	/* Make sure that the memory allocations succeeded. */
+	if (kthread == 0)
+	    return 0;
+	if (stackPage == 0) {
+	    Free_Page(kthread);
+	    return 0;
+	}
     }
 
     /*Print("New thread @ %x, stack @ %x\n", kthread, stackPage); */
@@ -137,8 +260,18 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
      */
     Init_Thread(kthread, stackPage, priority, detached);
 
-    /* Add to the list of all threads in the system. */
+    /*
+     * Give it a pid, and add to the list of all threads in the system.
+     */
+    iflag = Begin_Int_Atomic();
+    if (!Assign_Pid(kthread)) {
+	End_Int_Atomic(iflag);
+	Free_Page(stackPage);
+	Free_Page(kthread);
+	return 0;
+    }
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, kthread);
+    End_Int_Atomic(iflag);
 
     return kthread;
 }
@@ -162,14 +295,30 @@ static __inline__ void Push(struct Kernel_Thread* kthread, ulong_t value)
  */
 static void Destroy_Thread(struct Kernel_Thread* kthread)
 {
+    /* Free thread-local data, if the thread ever had any */
+    if (kthread->tlocalData != 0)
+	Free(kthread->tlocalData);
 
-    /* Dispose of the thread's memory. */
     Disable_Interrupts();
-    Free_Page(kthread->stackPage);
-    Free_Page(kthread);
 
-    /* Remove from list of all threads */
+    /* Give up any FPU state */
+    FPU_Release(kthread);
+
+    /* Remove from list of all threads, and free its pid */
     Remove_From_All_Thread_List(&s_allThreadList, kthread);
+    Release_Pid(kthread);
+
+    /*
+     * Keep the thread's memory for reuse if the cache has room,
+     * otherwise dispose of it.
+     */
+    if (s_threadCacheCount < THREAD_CACHE_SIZE) {
+	Enqueue_Thread(&s_threadCache, kthread);
+	++s_threadCacheCount;
+    } else {
+	Free_Page(kthread->stackPage);
+	Free_Page(kthread);
+    }
 
     Enable_Interrupts();
 
@@ -319,6 +468,22 @@ static void Setup_Kernel_Thread(
 }
 
 
+/*
+ * Return true if no thread is waiting in any run queue.
+ * Must be called with interrupts disabled!
+ */
+static bool Is_Run_Queue_Empty(void)
+{
+    int i;
+
+    KASSERT(!Interrupts_Enabled());
+    for (i = 0; i < MAX_QUEUE_LEVEL; i++) {
+	if (!Is_Thread_Queue_Empty(&s_runQueue[i]))
+	    return false;
+    }
+    return true;
+}
+
 /*
  * This is the body of the idle thread.  Its job is to preserve
  * the invariant that a runnable thread always exists,
@@ -326,8 +491,33 @@ static void Setup_Kernel_Thread(
  */
 static void Idle(ulong_t arg)
 {
-    while (true)
+    while (true) {
+	Disable_Interrupts();
+	if (Is_Run_Queue_Empty()) {
+	    /*
+	     * Nothing else to do: zero a free page for
+	     * Alloc_Zeroed_Page(), and look again.  A page takes
+	     * a few microseconds, so a thread made runnable
+	     * meanwhile does not wait long.
+	     */
+	    Enable_Interrupts();
+	    if (Zero_Free_Page())
+		continue;
+	    Disable_Interrupts();
+	}
+	if (Is_Run_Queue_Empty()) {
+	    /*
+	     * The zeroed page pool is full, so halt the CPU until
+	     * an interrupt makes some thread runnable.
+	     */
+	    Timer_Stop_Tick();
+	    Enable_Interrupts_And_Halt();
+	    Disable_Interrupts();
+	    Timer_Restart_Tick();
+	}
+	Enable_Interrupts();
 	Yield();
+    }
 }
 
 /*
@@ -395,14 +585,25 @@ static __inline__ struct Kernel_Thread* Find_Best(struct Thread_Queue* queue)
 
 /*
  * Acquires pointer to thread-local data from the current thread
- * indexed by the given key.  Assumes interrupts are off.
+ * indexed by the given key.  The thread's array of thread-local
+ * data is allocated if create is true and it doesn't have one yet.
+ * Returns null if there is no array.
  */
-static __inline__ const void** Get_Tlocal_Pointer(tlocal_key_t k) 
+static const void** Get_Tlocal_Pointer(tlocal_key_t k, bool create)
 {
     struct Kernel_Thread* current = g_currentThread;
 
     KASSERT(k < MAX_TLOCAL_KEYS);
 
+    if (current->tlocalData == 0) {
+	if (!create)
+	    return 0;
+	current->tlocalData = Malloc(MAX_TLOCAL_KEYS * sizeof(const void*));
+	if (current->tlocalData == 0)
+	    return 0;
+	memset(current->tlocalData, '\0', MAX_TLOCAL_KEYS * sizeof(const void*));
+    }
+
     return &current->tlocalData[k];
 }
 
@@ -419,6 +620,9 @@ static void Tlocal_Exit(struct Kernel_Thread* curr) {
 
     KASSERT(!Interrupts_Enabled());
 
+    if (curr->tlocalData == 0)
+	return;
+
     for (j = 0; j<MIN_DESTRUCTOR_ITERATIONS; j++) {
 
         for (i = 0; i<MAX_TLOCAL_KEYS; i++) {
@@ -446,13 +650,18 @@ static void Tlocal_Exit(struct Kernel_Thread* curr) {
 void Init_Scheduler(void)
 {
     struct Kernel_Thread* mainThread = (struct Kernel_Thread *) KERN_THREAD_OBJ;
+    bool iflag;
 
     /*
      * Create initial kernel thread context object and stack,
      * and make them current.
      */
+    memset(mainThread, '\0', sizeof(*mainThread));
     Init_Thread(mainThread, (void *) KERN_STACK, PRIORITY_NORMAL, true);
     g_currentThread = mainThread;
+    iflag = Begin_Int_Atomic();
+    Assign_Pid(mainThread);
+    End_Int_Atomic(iflag);
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, mainThread);
 
     /*
@@ -535,6 +744,29 @@ void Make_Runnable(struct Kernel_Thread* kthread)
     }
 }
 
+/*
+ * Move given thread to another run queue level.  If the thread
+ * is waiting to run, it moves to the run queue of that level.
+ * Must be called with interrupts disabled!
+ */
+void Set_Ready_Queue(struct Kernel_Thread* kthread, int level)
+{
+    struct Thread_Queue* queue = &s_runQueue[kthread->currentReadyQueue];
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(level >= 0 && level < MAX_QUEUE_LEVEL);
+
+    if (level == kthread->currentReadyQueue)
+	return;
+
+    if (!kthread->blocked && Is_Member_Of_Thread_Queue(queue, kthread)) {
+	Remove_Thread(queue, kthread);
+	kthread->currentReadyQueue = level;
+	Enqueue_Thread(&s_runQueue[level], kthread);
+    } else
+	kthread->currentReadyQueue = level;
+}
+
 /*
  * Atomically make a thread runnable.
  * Assumes interrupts are currently enabled.
@@ -687,6 +919,7 @@ int Join(struct Kernel_Thread* kthread)
 struct Kernel_Thread* Lookup_Thread(int pid)
 {
     struct Kernel_Thread *result = 0;
+    int slot = pid & (MAX_PID_SLOTS - 1);
 
     bool iflag = Begin_Int_Atomic();
 
@@ -696,14 +929,10 @@ struct Kernel_Thread* Lookup_Thread(int pid)
      * reference is added to the thread before it is returned.
      */
 
-    result = Get_Front_Of_All_Thread_List(&s_allThreadList);
-    while (result != 0) {
-	if (result->pid == pid) {
-	    if (g_currentThread != result->owner)
-		result = 0;
-	    break;
-	}
-	result = Get_Next_In_All_Thread_List(result);
+    if (pid > 0 && slot < s_numPidSlots) {
+	result = s_pidTable[slot].kthread;
+	if (result != 0 && (result->pid != pid || g_currentThread != result->owner))
+	    result = 0;
     }
 
     End_Int_Atomic(iflag);
@@ -801,16 +1030,21 @@ int Tlocal_Create(tlocal_key_t *key, tlocal_destructor_t destructor)
 }
 
 /*
- * Store a value for a thread-local item
+ * Store a value for a thread-local item.
+ * Returns 0 if successful, ENOMEM if the thread's
+ * thread-local data couldn't be allocated.
  */
-void Tlocal_Put(tlocal_key_t k, const void *v) 
+int Tlocal_Put(tlocal_key_t k, const void *v) 
 {
     const void **pv;
 
     KASSERT(k < s_tlocalKeyCounter);
 
-    pv = Get_Tlocal_Pointer(k);
+    pv = Get_Tlocal_Pointer(k, v != 0);
+    if (pv == 0)
+	return v != 0 ? ENOMEM : 0;
     *pv = v;
+    return 0;
 }
 
 /*
@@ -822,8 +1056,8 @@ void *Tlocal_Get(tlocal_key_t k)
 
     KASSERT(k < s_tlocalKeyCounter);
 
-    pv = Get_Tlocal_Pointer(k);
-    return (void *)*pv;
+    pv = Get_Tlocal_Pointer(k, false);
+    return pv != 0 ? (void *)*pv : 0;
 }
 
 /*
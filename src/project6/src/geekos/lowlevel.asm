@@ -70,6 +70,27 @@ INTERRUPT_STATE_SIZE equ 64
 	add     esp, 8                  ; clear 2 arguments
 %endmacro
 
+; Task switched bit in CR0.
+CR0_TS equ 0x00000008
+
+; Set CR0.TS unless the thread about to run (in eax) owns the FPU,
+; so that its first FPU/SSE instruction traps and the registers are
+; switched lazily (see fpu.c).  CR0 is only written if TS changes.
+; Clobbers ebx and ecx.
+%macro Update_FPU_Trap 0
+	mov	ebx, cr0
+	mov	ecx, ebx
+	or	ebx, CR0_TS
+	cmp	eax, [g_fpuOwner]
+	jne	%%update
+	and	ebx, ~CR0_TS
+%%update:
+	cmp	ebx, ecx
+	je	%%done
+	mov	cr0, ebx
+%%done:
+%endmacro
+
 ; Number of bytes between the top of the stack and
 ; the interrupt number after the general-purpose and segment
 ; registers have been saved.
@@ -123,6 +144,9 @@ IMPORT Make_Runnable
 ; Function to activate a new user context (if needed).
 IMPORT Switch_To_User_Context
 
+; Thread whose state is loaded in the FPU registers.
+IMPORT g_fpuOwner
+
 ; Sizes of interrupt handler entry points for interrupts with
 ; and without error codes.  The code in idt.c uses this
 ; information to infer the layout of the table of interrupt
@@ -289,6 +313,9 @@ Handle_Interrupt:
 	mov	[g_currentThread], eax
 	mov	esp, [eax+0]		; esp field
 
+	; Trap the new thread's first FPU use unless it owns the FPU
+	Update_FPU_Trap
+
 	; Clear "need reschedule" flag
 	mov	[g_needReschedule], dword 0
 
@@ -363,6 +390,9 @@ Switch_To_Thread:
 	mov	[g_currentThread], eax
 	mov	esp, [eax+0]
 
+	; Trap the new thread's first FPU use unless it owns the FPU
+	Update_FPU_Trap
+
 	; Activate the user context, if necessary.
 	Activate_User_Context
 
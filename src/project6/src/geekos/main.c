@@ -18,6 +18,7 @@
 #include <geekos/int.h>
 #include <geekos/kthread.h>
 #include <geekos/trap.h>
+#include <geekos/fpu.h>
 #include <geekos/timer.h>
 #include <geekos/keyboard.h>
 #include <geekos/dma.h>
@@ -69,6 +70,7 @@ void Main(struct Boot_Info* bootInfo)
     Init_VM(bootInfo);
     Init_Scheduler();
     Init_Traps();
+    Init_FPU();
     Init_Timer();
     Init_Keyboard();
     Init_DMA();
@@ -9,18 +9,199 @@
 
 #include <geekos/screen.h>
 #include <geekos/int.h>
+#include <geekos/io.h>
 #include <geekos/bget.h>
+#include <geekos/tlsf.h>
 #include <geekos/kassert.h>
+#include <geekos/mem.h>
 #include <geekos/malloc.h>
 
+/*
+ * The heap is managed by TLSF, which allocates and frees in a
+ * bounded number of steps.  Malloc() and Free() run with interrupts
+ * disabled, so a search whose length depends on how fragmented the
+ * heap is would add straight to interrupt latency.  Build with
+ * MALLOC=bget to use the bget best fit allocator instead.
+ */
+#ifndef MALLOC_BGET
+static struct TLSF_Heap s_heap;
+#endif
+
+/*
+ * The heap is made of pools of HEAP_POOL_SIZE bytes: the region
+ * Init_Mem() sets aside, cut into pools, and blocks of pages taken
+ * from the page allocator when the heap runs out.  A request too big
+ * for a pool gets a block of pages of its own.  A pool in which
+ * nothing is allocated any more goes back to the page allocator,
+ * unless the heap would be left smaller than Init_Heap() made it.
+ * The first such pool is held back as a spare, outside the allocator,
+ * and is the next one taken when the heap grows, so a heap that goes
+ * up and down across a pool boundary doesn't take pages from the page
+ * allocator and give them back each time.
+ * (bget only gives pools back when they are all the same size.)
+ */
+#define HEAP_POOL_ORDER 4
+#define HEAP_POOL_SIZE (PAGE_SIZE << HEAP_POOL_ORDER)
+
+/* Pages the heap holds, and the fewest it keeps */
+static ulong_t s_heapPages;
+static ulong_t s_minHeapPages;
+
+/* Pool of HEAP_POOL_SIZE bytes kept for the heap to grow into, if any */
+static void* s_sparePool;
+
+#ifdef MALLOC_TRACE
+/*
+ * Record the heap operations on the Bochs debug port, one per line:
+ * "@p size" for a pool, "@m size addr" for an allocation (addr is 0
+ * if it failed) and "@f addr" for a free, with numbers in hex.
+ * src/tools/heapsim.c replays the trace against both allocators.
+ * Each line starts on a line of its own, as console output also
+ * goes to the port.
+ */
+#define TRACE_PORT 0xE9
+
+static void Trace_Word(ulong_t value)
+{
+    int shift;
+
+    Out_Byte(TRACE_PORT, ' ');
+    for (shift = 28; shift >= 0; shift -= 4)
+	Out_Byte(TRACE_PORT, "0123456789abcdef"[(value >> shift) & 0xf]);
+}
+
+static void Trace_Op(char op, ulong_t size, void* buf)
+{
+    Out_Byte(TRACE_PORT, '\n');
+    Out_Byte(TRACE_PORT, '@');
+    Out_Byte(TRACE_PORT, op);
+    if (op != 'f')
+	Trace_Word(size);
+    if (op != 'p')
+	Trace_Word((ulong_t) buf);
+    Out_Byte(TRACE_PORT, '\n');
+}
+#else
+#  define Trace_Op(op, size, buf)
+#endif
+
+/*
+ * Take a block of pages for the heap, the spare pool if it is big enough.
+ * Returns null if there is none big enough.
+ * Called with interrupts disabled.
+ */
+static void* Acquire_Heap_Pages(bufsize size)
+{
+    int order = Pages_Order(size);
+    void* pages;
+
+    if (s_sparePool != 0 && size <= HEAP_POOL_SIZE) {
+	pages = s_sparePool;
+	s_sparePool = 0;
+	return pages;
+    }
+    if (order >= BUDDY_ORDERS)
+	return 0;
+    pages = Alloc_Pages(order);
+    if (pages != 0)
+	s_heapPages += 1UL << order;
+    return pages;
+}
+
+/*
+ * Get the number of pages in a pool.
+ */
+static ulong_t Pool_Pages(void* pool)
+{
+    struct Page* page = Get_Page((ulong_t) pool);
+
+    /* Pools of the region Init_Mem() set aside are not allocated pages */
+    return (page->flags & PAGE_ALLOCATED) ? 1UL << page->order : HEAP_POOL_SIZE / PAGE_SIZE;
+}
+
+/*
+ * Give the pages of a pool the heap no longer uses
+ * to the page allocator, or keep the pool as the spare.
+ * Called with interrupts disabled.
+ */
+static void Release_Heap_Pages(void* pool)
+{
+    struct Page* page = Get_Page((ulong_t) pool);
+
+    if (s_sparePool == 0 && Pool_Pages(pool) == HEAP_POOL_SIZE / PAGE_SIZE) {
+	s_sparePool = pool;
+	return;
+    }
+    s_heapPages -= Pool_Pages(pool);
+    if (page->flags & PAGE_ALLOCATED)
+	Free_Pages(pool, page->order);
+    else
+	Free_Heap_Pages(pool, HEAP_POOL_SIZE);
+}
+
+#ifdef MALLOC_BGET
+/*
+ * Called by bget when nothing is allocated in a pool or in a
+ * buffer that had pages of its own.  bget has already let go of
+ * it, so a pool the heap keeps is given to bget again.
+ */
+static void Release_Bget_Pages(void* buf)
+{
+    ulong_t numPages = Pool_Pages(buf);
+
+    if (numPages == HEAP_POOL_SIZE / PAGE_SIZE && s_heapPages - numPages < s_minHeapPages)
+	bpool(buf, HEAP_POOL_SIZE);
+    else
+	Release_Heap_Pages(buf);
+}
+#endif
+
+#ifndef MALLOC_BGET
+/*
+ * Add a pool big enough for an allocation of given size to the heap.
+ * Returns true if successful, false if there is not enough memory.
+ * Called with interrupts disabled.
+ */
+static bool Grow_Heap(ulong_t size)
+{
+    ulong_t poolSize = TLSF_Pool_Size(size);
+    void* pool;
+
+    if (poolSize < HEAP_POOL_SIZE)
+	poolSize = HEAP_POOL_SIZE;
+    pool = Acquire_Heap_Pages(poolSize);
+    if (pool == 0)
+	return false;
+    poolSize = Pool_Pages(pool) * PAGE_SIZE;
+    Trace_Op('p', poolSize, 0);
+    TLSF_Add_Pool(&s_heap, pool, poolSize);
+    return true;
+}
+#endif
+
 /*
  * Initialize the heap starting at given address and occupying
  * specified number of bytes.
  */
 void Init_Heap(ulong_t start, ulong_t size)
 {
+    ulong_t addr;
+
     /*Print("Creating kernel heap: start=%lx, size=%ld\n", start, size);*/
-    bpool((void*) start, size);
+    KASSERT(size % HEAP_POOL_SIZE == 0);
+
+#ifdef MALLOC_BGET
+    bectl(0, &Acquire_Heap_Pages, &Release_Bget_Pages, HEAP_POOL_SIZE);
+#endif
+    for (addr = start; addr < start + size; addr += HEAP_POOL_SIZE) {
+	Trace_Op('p', HEAP_POOL_SIZE, 0);
+#ifdef MALLOC_BGET
+	bpool((void*) addr, HEAP_POOL_SIZE);
+#else
+	TLSF_Add_Pool(&s_heap, (void*) addr, HEAP_POOL_SIZE);
+#endif
+    }
+    s_heapPages = s_minHeapPages = size / PAGE_SIZE;
 }
 
 /*
@@ -36,7 +217,14 @@ void* Malloc(ulong_t size)
     KASSERT(size > 0);
 
     iflag = Begin_Int_Atomic();
+#ifdef MALLOC_BGET
     result = bget(size);
+#else
+    result = TLSF_Alloc(&s_heap, size);
+    if (result == 0 && Grow_Heap(size))
+	result = TLSF_Alloc(&s_heap, size);
+#endif
+    Trace_Op('m', size, result);
     End_Int_Atomic(iflag);
 
     return result;
@@ -48,8 +236,28 @@ void* Malloc(ulong_t size)
 void Free(void* buf)
 {
     bool iflag;
+#ifndef MALLOC_BGET
+    void* pool;
+#endif
 
     iflag = Begin_Int_Atomic();
+    Trace_Op('f', 0, buf);
+#ifdef MALLOC_BGET
     brel(buf);
+#else
+    pool = TLSF_Free(&s_heap, buf);
+    if (pool != 0 && s_heapPages - Pool_Pages(pool) >= s_minHeapPages) {
+	TLSF_Remove_Pool(&s_heap, pool);
+	Release_Heap_Pages(pool);
+    }
+#endif
     End_Int_Atomic(iflag);
 }
+
+/*
+ * Get the number of pages the heap holds.
+ */
+ulong_t Get_Heap_Pages(void)
+{
+    return s_heapPages;
+}
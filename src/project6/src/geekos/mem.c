@@ -30,10 +30,16 @@
 struct Page* g_pageList;
 
 /*
- * Number of pages currently available on the freelist.
+ * Number of pages currently available on the freelist,
+ * including the ones in the zeroed page pool.
  */
 uint_t g_freePageCount = 0;
 
+/*
+ * Number of free pages known to be filled with zeroes.
+ */
+uint_t g_zeroedPageCount = 0;
+
 /* ----------------------------------------------------------------------
  * Private data and functions
  * ---------------------------------------------------------------------- */
@@ -45,15 +51,185 @@ extern int debugFaults;
 #define Debug(args...) if (debugFaults) Print(args)
 
 /*
- * List of pages available for allocation.
+ * Free memory, managed by the buddy system.  s_freeArea[k] lists the
+ * free blocks of 2^k pages; a block is aligned to its size, and is
+ * represented by its first page, which has PAGE_BUDDY set and its
+ * order field set to k.  s_numFreeBlocks[k] is the length of the list.
+ */
+static struct Page_List s_freeArea[BUDDY_ORDERS];
+static ulong_t s_numFreeBlocks[BUDDY_ORDERS];
+
+/*
+ * Free pages filled with zeroes by the idle thread, for
+ * Alloc_Zeroed_Page().  They are kept out of the buddy system, and
+ * Alloc_Page() only takes from this pool when the buddy system is
+ * out of pages.
+ */
+static struct Page_List s_zeroedList;
+
+/*
+ * Number of pages the idle thread keeps zeroed, at most.
+ */
+#define ZEROED_POOL_SIZE 128
+
+/*
+ * Pageable pages, for choosing pages to page out; a page on one of
+ * these lists has PAGE_ACTIVE or PAGE_INACTIVE set.  Pages are taken
+ * from the front of each list and put on the back, and the accessed
+ * bit of a page's PTE tells whether it was used since it was last
+ * looked at, so each list is the ring of a clock.  Pages are paged
+ * out from the inactive list, and the active list is scanned to
+ * refill it.  A page that stops being pageable is dropped from the
+ * lists when the clock gets to it.
+ */
+static struct Page_List s_activeList, s_inactiveList;
+static ulong_t s_numActive, s_numInactive;
+
+/*
+ * The active list is scanned when fewer than 1/INACTIVE_RATIO of the
+ * pageable pages are inactive, looking at CLOCK_BATCH pages at most.
  */
-static struct Page_List s_freeList;
+#define INACTIVE_RATIO 3
+#define CLOCK_BATCH 32
 
 /*
  * Total number of physical pages.
  */
 int unsigned s_numPages;
 
+/*
+ * Put a free block of 2^order pages, starting with the page with given
+ * index, on the free lists.  As long as the block's buddy (the other
+ * half of the block of twice the size) is free as a whole, the two
+ * are merged, so this takes O(log n) time.
+ * Must be called with interrupts disabled!
+ */
+static void Free_Block(ulong_t index, int order)
+{
+    struct Page* page;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT((index & ((1UL << order) - 1)) == 0);
+
+    g_freePageCount += 1UL << order;
+
+    while (order < BUDDY_ORDERS - 1) {
+	ulong_t buddyIndex = index ^ (1UL << order);
+	struct Page* buddy = &g_pageList[buddyIndex];
+
+	if (buddyIndex >= s_numPages || !(buddy->flags & PAGE_BUDDY) || buddy->order != order)
+	    break;
+
+	Remove_From_Page_List(&s_freeArea[order], buddy);
+	--s_numFreeBlocks[order];
+	buddy->flags &= ~(PAGE_BUDDY);
+	index &= ~(1UL << order);
+	++order;
+    }
+
+    page = &g_pageList[index];
+    page->flags |= PAGE_BUDDY;
+    page->order = order;
+    Add_To_Back_Of_Page_List(&s_freeArea[order], page);
+    ++s_numFreeBlocks[order];
+}
+
+/*
+ * Take a free block of 2^order pages off the free lists, splitting
+ * the smallest larger block if there is none of that size.
+ * Returns the index of its first page, or -1 if no block is large
+ * enough.
+ * Must be called with interrupts disabled!
+ */
+static long Take_Block(int order)
+{
+    struct Page* page;
+    ulong_t index;
+    int k;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (k = order; k < BUDDY_ORDERS && Is_Page_List_Empty(&s_freeArea[k]); ++k)
+	;
+    if (k == BUDDY_ORDERS)
+	return -1;
+
+    page = Remove_From_Front_Of_Page_List(&s_freeArea[k]);
+    --s_numFreeBlocks[k];
+    KASSERT((page->flags & (PAGE_BUDDY | PAGE_ALLOCATED)) == PAGE_BUDDY);
+    page->flags &= ~(PAGE_BUDDY);
+    index = page - g_pageList;
+
+    /* Give back the halves we don't need */
+    while (k > order) {
+	struct Page* half;
+
+	--k;
+	half = &g_pageList[index + (1UL << k)];
+	half->flags |= PAGE_BUDDY;
+	half->order = k;
+	Add_To_Back_Of_Page_List(&s_freeArea[k], half);
+	++s_numFreeBlocks[k];
+    }
+
+    g_freePageCount -= 1UL << order;
+    return index;
+}
+
+/*
+ * Mark the pages of a block taken by Take_Block() as allocated.
+ * Returns the address of the block.
+ */
+static void* Allocate_Block(ulong_t index, int order)
+{
+    ulong_t i;
+
+    for (i = index; i < index + (1UL << order); ++i) {
+	KASSERT((g_pageList[i].flags & PAGE_ALLOCATED) == 0);
+	g_pageList[i].flags |= PAGE_ALLOCATED;
+	g_pageList[i].order = -1;
+    }
+    g_pageList[index].order = order;
+    return (void*) (index << PAGE_POWER);
+}
+
+/*
+ * Take a page from the zeroed page pool.
+ * Returns null if the pool is empty.
+ * Must be called with interrupts disabled!
+ */
+static void* Take_Zeroed_Page(void)
+{
+    struct Page* page;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (Is_Page_List_Empty(&s_zeroedList))
+	return 0;
+
+    page = Remove_From_Front_Of_Page_List(&s_zeroedList);
+    g_freePageCount--;
+    g_zeroedPageCount--;
+    return Allocate_Block(page - g_pageList, 0);
+}
+
+/*
+ * Give the pages of the zeroed page pool back to the buddy system,
+ * so they can be merged into larger blocks.
+ * Must be called with interrupts disabled!
+ */
+static void Drain_Zeroed_Pool(void)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    while (!Is_Page_List_Empty(&s_zeroedList)) {
+	struct Page* page = Remove_From_Front_Of_Page_List(&s_zeroedList);
+	g_freePageCount--;
+	g_zeroedPageCount--;
+	Free_Block(page - g_pageList, 0);
+    }
+}
+
 /*
  * Add a range of pages to the inventory of physical memory.
  */
@@ -69,21 +245,16 @@ static void Add_Page_Range(ulong_t start, ulong_t end, int flags)
 	struct Page *page = Get_Page(addr);
 
 	page->flags = flags;
-
-	if (flags == PAGE_AVAIL) {
-	    /* Add the page to the freelist */
-	    Add_To_Back_Of_Page_List(&s_freeList, page);
-
-	    /* Update free page count */
-	    ++g_freePageCount;
-	} else {
-	    Set_Next_In_Page_List(page, 0);
-	    Set_Prev_In_Page_List(page, 0);
-	}
-
-	page->clock = 0;
+	page->order = 0;
 	page->vaddr = 0;
 	page->entry = 0;
+	page->pinCount = 0;
+	Set_Next_In_Page_List(page, 0);
+	Set_Prev_In_Page_List(page, 0);
+
+	/* Add the page to the free lists, and merge it with its buddies */
+	if (flags == PAGE_AVAIL)
+	    Free_Block(Page_Index(addr), 0);
     }
 }
 
@@ -128,6 +299,9 @@ void Init_Mem(struct Boot_Info* bootInfo)
     kernEnd = Round_Up_To_Page(pageListAddr + numPageListBytes);
     s_numPages = numPages;
 
+    /* The buddy system looks at pages beyond the ones added so far */
+    memset(g_pageList, '\0', numPageListBytes);
+
     /*
      * The initial kernel thread and its stack are placed
      * just beyond the ISA hole.
@@ -179,23 +353,45 @@ void Init_BSS(void)
  */
 void* Alloc_Page(void)
 {
-    struct Page* page;
     void *result = 0;
+    long index;
 
     bool iflag = Begin_Int_Atomic();
 
-    /* See if we have a free page */
-    if (!Is_Page_List_Empty(&s_freeList)) {
-	/* Remove the first page on the freelist. */
-	page = Get_Front_Of_Page_List(&s_freeList);
-	KASSERT((page->flags & PAGE_ALLOCATED) == 0);
-	Remove_From_Front_Of_Page_List(&s_freeList);
+    /* Leave the zeroed pages to those who need them */
+    index = Take_Block(0);
+    if (index >= 0)
+	result = Allocate_Block(index, 0);
+    else
+	result = Take_Zeroed_Page();
 
-	/* Mark page as having been allocated. */
-	page->flags |= PAGE_ALLOCATED;
-	g_freePageCount--;
-	result = (void*) Get_Page_Address(page);
+    End_Int_Atomic(iflag);
+
+    return result;
+}
+
+/*
+ * Allocate 2^order physically contiguous pages, aligned to their
+ * total size.  Free them with Free_Pages(), giving the same order.
+ * Returns null if there is no free block that large.
+ */
+void* Alloc_Pages(int order)
+{
+    void *result = 0;
+    long index;
+
+    KASSERT(order >= 0 && order < BUDDY_ORDERS);
+
+    bool iflag = Begin_Int_Atomic();
+
+    index = Take_Block(order);
+    if (index < 0) {
+	/* Pages in the zeroed pool may complete a block */
+	Drain_Zeroed_Pool();
+	index = Take_Block(order);
     }
+    if (index >= 0)
+	result = Allocate_Block(index, order);
 
     End_Int_Atomic(iflag);
 
@@ -203,28 +399,243 @@ void* Alloc_Page(void)
 }
 
 /*
- * Choose a page to evict.
+ * Allocate a page of physical memory filled with zeroes.
+ * The page comes from the pool the idle thread keeps, if it can;
+ * otherwise it is cleared here.
+ */
+void* Alloc_Zeroed_Page(void)
+{
+    void *result;
+    long index;
+
+    bool iflag = Begin_Int_Atomic();
+
+    result = Take_Zeroed_Page();
+    if (result == 0) {
+	index = Take_Block(0);
+	if (index >= 0) {
+	    result = Allocate_Block(index, 0);
+	    End_Int_Atomic(iflag);
+	    memset(result, '\0', PAGE_SIZE);
+	    return result;
+	}
+    }
+
+    End_Int_Atomic(iflag);
+
+    return result;
+}
+
+/*
+ * Zero a free page, and move it to the zeroed page pool.  This is
+ * called by the idle thread, with interrupts enabled; the page is
+ * cleared with interrupts enabled too, and is on no list meanwhile.
+ * Returns false if the pool is full or there are no pages to zero.
+ */
+bool Zero_Free_Page(void)
+{
+    struct Page* page;
+    long index;
+
+    KASSERT(Interrupts_Enabled());
+
+    Disable_Interrupts();
+    if (g_zeroedPageCount >= ZEROED_POOL_SIZE || (index = Take_Block(0)) < 0) {
+	Enable_Interrupts();
+	return false;
+    }
+    Enable_Interrupts();
+
+    page = &g_pageList[index];
+    memset((void*) Get_Page_Address(page), '\0', PAGE_SIZE);
+
+    Disable_Interrupts();
+    Add_To_Back_Of_Page_List(&s_zeroedList, page);
+    g_freePageCount++;
+    g_zeroedPageCount++;
+    Enable_Interrupts();
+
+    return true;
+}
+
+/*
+ * Get statistics on free memory.
+ */
+void Get_Page_Stats(struct Page_Stats* stats)
+{
+    int k;
+
+    bool iflag = Begin_Int_Atomic();
+
+    stats->numPages = s_numPages;
+    stats->freePages = g_freePageCount;
+    stats->zeroedPages = g_zeroedPageCount;
+    stats->heapPages = Get_Heap_Pages();
+    stats->activePages = s_numActive;
+    stats->inactivePages = s_numInactive;
+    for (k = 0; k < BUDDY_ORDERS; ++k)
+	stats->freeBlocks[k] = s_numFreeBlocks[k];
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Put a page on the back of the active or the inactive list.
+ * Must be called with interrupts disabled!
+ */
+static void Add_To_Clock(struct Page* page, bool active)
+{
+    KASSERT(!(page->flags & (PAGE_ACTIVE | PAGE_INACTIVE)));
+
+    if (active) {
+	Add_To_Back_Of_Page_List(&s_activeList, page);
+	page->flags |= PAGE_ACTIVE;
+	++s_numActive;
+    } else {
+	Add_To_Back_Of_Page_List(&s_inactiveList, page);
+	page->flags |= PAGE_INACTIVE;
+	++s_numInactive;
+    }
+}
+
+/*
+ * Take a page off the active or inactive list, if it is on one.
+ * Must be called with interrupts disabled!
+ */
+static void Remove_From_Clock(struct Page* page)
+{
+    if (page->flags & PAGE_ACTIVE) {
+	Remove_From_Page_List(&s_activeList, page);
+	--s_numActive;
+    } else if (page->flags & PAGE_INACTIVE) {
+	Remove_From_Page_List(&s_inactiveList, page);
+	--s_numInactive;
+    }
+    page->flags &= ~(PAGE_ACTIVE | PAGE_INACTIVE);
+}
+
+/*
+ * Check whether a page was used since this was last called for it.
+ */
+static bool Test_And_Clear_Accessed(struct Page* page)
+{
+    if (!page->entry->accesed)
+	return false;
+    page->entry->accesed = 0;
+    return true;
+}
+
+/*
+ * Advance the clock hand over the active list, moving pages that were
+ * not used since the hand last passed them to the inactive list, until
+ * enough pages are inactive or CLOCK_BATCH pages have been looked at.
+ * Must be called with interrupts disabled!
+ */
+static void Refill_Inactive_List(void)
+{
+    ulong_t target = (s_numActive + s_numInactive) / INACTIVE_RATIO;
+    int scanned;
+
+    if (target == 0)
+	target = 1;
+
+    for (scanned = 0; scanned < CLOCK_BATCH && s_numInactive < target; ++scanned) {
+	struct Page* page = Get_Front_Of_Page_List(&s_activeList);
+	if (page == 0)
+	    break;
+	Remove_From_Clock(page);
+	if (page->flags & PAGE_PAGEABLE)
+	    Add_To_Clock(page, Test_And_Clear_Accessed(page));
+    }
+}
+
+/*
+ * Choose a page to evict: the first page on the inactive list that
+ * was not used since it was put there.  Used pages go back to the
+ * active list.  Each page looked at is moved or dropped, so the time
+ * taken is paid for by the page uses the clock has seen.
  * Returns null if no pages are available.
+ * Must be called with interrupts disabled!
  */
-static struct Page *Find_Page_To_Page_Out()
+static struct Page *Find_Page_To_Page_Out(void)
 {
-    int i;
-    struct Page *curr, *best;
-
-    best = NULL;
-
-    for (i=0; i < s_numPages; i++) {
-	if ((g_pageList[i].flags & PAGE_PAGEABLE) &&
-	    (g_pageList[i].flags & PAGE_ALLOCATED)) {
-	    if (!best) best = &g_pageList[i];
-	    curr = &g_pageList[i];
-	    if ((curr->clock < best->clock) && (curr->flags & PAGE_PAGEABLE)) {
-		best = curr;
-	    }
+    struct Page* page;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (;;) {
+	if (s_numInactive * INACTIVE_RATIO < s_numActive + s_numInactive || s_numInactive == 0)
+	    Refill_Inactive_List();
+
+	page = Get_Front_Of_Page_List(&s_inactiveList);
+	if (page == 0) {
+	    if (s_numActive == 0)
+		return 0;
+	    continue;
+	}
+	Remove_From_Clock(page);
+
+	if (!(page->flags & PAGE_PAGEABLE))
+	    continue;		/* pinned since it was put on the list */
+	if (Test_And_Clear_Accessed(page)) {
+	    Add_To_Clock(page, true);
+	    continue;
 	}
+
+	/* Accessed bits cleared above may be cached in the TLB */
+	Flush_TLB();
+	return page;
+    }
+}
+
+/*
+ * Put a pageable page on the active list, if it is not on
+ * one of the lists of pages to page out already.
+ */
+void Activate_Page(struct Page* page)
+{
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    KASSERT(page->flags & PAGE_PAGEABLE);
+    if (!(page->flags & (PAGE_ACTIVE | PAGE_INACTIVE)))
+	Add_To_Clock(page, true);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Keep a page in memory until Unpin_Page() is called for it as
+ * many times as this was.  If the page is pageable, it is marked
+ * PAGE_PINNED instead until then.
+ */
+void Pin_Page(struct Page* page)
+{
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    if (page->pinCount++ == 0 && (page->flags & PAGE_PAGEABLE)) {
+	page->flags &= ~PAGE_PAGEABLE;
+	page->flags |= PAGE_PINNED;
     }
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Undo a call to Pin_Page().  When the last pin goes, a page
+ * that was pageable becomes pageable again.
+ */
+void Unpin_Page(struct Page* page)
+{
+    bool iflag;
 
-    return best;
+    iflag = Begin_Int_Atomic();
+    KASSERT(page->pinCount > 0);
+    if (--page->pinCount == 0 && (page->flags & PAGE_PINNED)) {
+	page->flags &= ~PAGE_PINNED;
+	page->flags |= PAGE_PAGEABLE;
+	Activate_Page(page);
+    }
+    End_Int_Atomic(iflag);
 }
 
 /**
@@ -259,13 +670,16 @@ void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr)
 	page = Find_Page_To_Page_Out();
 	KASSERT(page->flags & PAGE_PAGEABLE);
 	paddr = (void*) Get_Page_Address(page);
-	Debug("Selected page at addr %p (age = %d)\n", paddr, page->clock);
+	Debug("Selected page at addr %p\n", paddr);
 
 	/* Find a place on disk for it */
 	pagefileIndex = Find_Space_On_Paging_File();
-	if (pagefileIndex < 0)
+	if (pagefileIndex < 0) {
 	    /* No space available in paging file. */
+	    Activate_Page(page);
+	    paddr = 0;
 	    goto done;
+	}
 	Debug("Free disk page at index %d\n", pagefileIndex);
 
 	/* Make the page temporarily unpageable (can't let another process steal it) */
@@ -311,6 +725,7 @@ void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr)
     page->entry->kernelInfo = 0;
     page->vaddr = vaddr;
     KASSERT(page->flags & PAGE_ALLOCATED);
+    Activate_Page(page);
 
 done:
     End_Int_Atomic(iflag);
@@ -333,20 +748,70 @@ void Free_Page(void* pageAddr)
     /* Get the Page object for this page */
     page = Get_Page(addr);
     KASSERT((page->flags & PAGE_ALLOCATED) != 0);
+    KASSERT(page->order == 0);
 
-    /* Clear the allocation bit */
-    page->flags &= ~(PAGE_ALLOCATED);
+    /* Clear the allocation bit, and any pins, which must not outlive the page */
+    page->flags &= ~(PAGE_ALLOCATED | PAGE_PINNED);
+    page->pinCount = 0;
 
     /* When a page is locked, don't free it just let other thread know its not needed */
-    if (page->flags & PAGE_LOCKED)
-      return;
+    if (page->flags & PAGE_LOCKED) {
+	End_Int_Atomic(iflag);
+	return;
+    }
 
     /* Clear the pageable bit */
     page->flags &= ~(PAGE_PAGEABLE);
+    Remove_From_Clock(page);
 
-    /* Put the page back on the freelist */
-    Add_To_Back_Of_Page_List(&s_freeList, page);
-    g_freePageCount++;
+    /* Put the page back on the free lists */
+    Free_Block(Page_Index(addr), 0);
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Give pages of the kernel heap region set up by Init_Mem()
+ * to the page allocator, once the heap no longer uses them.
+ */
+void Free_Heap_Pages(void* start, ulong_t size)
+{
+    ulong_t addr;
+    bool iflag;
+
+    KASSERT(Is_Page_Multiple((ulong_t) start) && Is_Page_Multiple(size));
+
+    iflag = Begin_Int_Atomic();
+    for (addr = (ulong_t) start; addr < (ulong_t) start + size; addr += PAGE_SIZE) {
+	struct Page* page = Get_Page(addr);
+	KASSERT(page->flags == PAGE_HEAP);
+	page->flags = 0;
+	Free_Block(Page_Index(addr), 0);
+    }
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Free a block of pages allocated by Alloc_Pages().
+ */
+void Free_Pages(void* pageAddr, int order)
+{
+    ulong_t addr = (ulong_t) pageAddr;
+    ulong_t index = Page_Index(addr), i;
+    bool iflag;
+
+    KASSERT(order >= 0 && order < BUDDY_ORDERS);
+    KASSERT(Is_Page_Multiple(addr));
+
+    iflag = Begin_Int_Atomic();
+
+    KASSERT(g_pageList[index].order == order);
+    for (i = index; i < index + (1UL << order); ++i) {
+	KASSERT((g_pageList[i].flags & (PAGE_ALLOCATED | PAGE_PAGEABLE)) == PAGE_ALLOCATED);
+	g_pageList[i].flags &= ~(PAGE_ALLOCATED);
+	g_pageList[i].order = 0;
+    }
+    Free_Block(index, order);
 
     End_Int_Atomic(iflag);
 }
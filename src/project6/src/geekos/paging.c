@@ -115,6 +115,7 @@ void Init_VM(struct Boot_Info *bootInfo)
     /*
      * Hints:
      * - Build kernel page directory and page tables
+     *   (Alloc_Zeroed_Page() gives pages with every entry not present)
      * - Call Enable_Paging() with the kernel page directory
      * - Install an interrupt handler for interrupt 14,
      *   page fault
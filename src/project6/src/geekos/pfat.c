@@ -13,6 +13,7 @@
 #include <geekos/screen.h>
 #include <geekos/string.h>
 #include <geekos/malloc.h>
+#include <geekos/mem.h>
 #include <geekos/ide.h>
 #include <geekos/blockdev.h>
 #include <geekos/bitset.h>
@@ -69,6 +70,7 @@ struct PFAT_File {
     directoryEntry *entry;		 /* Directory entry of the file */
     ulong_t numBlocks;			 /* Number of blocks used by file */
     char *fileDataCache;		 /* File data cache */
+    int cacheOrder;			 /* order of its pages, or -1 if in the heap */
     struct Bit_Set *validBlockSet;	 /* Which data blocks of cache are valid */
     struct Mutex lock;			 /* Synchronize concurrent accesses */
     DEFINE_LINK(PFAT_File_List, PFAT_File);
@@ -355,6 +357,7 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
     ulong_t numBlocks;
     struct PFAT_File *pfatFile = 0;
     char *fileDataCache = 0;
+    int cacheOrder = -1;
     struct Bit_Set *validBlockSet = 0;
 
     KASSERT(entry != 0);
@@ -379,10 +382,16 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
 
 	/*
 	 * Allocate File object, PFAT_File object, file block data cache,
-	 * and valid cache block bitset
+	 * and valid cache block bitset.  Caches of a page or more are
+	 * taken from the page allocator, to spare the kernel heap.
 	 */
+	if (numBlocks * SECTOR_SIZE >= PAGE_SIZE)
+	    cacheOrder = Pages_Order(numBlocks * SECTOR_SIZE);
+	if (cacheOrder >= BUDDY_ORDERS)
+	    goto memfail;
 	if ((pfatFile = (struct PFAT_File *) Malloc(sizeof(*pfatFile))) == 0 ||
-	    (fileDataCache = Malloc(numBlocks * SECTOR_SIZE)) == 0 ||
+	    (fileDataCache = (cacheOrder < 0 ? Malloc(numBlocks * SECTOR_SIZE)
+		: Alloc_Pages(cacheOrder))) == 0 ||
 	    (validBlockSet = Create_Bit_Set(numBlocks)) == 0) {
 	    goto memfail;
 	}
@@ -391,6 +400,7 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
 	pfatFile->entry = entry;
 	pfatFile->numBlocks = numBlocks;
 	pfatFile->fileDataCache = fileDataCache;
+	pfatFile->cacheOrder = cacheOrder;
 	pfatFile->validBlockSet = validBlockSet;
 	Mutex_Init(&pfatFile->lock);
 
@@ -405,8 +415,12 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
 memfail:
     if (pfatFile != 0)
 	Free(pfatFile);
-    if (fileDataCache != 0)
-	Free(fileDataCache);
+    if (fileDataCache != 0) {
+	if (cacheOrder < 0)
+	    Free(fileDataCache);
+	else
+	    Free_Pages(fileDataCache, cacheOrder);
+    }
     if (validBlockSet != 0)
 	Free(validBlockSet);
 
@@ -107,9 +107,9 @@ int Create_Pipe(struct File **pRead, struct File **pWrite)
 done:
     if (rc != 0) {
 	if (read != 0)
-	    Free(read);
+	    Free_File(read);
 	if (write != 0)
-	    Free(write);
+	    Free_File(write);
     }
     return rc;
 }
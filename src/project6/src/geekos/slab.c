@@ -0,0 +1,257 @@
+/*
+ * Slab allocator for kernel objects
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/ktypes.h>
+#include <geekos/kassert.h>
+#include <geekos/int.h>
+#include <geekos/string.h>
+#include <geekos/errno.h>
+#include <geekos/mem.h>
+#include <geekos/slab.h>
+
+/*
+ * NOTES:
+ * - A slab is a block of 2^order pages.  The page allocator aligns
+ *   blocks to their size, so the slab an object belongs to is found
+ *   by rounding its address down.  The slab header is at the start
+ *   of the block, and the objects follow it.
+ * - Each object is followed by the link to the next free object in
+ *   its slab, so keeping an object on the free list does not disturb
+ *   its constructed state.
+ * - A cache keeps one wholly free slab, so that a cache whose use
+ *   hovers around a slab boundary does not go to the page allocator
+ *   on every other call.  Further empty slabs are given back.
+ */
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+/* Alignment of objects in a slab */
+#define SLAB_ALIGN 8
+
+/*
+ * A slab is made big enough for at least SLAB_MIN_OBJS objects,
+ * unless that would take more than 2^SLAB_MAX_ORDER pages.
+ */
+#define SLAB_MIN_OBJS 8
+#define SLAB_MAX_ORDER 3
+
+/* Number of wholly free slabs a cache keeps */
+#define SLAB_KEEP_EMPTY 1
+
+/*
+ * Header at the start of a slab.
+ */
+struct Slab {
+    struct Slab_Cache* cache;
+    void* freeList;		/* first free object in the slab */
+    ulong_t inUse;		/* number of objects allocated */
+
+    DEFINE_LINK(Slab_List, Slab);
+};
+
+#define SLAB_HEADER_SIZE ((sizeof(struct Slab) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+IMPLEMENT_LIST(Slab_List, Slab);
+IMPLEMENT_LIST(Slab_Cache_List, Slab_Cache);
+
+/* Every cache that has been used, for statistics */
+static struct Slab_Cache_List s_cacheList;
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Get the location of the free link of given object.
+ */
+static __inline__ void** Free_Link(struct Slab_Cache* cache, void* obj)
+{
+    return (void**) ((char*) obj + cache->bufSize - sizeof(void*));
+}
+
+/*
+ * Work out the layout of slabs for a cache on its first use.
+ * Must be called with interrupts disabled!
+ */
+static void Set_Up_Cache(struct Slab_Cache* cache)
+{
+    ulong_t space;
+    int order = 0;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(cache->objSize > 0);
+
+    cache->bufSize = (cache->objSize + sizeof(void*) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    for (;;) {
+	space = (PAGE_SIZE << order) - SLAB_HEADER_SIZE;
+	if (space / cache->bufSize >= SLAB_MIN_OBJS || order == SLAB_MAX_ORDER)
+	    break;
+	++order;
+    }
+    cache->order = order;
+    cache->objsPerSlab = space / cache->bufSize;
+    KASSERT(cache->objsPerSlab > 0);
+
+    strncpy(cache->stats.name, cache->name, SLAB_NAME_LEN);
+    cache->stats.name[SLAB_NAME_LEN] = '\0';
+    cache->stats.objSize = cache->objSize;
+    cache->stats.objsPerSlab = cache->objsPerSlab;
+    cache->stats.pagesPerSlab = 1 << order;
+
+    Add_To_Back_Of_Slab_Cache_List(&s_cacheList, cache);
+}
+
+/*
+ * Take a new slab from the page allocator and construct its objects.
+ * Returns the slab, or null if there is no memory for it.
+ * Must be called with interrupts disabled!
+ */
+static struct Slab* Grow_Cache(struct Slab_Cache* cache)
+{
+    struct Slab* slab;
+    char* obj;
+    ulong_t i;
+
+    slab = (struct Slab*) Alloc_Pages(cache->order);
+    if (slab == 0)
+	return 0;
+
+    slab->cache = cache;
+    slab->freeList = 0;
+    slab->inUse = 0;
+
+    /* Build the free list backwards, so objects are handed out in address order */
+    obj = (char*) slab + SLAB_HEADER_SIZE + (cache->objsPerSlab - 1) * cache->bufSize;
+    for (i = 0; i < cache->objsPerSlab; ++i) {
+	if (cache->ctor != 0)
+	    cache->ctor(obj);
+	*Free_Link(cache, obj) = slab->freeList;
+	slab->freeList = obj;
+	obj -= cache->bufSize;
+    }
+
+    Add_To_Back_Of_Slab_List(&cache->freeSlabs, slab);
+    ++cache->numEmptySlabs;
+    ++cache->stats.numSlabs;
+    ++cache->stats.numGrows;
+
+    return slab;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Allocate an object from given cache.  If the cache has a
+ * constructor, the object is in its constructed state.
+ * Returns null if there is not enough memory.
+ */
+void* Slab_Alloc(struct Slab_Cache* cache)
+{
+    struct Slab* slab;
+    void *obj = 0;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+
+    if (cache->bufSize == 0)
+	Set_Up_Cache(cache);
+
+    /* Partly used slabs are at the front */
+    slab = Get_Front_Of_Slab_List(&cache->freeSlabs);
+    if (slab == 0)
+	slab = Grow_Cache(cache);
+
+    if (slab != 0) {
+	obj = slab->freeList;
+	slab->freeList = *Free_Link(cache, obj);
+	if (slab->inUse++ == 0)
+	    --cache->numEmptySlabs;
+	if (slab->freeList == 0) {
+	    Remove_From_Slab_List(&cache->freeSlabs, slab);
+	    Add_To_Back_Of_Slab_List(&cache->fullSlabs, slab);
+	}
+
+	++cache->stats.numAllocs;
+	if (++cache->stats.inUse > cache->stats.maxInUse)
+	    cache->stats.maxInUse = cache->stats.inUse;
+    }
+
+    End_Int_Atomic(iflag);
+
+    return obj;
+}
+
+/*
+ * Give an object back to the cache it was allocated from.
+ * If the cache has a constructor, the object must be back
+ * in its constructed state.
+ */
+void Slab_Free(struct Slab_Cache* cache, void* obj)
+{
+    struct Slab* slab;
+    bool iflag;
+
+    slab = (struct Slab*) ((ulong_t) obj & ~((PAGE_SIZE << cache->order) - 1));
+    KASSERT(slab->cache == cache);
+    KASSERT(((char*) obj - (char*) slab - SLAB_HEADER_SIZE) % cache->bufSize == 0);
+
+    iflag = Begin_Int_Atomic();
+
+    KASSERT(slab->inUse > 0);
+
+    if (slab->freeList == 0) {
+	Remove_From_Slab_List(&cache->fullSlabs, slab);
+	Add_To_Front_Of_Slab_List(&cache->freeSlabs, slab);
+    }
+    *Free_Link(cache, obj) = slab->freeList;
+    slab->freeList = obj;
+
+    ++cache->stats.numFrees;
+    --cache->stats.inUse;
+
+    if (--slab->inUse == 0) {
+	Remove_From_Slab_List(&cache->freeSlabs, slab);
+	if (cache->numEmptySlabs < SLAB_KEEP_EMPTY) {
+	    Add_To_Back_Of_Slab_List(&cache->freeSlabs, slab);
+	    ++cache->numEmptySlabs;
+	} else {
+	    Free_Pages(slab, cache->order);
+	    --cache->stats.numSlabs;
+	    ++cache->stats.numShrinks;
+	}
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Get the usage statistics of a slab cache.  Caches are numbered
+ * from 0 in the order they were first used.
+ * Returns 0 if successful, or ENOTFOUND if there is no such cache.
+ */
+int Get_Slab_Stats(int index, struct Slab_Stats* stats)
+{
+    struct Slab_Cache* cache;
+    int rc = ENOTFOUND;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    cache = index < 0 ? 0 : Get_Front_Of_Slab_Cache_List(&s_cacheList);
+    while (cache != 0 && index-- > 0)
+	cache = Get_Next_In_Slab_Cache_List(cache);
+    if (cache != 0) {
+	*stats = cache->stats;
+	rc = 0;
+    }
+    End_Int_Atomic(iflag);
+
+    return rc;
+}
@@ -21,16 +21,122 @@
  *   concurrent execution of interrupt handlers.  Mutexes and
  *   condition variables should only be used from kernel threads,
  *   with interrupts enabled.
+ * - Mutexes implement priority inheritance.  A thread blocking on
+ *   a mutex lends its priority and its run queue level to the owner,
+ *   and on down the chain of owners if the owner is itself blocked
+ *   on another mutex.  The scheduler picks threads by run queue
+ *   level, so it is the level that gets a low level owner run ahead
+ *   of the threads keeping it off the CPU.  A thread gives both back
+ *   when it unlocks the mutex.
+ * - The level lending has not been run: this project's kernel does not
+ *   schedule threads until Get_Next_Runnable() and Init_VM() are
+ *   written, and no user program can hold a kernel mutex, so there is
+ *   no test for it yet.  Check it with three kernel threads at levels
+ *   0, 1 and 2 once the kernel boots: the level 2 owner of a mutex the
+ *   level 0 thread waits for must unlock it before the CPU bound level
+ *   1 thread runs.
  */
 
 /* ----------------------------------------------------------------------
  * Private functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Return the greater of given priority and the priority
+ * of the highest priority thread waiting for given mutex.
+ */
+static int Max_Waiter_Priority(struct Mutex* mutex, int priority)
+{
+    struct Kernel_Thread* kthread = Get_Front_Of_Thread_Queue(&mutex->waitQueue);
+
+    while (kthread != 0) {
+	if (kthread->priority > priority)
+	    priority = kthread->priority;
+	kthread = Get_Next_In_Thread_Queue(kthread);
+    }
+    return priority;
+}
+
+/*
+ * Return the lesser of given run queue level and the level
+ * of the highest level thread waiting for given mutex.
+ */
+static int Min_Waiter_Level(struct Mutex* mutex, int level)
+{
+    struct Kernel_Thread* kthread = Get_Front_Of_Thread_Queue(&mutex->waitQueue);
+
+    while (kthread != 0) {
+	if (kthread->currentReadyQueue < level)
+	    level = kthread->currentReadyQueue;
+	kthread = Get_Next_In_Thread_Queue(kthread);
+    }
+    return level;
+}
+
+/*
+ * Lend given run queue level to given thread, if it is higher
+ * (numerically lower) than the level the thread is at.
+ * Must be called with interrupts disabled!
+ */
+static void Lend_Ready_Queue(struct Kernel_Thread* kthread, int level)
+{
+    if (level >= kthread->currentReadyQueue)
+	return;
+    if (kthread->baseReadyQueue < 0)
+	kthread->baseReadyQueue = kthread->currentReadyQueue;
+    Set_Ready_Queue(kthread, level);
+}
+
+/*
+ * Recompute the effective priority and run queue level of given
+ * thread from its own and the waiters on the mutexes it still holds.
+ * Must be called with interrupts disabled!
+ */
+static void Recompute_Priority(struct Kernel_Thread* kthread)
+{
+    struct Mutex* held;
+    int priority = kthread->basePriority;
+    int ownLevel = kthread->baseReadyQueue >= 0 ? kthread->baseReadyQueue : kthread->currentReadyQueue;
+    int level = ownLevel;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (held = kthread->heldMutexes; held != 0; held = held->nextHeld) {
+	priority = Max_Waiter_Priority(held, priority);
+	level = Min_Waiter_Level(held, level);
+    }
+    kthread->priority = priority;
+    kthread->baseReadyQueue = level < ownLevel ? ownLevel : -1;
+    Set_Ready_Queue(kthread, level);
+}
+
+/*
+ * Lend given priority and run queue level to the owner of given
+ * mutex, and transitively to the owner of whatever mutex that owner
+ * is blocked on.  Stops as soon as an owner already runs at least
+ * that priority and level, so the walk also terminates if the owners
+ * are deadlocked.
+ * Must be called with interrupts disabled!
+ */
+static void Propagate_Priority(struct Mutex* mutex, int priority, int level)
+{
+    struct Kernel_Thread* owner;
+
+    KASSERT(!Interrupts_Enabled());
+
+    while (mutex != 0 && (owner = mutex->owner) != 0 &&
+	   (owner->priority < priority || owner->currentReadyQueue > level)) {
+	if (owner->priority < priority)
+	    owner->priority = priority;
+	Lend_Ready_Queue(owner, level);
+	mutex = owner->waitingOn;
+    }
+}
+
 /*
  * The mutex is currently locked.
- * Atomically reenable preemption and wait in the
- * mutex's wait queue.
+ * Lend our priority to its owner, then atomically reenable
+ * preemption and wait in the mutex's wait queue.
  */
 static void Mutex_Wait(struct Mutex *mutex)
 {
@@ -38,10 +144,14 @@ static void Mutex_Wait(struct Mutex *mutex)
     KASSERT(g_preemptionDisabled);
 
     Disable_Interrupts();
+    g_currentThread->waitingOn = mutex;
+    Propagate_Priority(mutex, g_currentThread->priority, g_currentThread->currentReadyQueue);
     g_preemptionDisabled = false;
     Wait(&mutex->waitQueue);
     g_preemptionDisabled = true;
     Enable_Interrupts();
+
+    g_currentThread->waitingOn = 0;
 }
 
 /*
@@ -63,6 +173,13 @@ static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
     /* Now it's ours! */
     mutex->state = MUTEX_LOCKED;
     mutex->owner = g_currentThread;
+    mutex->nextHeld = g_currentThread->heldMutexes;
+    g_currentThread->heldMutexes = mutex;
+
+    /* Inherit the priority and level of any threads still waiting. */
+    Disable_Interrupts();
+    Recompute_Priority(g_currentThread);
+    Enable_Interrupts();
 }
 
 /*
@@ -71,6 +188,8 @@ static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
  */
 static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
 {
+    struct Mutex** link;
+
     KASSERT(g_preemptionDisabled);
 
     /* Make sure mutex was actually acquired by this thread. */
@@ -81,17 +200,25 @@ static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
     mutex->owner = 0;
 
     /*
-     * If there are threads waiting to acquire the mutex,
-     * wake one of them up.  Note that it is legal to inspect
-     * the queue with interrupts enabled because preemption
-     * is disabled, and therefore we know that no thread can
-     * concurrently add itself to the queue.
+     * Drop it from our list of held mutexes (usually the head,
+     * since locks tend to be released in reverse order), and
+     * give back any priority inherited through it.
      */
-    if (!Is_Thread_Queue_Empty(&mutex->waitQueue)) {
-	Disable_Interrupts();
-	Wake_Up_One(&mutex->waitQueue);
-	Enable_Interrupts();
-    }
+    for (link = &g_currentThread->heldMutexes; *link != mutex; link = &(*link)->nextHeld)
+	KASSERT(*link != 0);
+    *link = mutex->nextHeld;
+    mutex->nextHeld = 0;
+
+    /*
+     * Drop back to our own priority and level, and if there are
+     * threads waiting to acquire the mutex, wake one of them up.
+     * Interrupts are disabled, since this may move us between
+     * run queues.
+     */
+    Disable_Interrupts();
+    Recompute_Priority(g_currentThread);
+    Wake_Up_One(&mutex->waitQueue);
+    Enable_Interrupts();
 }
 
 /* ----------------------------------------------------------------------
@@ -106,6 +233,7 @@ void Mutex_Init(struct Mutex* mutex)
     mutex->state = MUTEX_UNLOCKED;
     mutex->owner = 0;
     Clear_Thread_Queue(&mutex->waitQueue);
+    mutex->nextHeld = 0;
 }
 
 /*
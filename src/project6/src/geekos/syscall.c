@@ -20,6 +20,9 @@
 #include <geekos/user.h>
 #include <geekos/timer.h>
 #include <geekos/vfs.h>
+#include <geekos/futex.h>
+#include <geekos/pagestat.h>
+#include <geekos/slab.h>
 
 /*
  * Null system call.
@@ -443,6 +446,101 @@ static int Sys_CreatePipe(struct Interrupt_State *state)
     TODO("CreatePipe system call");
 }
 
+/*
+ * Suspend the current process for some time.
+ * Params:
+ *   state->ebx - number of milliseconds to sleep
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_Sleep(struct Interrupt_State* state)
+{
+    int ms = state->ebx;
+    int ticks;
+
+    if (ms < 0)
+	return EINVALID;
+
+    /*
+     * Round up, and add a tick for the part of the current tick that
+     * has already gone by, so the process sleeps at least as long as
+     * asked.
+     */
+    if (ms == 0)
+	return 0;
+    ticks = (ms / 1000) * TICKS_PER_SEC + ((ms % 1000) * TICKS_PER_SEC + 999) / 1000 + 1;
+
+    return Sleep(ticks);
+}
+
+/*
+ * Wait on a futex, if it holds the expected value.
+ * Params:
+ *   state->ebx - user address of the futex word
+ *   state->ecx - the value it is expected to hold
+ *
+ * Returns: 0 when woken up, EAGAIN if the word did not hold
+ *   the expected value, other error code (< 0) if unsuccessful
+ */
+static int Sys_FutexWait(struct Interrupt_State* state)
+{
+    return Futex_Wait(state->ebx, state->ecx);
+}
+
+/*
+ * Wake threads waiting on a futex.
+ * Params:
+ *   state->ebx - user address of the futex word
+ *   state->ecx - largest number of threads to wake
+ *
+ * Returns: the number of threads woken, or error code (< 0)
+ *   if unsuccessful
+ */
+static int Sys_FutexWake(struct Interrupt_State* state)
+{
+    if ((int) state->ecx < 0)
+	return EINVALID;
+    return Futex_Wake(state->ebx, state->ecx);
+}
+
+/*
+ * Get statistics on free physical memory.
+ * Params:
+ *   state->ebx - user pointer of struct Page_Stats to fill in
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_PageStat(struct Interrupt_State* state)
+{
+    struct Page_Stats stats;
+
+    Get_Page_Stats(&stats);
+    if (!Copy_To_User(state->ebx, &stats, sizeof(stats)))
+	return EINVALID;
+    return 0;
+}
+
+/*
+ * Get usage statistics of a kernel slab cache.
+ * Params:
+ *   state->ebx - index of the cache, from 0
+ *   state->ecx - user pointer of struct Slab_Stats to fill in
+ *
+ * Returns: 0 if successful, ENOTFOUND if there is no such cache,
+ *   or another error code (< 0) if unsuccessful
+ */
+static int Sys_SlabStat(struct Interrupt_State* state)
+{
+    struct Slab_Stats stats;
+    int rc;
+
+    rc = Get_Slab_Stats((int) state->ebx, &stats);
+    if (rc != 0)
+	return rc;
+    if (!Copy_To_User(state->ecx, &stats, sizeof(stats)))
+	return EINVALID;
+    return 0;
+}
+
 
 /*
  * Global table of system call handler functions.
@@ -482,6 +580,11 @@ const Syscall g_syscallTable[] = {
     Sys_Format,
     /* Pipe system calls. */
     Sys_CreatePipe,
+    Sys_Sleep,
+    Sys_FutexWait,
+    Sys_FutexWake,
+    Sys_PageStat,
+    Sys_SlabStat,
 };
 
 /*
@@ -13,14 +13,71 @@
 #include <geekos/int.h>
 #include <geekos/irq.h>
 #include <geekos/kthread.h>
+#include <geekos/errno.h>
+#include <geekos/malloc.h>
+#include <geekos/list.h>
 #include <geekos/timer.h>
 
-#define MAX_TIMER_EVENTS	100
+/*
+ * Pending timer events are kept in a hierarchical timing wheel.
+ * The root level has one slot per tick for the next TW_ROOT_SIZE
+ * ticks, and each slot of an upper level covers one whole revolution
+ * of the level below it.  Whenever a level wraps around, the next slot
+ * of the level above is cascaded down, so starting, cancelling and
+ * expiring an event are all constant time, and an event is moved at
+ * most TW_NUM_LEVELS-1 times during its life.
+ */
+#define TW_ROOT_BITS	8
+#define TW_LEVEL_BITS	6
+#define TW_ROOT_SIZE	(1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE	(1 << TW_LEVEL_BITS)
+#define TW_ROOT_MASK	(TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK	(TW_LEVEL_SIZE - 1)
+#define TW_NUM_LEVELS	4	/* root plus three upper levels */
+#define TW_MAX_DELTA	(1UL << (TW_ROOT_BITS + (TW_NUM_LEVELS-1)*TW_LEVEL_BITS))
+
+/*
+ * Events are also hashed by id so Cancel_Timer() and
+ * Get_Remaing_Timer_Ticks() don't have to search for them.
+ * The hash table doubles when it gets more events than buckets.
+ */
+#define TIMER_HASH_MIN_BUCKETS	64
+
+struct Timer_Event;
+DEFINE_LIST(Timer_Wheel_Slot, Timer_Event);
+DEFINE_LIST(Timer_Id_Bucket, Timer_Event);
+
+struct Timer_Event {
+    ulong_t expires;			 /* wheel time at which the event fires */
+    int id;				 /* unique id for this timer event */
+    timerCallback callBack;		 /* function to call on timer expire */
+    struct Thread_Queue* waitQueue;	 /* queue to wake up if no callBack */
+    int origTicks;
+    struct Timer_Wheel_Slot* slot;	 /* wheel slot holding the event */
+    DEFINE_LINK(Timer_Wheel_Slot, Timer_Event);
+    DEFINE_LINK(Timer_Id_Bucket, Timer_Event);
+};
+
+IMPLEMENT_LIST(Timer_Wheel_Slot, Timer_Event);
+IMPLEMENT_LIST(Timer_Id_Bucket, Timer_Event);
 
 static int timerDebug = 0;
-static int timeEventCount;
+static uint_t timeEventCount;
 static int nextEventID;
-timerEvent pendingTimerEvents[MAX_TIMER_EVENTS];
+
+/*
+ * The wheel.  s_wheelTime is the last tick that was processed.
+ */
+static struct Timer_Wheel_Slot s_rootWheel[TW_ROOT_SIZE];
+static struct Timer_Wheel_Slot s_upperWheel[TW_NUM_LEVELS-1][TW_LEVEL_SIZE];
+static ulong_t s_wheelTime;
+
+/*
+ * Hash table of pending events, indexed by event id.
+ */
+static struct Timer_Id_Bucket s_initialIdBuckets[TIMER_HASH_MIN_BUCKETS];
+static struct Timer_Id_Bucket* s_idBuckets = s_initialIdBuckets;
+static uint_t s_numIdBuckets = TIMER_HASH_MIN_BUCKETS;
 
 /*
  * Global tick counter
@@ -49,10 +106,27 @@ static int s_spinCountPerTick;
 int g_Quantum = DEFAULT_MAX_TICKS;
 
 /*
- * Ticks per second.
- * FIXME: should set this to something more reasonable, like 100.
+ * The PIT input clock, and the count that gives
+ * TICKS_PER_SEC interrupts per second.
  */
-#define TICKS_PER_SEC 18
+#define PIT_FREQ	1193182
+#define PIT_DIVISOR	((PIT_FREQ + TICKS_PER_SEC/2) / TICKS_PER_SEC)
+#define PIT_MAX_COUNT	65535
+
+#if PIT_DIVISOR > 65536
+#  error "TICKS_PER_SEC is too low for the PIT"
+#endif
+
+#ifdef DYNAMIC_TICK
+/*
+ * Dynamic tick support.  While the idle thread halts the CPU,
+ * the PIT is switched to one-shot mode so it fires when the next
+ * timer event is due (or as late as its 16 bit counter allows)
+ * instead of on every tick.  This is the number of ticks covered
+ * by the one-shot count, or zero while the periodic tick runs.
+ */
+static ulong_t s_stoppedTicks;
+#endif
 
 /*#define DEBUG_TIMER */
 #ifdef DEBUG_TIMER
@@ -65,27 +139,275 @@ int g_Quantum = DEFAULT_MAX_TICKS;
  * Private functions
  * ---------------------------------------------------------------------- */
 
+static __inline__ struct Timer_Id_Bucket* Get_Id_Bucket(int id)
+{
+    return &s_idBuckets[(uint_t) id & (s_numIdBuckets - 1)];
+}
+
+/*
+ * Find the pending event with given id.
+ * Returns null if there is no such event.
+ */
+static struct Timer_Event* Lookup_Timer_Event(int id)
+{
+    struct Timer_Event* event = Get_Front_Of_Timer_Id_Bucket(Get_Id_Bucket(id));
+
+    while (event != 0 && event->id != id)
+	event = Get_Next_In_Timer_Id_Bucket(event);
+    return event;
+}
+
+/*
+ * Double the number of id hash buckets.
+ * If there isn't enough memory the table is left as it is,
+ * which only makes the chains longer.
+ */
+static void Grow_Id_Table(void)
+{
+    uint_t numBuckets = s_numIdBuckets * 2;
+    struct Timer_Id_Bucket* buckets, *oldBuckets = s_idBuckets;
+    uint_t oldNumBuckets = s_numIdBuckets;
+    uint_t i;
+
+    buckets = Malloc(numBuckets * sizeof(struct Timer_Id_Bucket));
+    if (buckets == 0)
+	return;
+    for (i = 0; i < numBuckets; i++)
+	Clear_Timer_Id_Bucket(&buckets[i]);
+
+    s_idBuckets = buckets;
+    s_numIdBuckets = numBuckets;
+    for (i = 0; i < oldNumBuckets; i++) {
+	while (!Is_Timer_Id_Bucket_Empty(&oldBuckets[i])) {
+	    struct Timer_Event* event = Remove_From_Front_Of_Timer_Id_Bucket(&oldBuckets[i]);
+	    Add_To_Back_Of_Timer_Id_Bucket(Get_Id_Bucket(event->id), event);
+	}
+    }
+
+    if (oldBuckets != s_initialIdBuckets)
+	Free(oldBuckets);
+}
+
+/*
+ * Put an event in the wheel slot matching its expiration time.
+ * Events too far in the future go in the last slot of the top
+ * level, and are placed again when that slot is cascaded.
+ */
+static void Add_To_Wheel(struct Timer_Event* event)
+{
+    ulong_t expires = event->expires;
+    long delta = (long) (expires - s_wheelTime);
+    struct Timer_Wheel_Slot* slot;
+    int level, shift;
+
+    if (delta < TW_ROOT_SIZE) {
+	/* Events that are already due go in the slot being processed */
+	if (delta < 0)
+	    expires = s_wheelTime;
+	slot = &s_rootWheel[expires & TW_ROOT_MASK];
+    } else {
+	if ((ulong_t) delta >= TW_MAX_DELTA)
+	    expires = s_wheelTime + TW_MAX_DELTA - 1;
+	level = 0;
+	shift = TW_ROOT_BITS + TW_LEVEL_BITS;
+	while (level < TW_NUM_LEVELS-2 && (expires - s_wheelTime) >= (1UL << shift)) {
+	    ++level;
+	    shift += TW_LEVEL_BITS;
+	}
+	slot = &s_upperWheel[level][(expires >> (shift - TW_LEVEL_BITS)) & TW_LEVEL_MASK];
+    }
+
+    event->slot = slot;
+    Add_To_Back_Of_Timer_Wheel_Slot(slot, event);
+}
+
+/*
+ * Move every event in given upper level slot
+ * down to the level(s) below.
+ */
+static void Cascade_Slot(struct Timer_Wheel_Slot* slot)
+{
+    struct Timer_Wheel_Slot events = *slot;
+
+    Clear_Timer_Wheel_Slot(slot);
+    while (!Is_Timer_Wheel_Slot_Empty(&events))
+	Add_To_Wheel(Remove_From_Front_Of_Timer_Wheel_Slot(&events));
+}
+
+/*
+ * Unlink and free a pending event.
+ */
+static void Destroy_Timer_Event(struct Timer_Event* event)
+{
+    Remove_From_Timer_Wheel_Slot(event->slot, event);
+    Remove_From_Timer_Id_Bucket(Get_Id_Bucket(event->id), event);
+    --timeEventCount;
+    Free(event);
+}
+
+/*
+ * Advance the wheel by one tick, and fire every event
+ * that expires on it.  Called with interrupts disabled.
+ */
+static void Run_Timer_Wheel(void)
+{
+    struct Timer_Wheel_Slot* slot;
+    struct Timer_Event* event;
+    int level;
+    ulong_t index;
+
+    ++s_wheelTime;
+
+    /* Each time a level wraps around, cascade the next slot above it */
+    index = s_wheelTime & TW_ROOT_MASK;
+    for (level = 0; index == 0 && level < TW_NUM_LEVELS-1; level++) {
+	index = (s_wheelTime >> (TW_ROOT_BITS + level*TW_LEVEL_BITS)) & TW_LEVEL_MASK;
+	Cascade_Slot(&s_upperWheel[level][index]);
+    }
+
+    /*
+     * Fire the events one at a time, since a callback may start
+     * or cancel other timers.  New events always expire in a later
+     * tick, so they never land in this slot.
+     */
+    slot = &s_rootWheel[s_wheelTime & TW_ROOT_MASK];
+    while ((event = Get_Front_Of_Timer_Wheel_Slot(slot)) != 0) {
+	int id = event->id;
+	timerCallback callBack = event->callBack;
+	struct Thread_Queue* waitQueue = event->waitQueue;
+
+	if (timerDebug) Print("timer: event %d expired (%d ticks)\n",
+	    id, event->origTicks);
+	Destroy_Timer_Event(event);
+	if (callBack != 0)
+	    callBack(id);
+	else
+	    Wake_Up(waitQueue);
+    }
+}
+
+/*
+ * Program PIT channel 0 to interrupt every tick.
+ */
+static void Set_Periodic_Tick(void)
+{
+    Out_Byte(0x43, 0x36);
+    Out_Byte(0x40, PIT_DIVISOR & 0xff);
+    Out_Byte(0x40, (PIT_DIVISOR >> 8) & 0xff);
+}
+
+#ifdef DYNAMIC_TICK
+/*
+ * Program PIT channel 0 to interrupt once,
+ * after given number of PIT clock cycles.
+ */
+static void Set_One_Shot(ulong_t count)
+{
+    KASSERT(count > 0 && count <= PIT_MAX_COUNT);
+    Out_Byte(0x43, 0x30);
+    Out_Byte(0x40, count & 0xff);
+    Out_Byte(0x40, (count >> 8) & 0xff);
+}
+
+/*
+ * Read the current count of PIT channel 0.
+ */
+static ulong_t Read_PIT_Count(void)
+{
+    ulong_t lo, hi;
+
+    Out_Byte(0x43, 0x00);  /* latch channel 0 */
+    lo = In_Byte(0x40);
+    hi = In_Byte(0x40);
+    return lo | (hi << 8);
+}
+
+/*
+ * Get the number of ticks until the timer wheel next needs
+ * attention, looking no further than maxTicks ahead.
+ * The search stops at the next wrap of the root wheel,
+ * because that is when upper level events are cascaded.
+ */
+static ulong_t Ticks_To_Next_Event(ulong_t maxTicks)
+{
+    ulong_t ticks;
+
+    for (ticks = 1; ticks < maxTicks; ticks++) {
+	ulong_t index = (s_wheelTime + ticks) & TW_ROOT_MASK;
+	if (index == 0 || !Is_Timer_Wheel_Slot_Empty(&s_rootWheel[index]))
+	    break;
+    }
+    return ticks;
+}
+
+/*
+ * Account for ticks that passed while the periodic tick was stopped.
+ */
+static void Catch_Up_Ticks(ulong_t ticks)
+{
+    while (ticks-- > 0) {
+	++g_numTicks;
+	Run_Timer_Wheel();
+    }
+}
+#endif
+
+/*
+ * Add a one-shot event that fires after given number of ticks
+ * (at least one), either calling callBack or, if it is null,
+ * waking up the threads in waitQueue.
+ * Returns the event id, or -1 if there isn't enough memory.
+ */
+static int Add_Timer_Event(int ticks, timerCallback cb, struct Thread_Queue* waitQueue)
+{
+    struct Timer_Event* event;
+
+    KASSERT(!Interrupts_Enabled());
+
+    event = Malloc(sizeof(*event));
+    if (event == 0)
+	return -1;
+
+    if (ticks < 1)
+	ticks = 1;
+
+    event->id = nextEventID++;
+    event->callBack = cb;
+    event->waitQueue = waitQueue;
+    event->origTicks = ticks;
+    event->expires = s_wheelTime + ticks;
+
+    if (++timeEventCount > s_numIdBuckets)
+	Grow_Id_Table();
+    Add_To_Back_Of_Timer_Id_Bucket(Get_Id_Bucket(event->id), event);
+    Add_To_Wheel(event);
+
+    return event->id;
+}
+
 static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 {
-    int i;
     struct Kernel_Thread* current = g_currentThread;
 
     Begin_IRQ(state);
 
+#ifdef DYNAMIC_TICK
+    /* A one-shot interrupt stands for all the ticks it covered */
+    if (s_stoppedTicks != 0) {
+	ulong_t skipped = s_stoppedTicks - 1;
+
+	s_stoppedTicks = 0;
+	Set_Periodic_Tick();
+	Catch_Up_Ticks(skipped);
+    }
+#endif
+
     /* Update global and per-thread number of ticks */
     ++g_numTicks;
     ++current->numTicks;
 
     /* update timer events */
-    for (i=0; i < timeEventCount; i++) {
-	if (pendingTimerEvents[i].ticks == 0) {
-	    if (timerDebug) Print("timer: event %d expired (%d ticks)\n", 
-	        pendingTimerEvents[i].id, pendingTimerEvents[i].origTicks);
-	    (pendingTimerEvents[i].callBack)(pendingTimerEvents[i].id);
-	} else {
-	    pendingTimerEvents[i].ticks--;
-	}
-    }
+    Run_Timer_Wheel();
 
     /*
      * If thread has been running for an entire quantum,
@@ -98,7 +420,11 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 	 * The current process is moved to a lower priority queue,
 	 * since it consumed a full quantum.
 	 */
-        if (current->currentReadyQueue < (MAX_QUEUE_LEVEL - 1)) {
+        if (current->baseReadyQueue >= 0) {
+            /* Running at a level lent through a mutex: demote its own level */
+            if (current->baseReadyQueue < (MAX_QUEUE_LEVEL - 1))
+                current->baseReadyQueue++;
+        } else if (current->currentReadyQueue < (MAX_QUEUE_LEVEL - 1)) {
             /*Print("process %d moved to ready queue %d\n", current->pid, current->currentReadyQueue); */
             current->currentReadyQueue++;
         }
@@ -196,18 +522,10 @@ static void Calibrate_Delay(void)
 
 void Init_Timer(void)
 {
-    /*
-     * TODO: reprogram the timer to set the frequency.
-     * In bochs, it defaults to 18Hz, which is actually pretty
-     * reasonable.
-     */
-
     Print("Initializing timer...\n");
 
-    /* configure for default clock */
-    Out_Byte(0x43, 0x36);
-    Out_Byte(0x40, 0x00);
-    Out_Byte(0x40, 0x00);
+    /* configure for TICKS_PER_SEC interrupts per second */
+    Set_Periodic_Tick();
 
     /* Calibrate for delay loop */
     Calibrate_Delay();
@@ -218,57 +536,131 @@ void Init_Timer(void)
     Enable_IRQ(TIMER_IRQ);
 }
 
+/*
+ * Start a one-shot timer that calls given function, with the
+ * event id as argument, once the given number of ticks
+ * (at least one) have elapsed.  The callback runs in interrupt
+ * context, and the event is gone by the time it is called.
+ * Returns the event id, or -1 if there isn't enough memory.
+ */
 int Start_Timer(int ticks, timerCallback cb)
 {
-    int ret;
+    KASSERT(cb != 0);
+    return Add_Timer_Event(ticks, cb, 0);
+}
+
+int Get_Remaing_Timer_Ticks(int id)
+{
+    struct Timer_Event* event;
 
     KASSERT(!Interrupts_Enabled());
 
-    if (timeEventCount == MAX_TIMER_EVENTS) {
+    event = Lookup_Timer_Event(id);
+    if (event == 0)
 	return -1;
-    } else {
-	ret = nextEventID++;
-	pendingTimerEvents[timeEventCount].id = ret;
-	pendingTimerEvents[timeEventCount].callBack = cb;
-	pendingTimerEvents[timeEventCount].ticks = ticks;
-	pendingTimerEvents[timeEventCount].origTicks = ticks;
-	timeEventCount++;
-
-	return ret;
-    }
+
+    return (int) (event->expires - s_wheelTime);
 }
 
-int Get_Remaing_Timer_Ticks(int id)
+int Cancel_Timer(int id)
 {
-    int i;
+    struct Timer_Event* event;
 
     KASSERT(!Interrupts_Enabled());
-    for (i=0; i < timeEventCount; i++) {
-	if (pendingTimerEvents[i].id == id) {
-	    return pendingTimerEvents[i].ticks;
-	}
+
+    event = Lookup_Timer_Event(id);
+    if (event == 0) {
+	Print("timer: unable to find timer id %d to cancel it\n", id);
+	return -1;
     }
 
-    return -1;
+    Destroy_Timer_Event(event);
+    return 0;
 }
 
-int Cancel_Timer(int id)
+/*
+ * Suspend the current thread until given number of ticks
+ * have elapsed.  The thread blocks on a wait queue that a
+ * timer event wakes up, so it uses no CPU while sleeping.
+ * Returns 0 if successful, ENOMEM if the timer couldn't be started.
+ */
+int Sleep(int ticks)
+{
+    struct Thread_Queue waitQueue;
+    int id;
+    bool iflag;
+
+    if (ticks <= 0)
+	return 0;
+
+    iflag = Begin_Int_Atomic();
+    Clear_Thread_Queue(&waitQueue);
+    id = Add_Timer_Event(ticks, 0, &waitQueue);
+    if (id >= 0)
+	Wait(&waitQueue);
+    End_Int_Atomic(iflag);
+
+    return id >= 0 ? 0 : ENOMEM;
+}
+
+/*
+ * Stop the periodic tick before the CPU is halted.
+ * The PIT is set to interrupt once, when the next timer event is
+ * due, so an idle CPU isn't woken up on every tick.
+ * Called by the idle thread, with interrupts disabled.
+ * Does nothing unless the kernel is built with DYNAMIC_TICK.
+ */
+void Timer_Stop_Tick(void)
 {
-    int i;
+#ifdef DYNAMIC_TICK
+    ulong_t ticks;
+
     KASSERT(!Interrupts_Enabled());
-    for (i=0; i < timeEventCount; i++) {
-	if (pendingTimerEvents[i].id == id) {
-	    pendingTimerEvents[i] = pendingTimerEvents[timeEventCount-1];
-	    timeEventCount--;
-	    return 0;
-	}
+
+    if (s_stoppedTicks != 0)
+	return;
+
+    ticks = Ticks_To_Next_Event(PIT_MAX_COUNT / PIT_DIVISOR);
+    if (ticks <= 1)
+	return;  /* the periodic tick is just as good */
+
+    Set_One_Shot(ticks * PIT_DIVISOR);
+    s_stoppedTicks = ticks;
+#endif
+}
+
+/*
+ * Restart the periodic tick after the CPU was woken up by some
+ * other interrupt than the one-shot timer, accounting for the
+ * ticks that went by while it was stopped.
+ * Called with interrupts disabled.
+ */
+void Timer_Restart_Tick(void)
+{
+#ifdef DYNAMIC_TICK
+    ulong_t count, programmed, elapsed;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (s_stoppedTicks == 0)
+	return;
+
+    count = Read_PIT_Count();
+    programmed = s_stoppedTicks * PIT_DIVISOR;
+    if (count == 0 || count > programmed) {
+	/* Already expired: the pending interrupt counts the last tick */
+	elapsed = s_stoppedTicks - 1;
+    } else {
+	elapsed = (programmed - count) / PIT_DIVISOR;
     }
 
-    Print("timer: unable to find timer id %d to cancel it\n", id);
-    return -1;
+    s_stoppedTicks = 0;
+    Set_Periodic_Tick();
+    Catch_Up_Ticks(elapsed);
+#endif
 }
 
-#define US_PER_TICK (TICKS_PER_SEC * 1000000)
+#define US_PER_TICK (1000000 / TICKS_PER_SEC)
 
 /*
  * Spin for at least given number of microseconds.
@@ -277,16 +669,25 @@ int Cancel_Timer(int id)
  */
 void Micro_Delay(int us)
 {
-    int num = us * s_spinCountPerTick;
+    /*
+     * us * s_spinCountPerTick overflows an int for anything but a
+     * slow CPU, and the kernel has no 64-bit divide, so split both
+     * factors into whole ticks and a remainder below US_PER_TICK.
+     * Only the remainder product is divided, and it always fits.
+     */
     int denom = US_PER_TICK;
+    int wholeTicks = us / denom, partUs = us % denom;
+    int countPerUs = s_spinCountPerTick / denom;
+    int countRem = s_spinCountPerTick % denom;
+    int num = partUs * countRem;
 
-    int numSpins = num / denom;
+    int numSpins = wholeTicks * s_spinCountPerTick + partUs * countPerUs + num / denom;
     int rem = num % denom;
 
     if (rem > 0)
 	++numSpins;
 
-    Debug("Micro_Delay(): num=%d, denom=%d, spin count = %d\n", num, denom, numSpins);
+    Debug("Micro_Delay(): us=%d, denom=%d, spin count = %d\n", us, denom, numSpins);
 
     Spin(numSpins);
 }
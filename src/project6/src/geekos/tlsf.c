@@ -0,0 +1,341 @@
+/*
+ * Two-level segregated fit (TLSF) memory allocator
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+/*
+ * NOTES:
+ * - Allocation and freeing take a bounded number of steps whatever
+ *   the state of the heap: a free block big enough for a request is
+ *   found from the two levels of bitmaps, without searching a list.
+ *   The price is that a request may be given a block from a larger
+ *   class even when a block in its own class would have fit.
+ * - Blocks are kept in address order in each pool, and freed blocks
+ *   are merged with free neighbours straight away.  Each pool ends
+ *   with a used block of size 0, so merging stops there, and its
+ *   first block is flagged, so a pool that is wholly free can be
+ *   recognized and taken out of the heap.
+ * - Like bget.c, this builds outside the kernel (without GEEKOS
+ *   defined), so the allocators can be compared on the host.
+ */
+
+#if defined(GEEKOS)
+
+#include <geekos/kassert.h>
+
+#else  /* defined(GEEKOS) */
+
+#include <assert.h>
+#define KASSERT(exp) assert(exp)
+
+#endif  /* defined(GEEKOS) */
+
+#include <geekos/tlsf.h>
+
+/* ----------------------------------------------------------------------
+ * Private data
+ * ---------------------------------------------------------------------- */
+
+/*
+ * A block of memory in a pool.  The free list links are only
+ * there in free blocks; in used blocks, the data starts there.
+ */
+struct TLSF_Block {
+    struct TLSF_Block* prevPhys;	/* previous block; only valid if it is free */
+    ulong_t size;			/* bytes after the header, and flags */
+    struct TLSF_Block* nextFree;
+    struct TLSF_Block* prevFree;
+};
+
+/* Flags in the low bits of the size of a block */
+#define BLOCK_FREE	1
+#define PREV_FREE	2
+#define POOL_START	4
+#define BLOCK_FLAGS	(TLSF_ALIGN - 1)
+
+#define HEADER_SIZE ((ulong_t) &((struct TLSF_Block*) 0)->nextFree)
+#define MIN_BLOCK_SIZE (sizeof(struct TLSF_Block) - HEADER_SIZE)
+#define MAX_BLOCK_SIZE ((1UL << TLSF_FL_MAX) - TLSF_ALIGN)
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+/* Index of the most significant set bit */
+static __inline__ int Fls(ulong_t x)
+{
+    return sizeof(ulong_t) * 8 - 1 - __builtin_clzl(x);
+}
+
+/* Index of the least significant set bit */
+static __inline__ int Ffs(ulong_t x)
+{
+    return __builtin_ctzl(x);
+}
+
+static __inline__ ulong_t Block_Size(struct TLSF_Block* block)
+{
+    return block->size & ~BLOCK_FLAGS;
+}
+
+static __inline__ void* Block_Data(struct TLSF_Block* block)
+{
+    return (char*) block + HEADER_SIZE;
+}
+
+static __inline__ struct TLSF_Block* Data_Block(void* buf)
+{
+    return (struct TLSF_Block*) ((char*) buf - HEADER_SIZE);
+}
+
+static __inline__ struct TLSF_Block* Next_Phys(struct TLSF_Block* block)
+{
+    return (struct TLSF_Block*) ((char*) Block_Data(block) + Block_Size(block));
+}
+
+/*
+ * Find the size class a block of given size belongs in.
+ */
+static void Mapping_Insert(ulong_t size, int* fl, int* sl)
+{
+    if (size < TLSF_SMALL_SIZE) {
+	*fl = 0;
+	*sl = size / (TLSF_SMALL_SIZE / TLSF_SL_COUNT);
+    } else {
+	int bit = Fls(size);
+	*fl = bit - (TLSF_FL_SHIFT - 1);
+	*sl = (size >> (bit - TLSF_SL_LOG2)) ^ (1 << TLSF_SL_LOG2);
+    }
+}
+
+/*
+ * Find the lowest size class whose blocks are all at least
+ * the given size.
+ */
+static void Mapping_Search(ulong_t size, int* fl, int* sl)
+{
+    if (size >= TLSF_SMALL_SIZE)
+	size += (1UL << (Fls(size) - TLSF_SL_LOG2)) - 1;
+    Mapping_Insert(size, fl, sl);
+}
+
+static void Insert_Free_Block(struct TLSF_Heap* heap, struct TLSF_Block* block)
+{
+    struct TLSF_Block* head;
+    int fl, sl;
+
+    Mapping_Insert(Block_Size(block), &fl, &sl);
+    head = heap->freeLists[fl][sl];
+    block->prevFree = 0;
+    block->nextFree = head;
+    if (head != 0)
+	head->prevFree = block;
+    heap->freeLists[fl][sl] = block;
+    heap->flBitmap |= 1UL << fl;
+    heap->slBitmap[fl] |= 1UL << sl;
+}
+
+static void Remove_Free_Block(struct TLSF_Heap* heap, struct TLSF_Block* block)
+{
+    int fl, sl;
+
+    Mapping_Insert(Block_Size(block), &fl, &sl);
+    if (block->prevFree != 0)
+	block->prevFree->nextFree = block->nextFree;
+    else
+	heap->freeLists[fl][sl] = block->nextFree;
+    if (block->nextFree != 0)
+	block->nextFree->prevFree = block->prevFree;
+
+    if (heap->freeLists[fl][sl] == 0) {
+	heap->slBitmap[fl] &= ~(1UL << sl);
+	if (heap->slBitmap[fl] == 0)
+	    heap->flBitmap &= ~(1UL << fl);
+    }
+}
+
+/*
+ * Find a free block of at least given size, or null if there is none.
+ */
+static struct TLSF_Block* Find_Free_Block(struct TLSF_Heap* heap, ulong_t size)
+{
+    ulong_t map;
+    int fl, sl;
+
+    Mapping_Search(size, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+	return 0;
+
+    map = heap->slBitmap[fl] & (~0UL << sl);
+    if (map == 0) {
+	/* Nothing in this power of 2; take the next one up that has anything */
+	map = fl + 1 < TLSF_FL_COUNT ? heap->flBitmap & (~0UL << (fl + 1)) : 0;
+	if (map == 0)
+	    return 0;
+	fl = Ffs(map);
+	map = heap->slBitmap[fl];
+    }
+    sl = Ffs(map);
+
+    return heap->freeLists[fl][sl];
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Add a region of memory to a heap.  If the region is aligned
+ * to TLSF_ALIGN, the pool starts at its start.
+ */
+void TLSF_Add_Pool(struct TLSF_Heap* heap, void* start, ulong_t size)
+{
+    ulong_t addr = ((ulong_t) start + TLSF_ALIGN - 1) & ~BLOCK_FLAGS;
+    struct TLSF_Block *block, *sentinel;
+
+    size = (size - (addr - (ulong_t) start)) & ~BLOCK_FLAGS;
+    KASSERT(size >= 2 * HEADER_SIZE + MIN_BLOCK_SIZE);
+    KASSERT(size - 2 * HEADER_SIZE <= MAX_BLOCK_SIZE);
+
+    /* One free block spanning the pool, and the sentinel after it */
+    block = (struct TLSF_Block*) addr;
+    block->size = (size - 2 * HEADER_SIZE) | BLOCK_FREE | POOL_START;
+    sentinel = Next_Phys(block);
+    sentinel->prevPhys = block;
+    sentinel->size = PREV_FREE;
+
+    Insert_Free_Block(heap, block);
+}
+
+/*
+ * Allocate a buffer of given size from a heap.
+ * Returns null if there is no free block big enough.
+ */
+void* TLSF_Alloc(struct TLSF_Heap* heap, ulong_t size)
+{
+    struct TLSF_Block *block, *next;
+    ulong_t blockSize;
+
+    if (size == 0 || size > MAX_BLOCK_SIZE)
+	return 0;
+    size = (size + TLSF_ALIGN - 1) & ~BLOCK_FLAGS;
+    if (size < MIN_BLOCK_SIZE)
+	size = MIN_BLOCK_SIZE;
+
+    block = Find_Free_Block(heap, size);
+    if (block == 0)
+	return 0;
+    Remove_Free_Block(heap, block);
+
+    blockSize = Block_Size(block);
+    KASSERT(blockSize >= size);
+    next = Next_Phys(block);
+
+    if (blockSize - size >= HEADER_SIZE + MIN_BLOCK_SIZE) {
+	/* Split off the rest as a free block */
+	struct TLSF_Block* rest = (struct TLSF_Block*) ((char*) Block_Data(block) + size);
+	rest->size = (blockSize - size - HEADER_SIZE) | BLOCK_FREE;
+	rest->prevPhys = block;
+	next->prevPhys = rest;
+	Insert_Free_Block(heap, rest);
+	block->size = size | (block->size & (PREV_FREE | POOL_START));
+    } else {
+	block->size &= ~BLOCK_FREE;
+	next->size &= ~PREV_FREE;
+    }
+
+    return Block_Data(block);
+}
+
+/*
+ * Give a buffer allocated by TLSF_Alloc() back to its heap.
+ * Returns the start of the buffer's pool if nothing in the pool
+ * is allocated any more, or null otherwise.
+ */
+void* TLSF_Free(struct TLSF_Heap* heap, void* buf)
+{
+    struct TLSF_Block *block = Data_Block(buf), *next;
+
+    KASSERT(!(block->size & BLOCK_FREE));
+
+    if (block->size & PREV_FREE) {
+	struct TLSF_Block* prev = block->prevPhys;
+	KASSERT(prev->size & BLOCK_FREE);
+	Remove_Free_Block(heap, prev);
+	prev->size += HEADER_SIZE + Block_Size(block);
+	block = prev;
+    }
+
+    next = Next_Phys(block);
+    if (next->size & BLOCK_FREE) {
+	Remove_Free_Block(heap, next);
+	block->size += HEADER_SIZE + Block_Size(next);
+	next = Next_Phys(block);
+    }
+
+    block->size |= BLOCK_FREE;
+    next->prevPhys = block;
+    next->size |= PREV_FREE;
+    Insert_Free_Block(heap, block);
+
+    return (block->size & POOL_START) && Block_Size(next) == 0 ? block : 0;
+}
+
+/*
+ * Take a pool out of a heap.  Nothing in the pool may be allocated.
+ */
+void TLSF_Remove_Pool(struct TLSF_Heap* heap, void* pool)
+{
+    struct TLSF_Block* block = pool;
+
+    KASSERT(block->size & POOL_START);
+    KASSERT(block->size & BLOCK_FREE);
+    KASSERT(Block_Size(Next_Phys(block)) == 0);
+
+    Remove_Free_Block(heap, block);
+}
+
+/*
+ * Get the size of the smallest pool from which an allocation
+ * of given size is sure to succeed.
+ */
+ulong_t TLSF_Pool_Size(ulong_t size)
+{
+    if (size < MIN_BLOCK_SIZE)
+	size = MIN_BLOCK_SIZE;
+    size = (size + TLSF_ALIGN - 1) & ~BLOCK_FLAGS;
+    if (size >= TLSF_SMALL_SIZE) {
+	/* Up to the first size class whose blocks are all big enough */
+	ulong_t step = 1UL << (Fls(size) - TLSF_SL_LOG2);
+	size = (size + step - 1) & ~(step - 1);
+    }
+    return size + 2 * HEADER_SIZE;
+}
+
+/*
+ * Add up the free space in a heap.  This walks the free lists,
+ * so it is for reporting, not for use on every allocation.
+ */
+void TLSF_Get_Stats(struct TLSF_Heap* heap, struct TLSF_Stats* stats)
+{
+    struct TLSF_Block* block;
+    int fl, sl;
+
+    stats->freeBytes = 0;
+    stats->largestFree = 0;
+    stats->numFreeBlocks = 0;
+
+    for (fl = 0; fl < TLSF_FL_COUNT; ++fl) {
+	for (sl = 0; sl < TLSF_SL_COUNT; ++sl) {
+	    for (block = heap->freeLists[fl][sl]; block != 0; block = block->nextFree) {
+		ulong_t size = Block_Size(block);
+		stats->freeBytes += size;
+		if (size > stats->largestFree)
+		    stats->largestFree = size;
+		++stats->numFreeBlocks;
+	    }
+	}
+    }
+}
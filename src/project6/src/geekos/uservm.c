@@ -23,6 +23,13 @@
  * ---------------------------------------------------------------------- */
 
 // TODO: Add private functions
+
+/*
+ * User addresses are offsets from here; the user code and data
+ * segments start at this linear address.
+ */
+#define USER_VM_START 0x80000000
+
 /* ----------------------------------------------------------------------
  * Public functions
  * ---------------------------------------------------------------------- */
@@ -72,7 +79,8 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
      * - Determine space requirements for code, data, argument block,
      *   and stack
      * - Allocate pages for above, map them into user address
-     *   space (allocating page directory and page tables as needed)
+     *   space (allocating page directory and page tables as needed);
+     *   use Alloc_Zeroed_Page() rather than clearing pages yourself
      * - Fill in initial stack pointer, argument block address,
      *   and code entry point fields in User_Context
      */
@@ -121,6 +129,35 @@ bool Copy_To_User(ulong_t destInUser, void* srcInKernel, ulong_t numBytes)
     TODO("Copy kernel data to user buffer");
 }
 
+/*
+ * Find the physical address of given user address, if its page is
+ * present in memory.  Interrupts must be disabled, or the page
+ * could be stolen as soon as this returns.
+ * Returns true if the page is present, false otherwise.
+ */
+bool User_To_Physical(struct User_Context* context, ulong_t userAddr, ulong_t* paddr)
+{
+    ulong_t vaddr = USER_VM_START + userAddr;
+    pde_t* pde;
+    pte_t* pte;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (userAddr >= USER_VM_START || context->pageDir == 0)
+	return false;
+
+    pde = &context->pageDir[PAGE_DIRECTORY_INDEX(vaddr)];
+    if (!pde->present)
+	return false;
+
+    pte = &((pte_t*) (pde->pageTableBaseAddr << PAGE_POWER))[PAGE_TABLE_INDEX(vaddr)];
+    if (!pte->present)
+	return false;
+
+    *paddr = (pte->pageBaseAddr << PAGE_POWER) | (vaddr & PAGE_MASK);
+    return true;
+}
+
 /*
  * Switch to user address space.
  */
@@ -14,6 +14,7 @@
 #include <geekos/screen.h>
 #include <geekos/malloc.h>
 #include <geekos/synch.h>
+#include <geekos/slab.h>
 #include <geekos/vfs.h>
 
 /*
@@ -60,6 +61,9 @@ static struct Filesystem_List s_filesystemList;
 /* Registered paging device. */
 static struct Paging_Device *s_pagingDevice;
 
+/* File objects of all filesystems. */
+static struct Slab_Cache s_fileCache = SLAB_CACHE_INITIALIZER("file", struct File, 0);
+
 #define MAX_PREFIX_LEN 16
 
 /*
@@ -404,7 +408,7 @@ int Close(struct File *file)
 
     rc = file->ops->Close(file);
     if (rc == 0)
-	Free(file);
+	Free_File(file);
     return rc;
 }
 
@@ -477,7 +481,7 @@ struct File *Allocate_File(struct File_Ops *ops, int filePos, int endPos, void *
 {
     struct File *file;
 
-    file = (struct File *) Malloc(sizeof(struct File));
+    file = (struct File *) Slab_Alloc(&s_fileCache);
     if (file != 0) {
 	file->ops = ops;
 	file->filePos = filePos;
@@ -489,6 +493,16 @@ struct File *Allocate_File(struct File_Ops *ops, int filePos, int endPos, void *
     return file;
 }
 
+/*
+ * Free a File object allocated with Allocate_File().
+ * Filesystems must use this to free a File they could not
+ * hand out; files that were opened are freed by Close().
+ */
+void Free_File(struct File *file)
+{
+    Slab_Free(&s_fileCache, file);
+}
+
 /*
  * Get metadata for given file.
  * Params:
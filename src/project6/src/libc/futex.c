@@ -0,0 +1,159 @@
+/*
+ * Futexes, and mutexes and semaphores built on them
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/syscall.h>
+#include <geekos/errno.h>
+#include <futex.h>
+
+DEF_SYSCALL(Futex_Wait,SYS_FUTEXWAIT,int,(volatile int *addr, int expected),
+    volatile int *arg0 = addr; int arg1 = expected;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Futex_Wake,SYS_FUTEXWAKE,int,(volatile int *addr, int count),
+    volatile int *arg0 = addr; int arg1 = count;,
+    SYSCALL_REGS_2)
+
+/*
+ * Atomically set *addr to newValue if it holds oldValue.
+ * Returns the value *addr held.
+ */
+static __inline__ int Compare_And_Swap(volatile int *addr, int oldValue, int newValue)
+{
+    int prev;
+
+    __asm__ __volatile__ (
+	"lock; cmpxchgl %2, %1"
+	: "=a" (prev), "+m" (*addr)
+	: "r" (newValue), "0" (oldValue)
+	: "memory"
+    );
+    return prev;
+}
+
+/*
+ * Atomically set *addr to value.
+ * Returns the value *addr held.
+ */
+static __inline__ int Exchange(volatile int *addr, int value)
+{
+    __asm__ __volatile__ (
+	"xchgl %0, %1"
+	: "+r" (value), "+m" (*addr)
+	:
+	: "memory"
+    );
+    return value;
+}
+
+/*
+ * Atomically add delta to *addr.
+ * Returns the value *addr held.
+ */
+static __inline__ int Fetch_And_Add(volatile int *addr, int delta)
+{
+    __asm__ __volatile__ (
+	"lock; xaddl %0, %1"
+	: "+r" (delta), "+m" (*addr)
+	:
+	: "memory"
+    );
+    return delta;
+}
+
+/* ----------------------------------------------------------------------
+ * Mutexes
+ *
+ * The state word is 0 when unlocked, 1 when locked, and 2 when locked
+ * with (possibly) sleeping waiters.  Locking an unlocked mutex and
+ * unlocking one nobody waits for are a single atomic instruction.
+ * ---------------------------------------------------------------------- */
+
+void Fast_Mutex_Init(struct Fast_Mutex *mutex)
+{
+    mutex->state = 0;
+}
+
+void Fast_Mutex_Lock(struct Fast_Mutex *mutex)
+{
+    int state = Compare_And_Swap(&mutex->state, 0, 1);
+
+    if (state == 0)
+	return;
+
+    /*
+     * Contended: mark the mutex as having waiters, and sleep until
+     * we are the one to change it from unlocked.  We can't tell if
+     * other waiters remain, so we take it in the "waiters" state.
+     */
+    if (state != 2)
+	state = Exchange(&mutex->state, 2);
+    while (state != 0) {
+	Futex_Wait(&mutex->state, 2);
+	state = Exchange(&mutex->state, 2);
+    }
+}
+
+bool Fast_Mutex_Trylock(struct Fast_Mutex *mutex)
+{
+    return Compare_And_Swap(&mutex->state, 0, 1) == 0;
+}
+
+void Fast_Mutex_Unlock(struct Fast_Mutex *mutex)
+{
+    if (Fetch_And_Add(&mutex->state, -1) != 1) {
+	/* There may be waiters */
+	mutex->state = 0;
+	Futex_Wake(&mutex->state, 1);
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Semaphores
+ *
+ * The count never goes below zero.  P takes a unit with a compare and
+ * swap if there is one; otherwise it sleeps for as long as the count
+ * is still zero.  V only calls the kernel if someone is sleeping.
+ * ---------------------------------------------------------------------- */
+
+void Fast_Sem_Init(struct Fast_Semaphore *sem, int count)
+{
+    sem->count = count;
+    sem->numWaiters = 0;
+}
+
+bool Fast_Sem_Try_P(struct Fast_Semaphore *sem)
+{
+    int count = sem->count;
+
+    while (count > 0) {
+	int prev = Compare_And_Swap(&sem->count, count, count - 1);
+	if (prev == count)
+	    return true;
+	count = prev;
+    }
+    return false;
+}
+
+void Fast_Sem_P(struct Fast_Semaphore *sem)
+{
+    while (!Fast_Sem_Try_P(sem)) {
+	/*
+	 * Announce ourselves before sleeping.  If a V slips in after
+	 * the failed attempt, the count is no longer zero and the
+	 * kernel returns EAGAIN instead of putting us to sleep.
+	 */
+	Fetch_And_Add(&sem->numWaiters, 1);
+	Futex_Wait(&sem->count, 0);
+	Fetch_And_Add(&sem->numWaiters, -1);
+    }
+}
+
+void Fast_Sem_V(struct Fast_Semaphore *sem)
+{
+    Fetch_And_Add(&sem->count, 1);
+    if (sem->numWaiters > 0)
+	Futex_Wake(&sem->count, 1);
+}
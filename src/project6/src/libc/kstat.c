@@ -0,0 +1,16 @@
+/*
+ * Kernel statistics system calls
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/syscall.h>
+#include <kstat.h>
+
+DEF_SYSCALL(Get_Memory_Stats,SYS_PAGESTAT,int,(struct Page_Stats* stats),
+    struct Page_Stats* arg0 = stats;,
+    SYSCALL_REGS_1)
+DEF_SYSCALL(Get_Slab_Cache_Stats,SYS_SLABSTAT,int,(int index, struct Slab_Stats* stats),
+    int arg0 = index; struct Slab_Stats* arg1 = stats;,
+    SYSCALL_REGS_2)
@@ -15,4 +15,4 @@ DEF_SYSCALL(Set_Scheduling_Policy,SYS_SETSCHEDULINGPOLICY,int, (int policy, int
     int arg0 = policy; int arg1 = quantum;,
     SYSCALL_REGS_2)
 DEF_SYSCALL(Get_Time_Of_Day,SYS_GETTIMEOFDAY,int,(void),,SYSCALL_REGS_0)
-
+DEF_SYSCALL(Sleep,SYS_SLEEP,int,(int ms),int arg0 = ms;,SYSCALL_REGS_1)
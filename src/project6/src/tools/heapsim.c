@@ -0,0 +1,367 @@
+/*
+ * Replay a kernel heap trace against the TLSF and bget allocators
+ *
+ * Reads the heap operations recorded by a kernel built with
+ * MALLOC_TRACE=yes (the lines starting with '@' in the Bochs debug
+ * port log), replays them against each allocator on a pool of the
+ * same size as the kernel heap at boot, and reports for each:
+ *   - the time taken by each allocation and free, in TSC cycles,
+ *     as an average, a maximum and a log2 histogram
+ *   - allocations that failed
+ *   - fragmentation when the most memory was in use and at the end:
+ *     the share of free memory outside the largest free block
+ *
+ * usage: heapsim [-s poolsize] tracefile
+ *   -s  replay on a pool of this many bytes instead
+ *
+ * Runs on an x86 host.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <geekos/ktypes.h>
+#include <geekos/bget.h>
+#include <geekos/tlsf.h>
+
+#define HASH_SIZE 65536
+#define HIST_BUCKETS 24
+
+/* One operation of the trace */
+struct Op {
+    char type;			/* 'm' or 'f' */
+    unsigned long size;
+    int slot;			/* which allocation it is */
+};
+
+struct Addr {
+    unsigned long addr;
+    int slot;
+    struct Addr *next;
+};
+
+struct Timing {
+    unsigned long count;
+    unsigned long long cycles;
+    unsigned long maxCycles;
+    unsigned long hist[HIST_BUCKETS];
+};
+
+struct Frag {
+    unsigned long freeBytes;
+    unsigned long largestFree;
+};
+
+/* An allocator to replay the trace against */
+struct Backend {
+    const char *name;
+    void (*init)(void *pool, unsigned long size);
+    void *(*alloc)(unsigned long size);
+    void (*release)(void *buf);
+    void (*frag)(struct Frag *frag);
+};
+
+static struct Op *s_ops;
+static int s_numOps, s_numSlots;
+static unsigned long s_poolSize;
+static struct Addr *s_hash[HASH_SIZE];
+
+/* ----------------------------------------------------------------------
+ * Allocators
+ * ---------------------------------------------------------------------- */
+
+static struct TLSF_Heap s_tlsfHeap;
+
+static void TLSF_Init(void *pool, unsigned long size)
+{
+    TLSF_Add_Pool(&s_tlsfHeap, pool, size);
+}
+
+static void *TLSF_Malloc(unsigned long size)
+{
+    return TLSF_Alloc(&s_tlsfHeap, size);
+}
+
+static void TLSF_Release(void *buf)
+{
+    TLSF_Free(&s_tlsfHeap, buf);
+}
+
+static void TLSF_Frag(struct Frag *frag)
+{
+    struct TLSF_Stats stats;
+
+    TLSF_Get_Stats(&s_tlsfHeap, &stats);
+    frag->freeBytes = stats.freeBytes;
+    frag->largestFree = stats.largestFree;
+}
+
+static void Bget_Init(void *pool, unsigned long size)
+{
+    bpool(pool, size);
+}
+
+static void *Bget_Malloc(unsigned long size)
+{
+    return bget(size);
+}
+
+static void Bget_Release(void *buf)
+{
+    brel(buf);
+}
+
+static void Bget_Frag(struct Frag *frag)
+{
+    bufsize curalloc, totfree, maxfree;
+    long nget, nrel;
+
+    bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+    frag->freeBytes = totfree;
+    frag->largestFree = maxfree;
+}
+
+static struct Backend s_backends[] = {
+    { "tlsf", TLSF_Init, TLSF_Malloc, TLSF_Release, TLSF_Frag },
+    { "bget", Bget_Init, Bget_Malloc, Bget_Release, Bget_Frag },
+};
+
+/* ----------------------------------------------------------------------
+ * Reading the trace
+ * ---------------------------------------------------------------------- */
+
+static struct Addr **Find_Addr(unsigned long addr)
+{
+    struct Addr **p = &s_hash[(addr >> 3) & (HASH_SIZE - 1)];
+
+    while (*p != 0 && (*p)->addr != addr)
+	p = &(*p)->next;
+    return p;
+}
+
+static void Add_Op(char type, unsigned long size, int slot)
+{
+    static int maxOps;
+
+    if (s_numOps == maxOps) {
+	maxOps = maxOps == 0 ? 4096 : maxOps * 2;
+	s_ops = realloc(s_ops, maxOps * sizeof(struct Op));
+	if (s_ops == 0) {
+	    fprintf(stderr, "heapsim: out of memory\n");
+	    exit(1);
+	}
+    }
+    s_ops[s_numOps].type = type;
+    s_ops[s_numOps].size = size;
+    s_ops[s_numOps].slot = slot;
+    ++s_numOps;
+}
+
+/*
+ * Read the trace, giving each allocation a slot number so that
+ * the replay needs no lookups.  Frees of buffers allocated before
+ * the trace started are dropped.
+ */
+static void Read_Trace(FILE *fp)
+{
+    char line[256];
+    unsigned long size, addr;
+    struct Addr **p, *a;
+
+    while (fgets(line, sizeof(line), fp) != 0) {
+	if (line[0] != '@')
+	    continue;
+	switch (line[1]) {
+	case 'p':
+	    /* The pools made at boot; the ones the heap grows by later are not replayed */
+	    if (sscanf(line + 2, "%lx", &size) == 1 && s_numOps == 0)
+		s_poolSize += size;
+	    break;
+
+	case 'm':
+	    if (sscanf(line + 2, "%lx %lx", &size, &addr) != 2)
+		break;
+	    if (addr != 0) {
+		p = Find_Addr(addr);
+		if (*p == 0) {
+		    a = malloc(sizeof(*a));
+		    a->addr = addr;
+		    a->next = 0;
+		    *p = a;
+		}
+		(*p)->slot = s_numSlots;
+	    }
+	    Add_Op('m', size, s_numSlots++);
+	    break;
+
+	case 'f':
+	    if (sscanf(line + 2, "%lx", &addr) != 1)
+		break;
+	    p = Find_Addr(addr);
+	    if (*p != 0) {
+		a = *p;
+		*p = a->next;
+		Add_Op('f', 0, a->slot);
+		free(a);
+	    }
+	    break;
+	}
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Replay
+ * ---------------------------------------------------------------------- */
+
+static __inline__ unsigned long long Read_TSC(void)
+{
+    unsigned int lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long) hi << 32) | lo;
+}
+
+static void Record(struct Timing *t, unsigned long cycles)
+{
+    int bucket = 0;
+
+    ++t->count;
+    t->cycles += cycles;
+    if (cycles > t->maxCycles)
+	t->maxCycles = cycles;
+    while ((cycles >>= 1) != 0 && bucket < HIST_BUCKETS - 1)
+	++bucket;
+    ++t->hist[bucket];
+}
+
+static void Print_Timing(const char *what, struct Timing *t)
+{
+    int i;
+
+    printf("  %-6s %9lu ops, avg %lu, max %lu cycles\n        ", what, t->count,
+	t->count == 0 ? 0 : (unsigned long) (t->cycles / t->count), t->maxCycles);
+    for (i = 0; i < HIST_BUCKETS; ++i) {
+	if (t->hist[i] != 0)
+	    printf(" 2^%d:%lu", i, t->hist[i]);
+    }
+    printf("\n");
+}
+
+static void Print_Frag(const char *when, struct Frag *frag, unsigned long live)
+{
+    printf("  %-6s %9lu bytes live, %lu free, largest free block %lu, fragmentation %lu%%\n",
+	when, live, frag->freeBytes, frag->largestFree,
+	frag->freeBytes == 0 ? 0 : 100 - frag->largestFree * 100 / frag->freeBytes);
+}
+
+static void Replay(struct Backend *b)
+{
+    struct Timing allocs, frees;
+    struct Frag peakFrag, endFrag;
+    unsigned long live = 0, peakLive = 0, failed = 0;
+    unsigned long *sizes;
+    void **bufs, *pool;
+    int i;
+
+    memset(&allocs, 0, sizeof(allocs));
+    memset(&frees, 0, sizeof(frees));
+    memset(&peakFrag, 0, sizeof(peakFrag));
+
+    pool = malloc(s_poolSize);
+    bufs = calloc(s_numSlots + 1, sizeof(void *));
+    sizes = calloc(s_numSlots + 1, sizeof(unsigned long));
+    if (pool == 0 || bufs == 0 || sizes == 0) {
+	fprintf(stderr, "heapsim: out of memory\n");
+	exit(1);
+    }
+    /* Fault them in before timing */
+    memset(pool, 0, s_poolSize);
+    memset(bufs, 0, (s_numSlots + 1) * sizeof(void *));
+    memset(sizes, 0, (s_numSlots + 1) * sizeof(unsigned long));
+    b->init(pool, s_poolSize);
+
+    for (i = 0; i < s_numOps; ++i) {
+	struct Op *op = &s_ops[i];
+	unsigned long long start;
+	void *buf;
+
+	if (op->type == 'm') {
+	    start = Read_TSC();
+	    buf = b->alloc(op->size);
+	    Record(&allocs, (unsigned long) (Read_TSC() - start));
+	    bufs[op->slot] = buf;
+	    if (buf == 0) {
+		++failed;
+		continue;
+	    }
+	    sizes[op->slot] = op->size;
+	    live += op->size;
+	    if (live > peakLive) {
+		peakLive = live;
+		b->frag(&peakFrag);
+	    }
+	} else if (bufs[op->slot] != 0) {
+	    start = Read_TSC();
+	    b->release(bufs[op->slot]);
+	    Record(&frees, (unsigned long) (Read_TSC() - start));
+	    bufs[op->slot] = 0;
+	    live -= sizes[op->slot];
+	}
+    }
+    b->frag(&endFrag);
+
+    printf("%s: %lu allocations failed\n", b->name, failed);
+    Print_Timing("alloc", &allocs);
+    Print_Timing("free", &frees);
+    Print_Frag("peak", &peakFrag, peakLive);
+    Print_Frag("end", &endFrag, live);
+
+    /* The pool stays allocated: bget has no way to give it back */
+    free(bufs);
+    free(sizes);
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: heapsim [-s poolsize] tracefile\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long poolSize = 0;
+    FILE *fp;
+    int arg = 1;
+    unsigned int i;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-s") == 0) {
+	poolSize = strtoul(argv[arg + 1], 0, 0);
+	arg += 2;
+    }
+    if (arg + 1 != argc)
+	Usage();
+
+    fp = fopen(argv[arg], "r");
+    if (fp == 0) {
+	perror(argv[arg]);
+	exit(1);
+    }
+    Read_Trace(fp);
+    fclose(fp);
+
+    if (poolSize != 0)
+	s_poolSize = poolSize;
+    if (s_poolSize == 0) {
+	fprintf(stderr, "heapsim: no pool size in trace; use -s\n");
+	exit(1);
+    }
+
+    printf("%d operations, %lu byte pool\n", s_numOps, s_poolSize);
+    for (i = 0; i < sizeof(s_backends) / sizeof(s_backends[0]); ++i)
+	Replay(&s_backends[i]);
+
+    return 0;
+}
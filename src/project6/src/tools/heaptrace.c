@@ -0,0 +1,224 @@
+/*
+ * Generate a kernel heap trace for heapsim
+ *
+ * Writes a trace in the format a kernel built with MALLOC_TRACE=yes
+ * records (see malloc.c), modelled on what the kernel asks of
+ * Malloc() while it boots and then runs a stream of user processes:
+ *   - at boot, the long-lived tables: the FAT and root directory of
+ *     the boot disk, the boot sector, block device and filesystem
+ *     objects, mount points, the pid table and the timer id table
+ *   - for each process spawned, the buffer its executable is read
+ *     into by Read_Fully(), freed once the program is loaded, and,
+ *     the first time an executable is opened, the PFAT_File and
+ *     valid block set that stay cached for it
+ *   - while a process runs, its FPU save area and thread-local
+ *     data array, if it uses them, and the timer events of the
+ *     Sleep() calls it makes
+ *   - now and then, the pid and timer id tables doubling in size
+ * Several processes are alive at any time, and they exit in a
+ * different order from the one they started in.  Objects the kernel
+ * takes from slab caches or the page allocator are left out.  The
+ * sizes are those of the kernel's structures on i386.
+ *
+ * The trace depends only on the arguments, so a run can be repeated.
+ *
+ * usage: heaptrace [-n spawns] [-s seed] > tracefile
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEAP_POOL_SIZE 0x10000
+#define KERNEL_HEAP_SIZE (1024 * 1024)
+
+#define MAX_LIVE 16		/* processes alive at once, at most */
+#define MAX_EVENTS 4		/* sleeping timer events per process, at most */
+#define NUM_PROGRAMS 12		/* executables on the disk */
+
+/* A process of the model, and the heap buffers it holds */
+struct Process {
+    unsigned long fpuState;
+    unsigned long tlocalData;
+    unsigned long events[MAX_EVENTS];
+    int numEvents;
+    int ticksLeft;
+};
+
+static unsigned long s_seed = 1;
+static unsigned long s_nextAddr = 0x100000;
+
+static struct Process s_live[MAX_LIVE];
+static int s_numLive;
+
+/* Executable sizes, and whether the PFAT_File of each is cached yet */
+static unsigned long s_programSize[NUM_PROGRAMS];
+static int s_programOpened[NUM_PROGRAMS];
+
+static unsigned long s_pidTable, s_pidTableSize = 64 * 8;
+static unsigned long s_timerTable, s_timerTableSize = 64 * 8;
+static int s_numSpawned;
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+/* Pseudo-random number below given bound, the same on every host */
+static unsigned long Random(unsigned long bound)
+{
+    s_seed = s_seed * 1103515245UL + 12345UL;
+    return ((s_seed >> 16) & 0x7fff) * bound / 0x8000;
+}
+
+/*
+ * Record an allocation.  Addresses only have to tell buffers
+ * apart, so each allocation gets a new one.
+ */
+static unsigned long Alloc(unsigned long size)
+{
+    unsigned long addr = s_nextAddr;
+
+    s_nextAddr += (size + 15) & ~15UL;
+    printf("@m %lx %lx\n", size, addr);
+    return addr;
+}
+
+static void Release(unsigned long addr)
+{
+    if (addr != 0)
+	printf("@f %lx\n", addr);
+}
+
+/* A table doubling in size: the new one is allocated before the old one goes */
+static void Grow_Table(unsigned long *table, unsigned long *size)
+{
+    unsigned long old = *table;
+
+    *size *= 2;
+    *table = Alloc(*size);
+    Release(old);
+}
+
+static void Boot(void)
+{
+    unsigned long addr;
+    int i;
+
+    for (addr = 0; addr < KERNEL_HEAP_SIZE; addr += HEAP_POOL_SIZE)
+	printf("@p %x\n", HEAP_POOL_SIZE);
+
+    s_pidTable = Alloc(s_pidTableSize);
+    s_timerTable = Alloc(s_timerTableSize);
+    for (i = 0; i < 4; ++i)
+	Alloc(48);			/* Block_Device */
+    Alloc(64);				/* Filesystem */
+    Alloc(40);				/* Mount_Point */
+    Alloc(512);				/* boot sector, freed after mounting */
+    Release(s_nextAddr - 512);
+    Alloc(9 * 512);			/* FAT */
+    Alloc(224 * 32);			/* root directory */
+    Alloc(32);				/* PFAT_Instance */
+    Alloc(64);				/* FS_Buffer_Cache */
+    Alloc(48);				/* paging device and its file name */
+    Alloc(16);
+
+    for (i = 0; i < NUM_PROGRAMS; ++i)
+	s_programSize[i] = 6000 + Random(40000);
+}
+
+static void Spawn(void)
+{
+    struct Process *proc = &s_live[s_numLive++];
+    int program = Random(NUM_PROGRAMS);
+    unsigned long exe;
+
+    memset(proc, 0, sizeof(*proc));
+
+    if (!s_programOpened[program]) {
+	s_programOpened[program] = 1;
+	Alloc(36);					/* PFAT_File */
+	Alloc(4 + (s_programSize[program] / 512 + 7) / 8);	/* valid block set */
+    }
+    exe = Alloc(s_programSize[program]);
+    Release(exe);
+
+    if (Random(2))
+	proc->fpuState = Alloc(512 + 15);
+    proc->ticksLeft = 5 + Random(200);
+
+    if (++s_numSpawned % 500 == 0 && s_pidTableSize < 4096 * 8)
+	Grow_Table(&s_pidTable, &s_pidTableSize);
+}
+
+static void Exit_Process(int i)
+{
+    struct Process *proc = &s_live[i];
+    int j;
+
+    for (j = 0; j < proc->numEvents; ++j)
+	Release(proc->events[j]);
+    Release(proc->fpuState);
+    Release(proc->tlocalData);
+    s_live[i] = s_live[--s_numLive];
+}
+
+/* One tick's worth of work by the processes alive */
+static void Run(void)
+{
+    int i;
+
+    for (i = 0; i < s_numLive; ++i) {
+	struct Process *proc = &s_live[i];
+
+	if (--proc->ticksLeft <= 0) {
+	    Exit_Process(i--);
+	    continue;
+	}
+	if (proc->tlocalData == 0 && Random(50) == 0)
+	    proc->tlocalData = Alloc(128 * 4);
+	if (proc->numEvents > 0 && Random(3) == 0)
+	    Release(proc->events[--proc->numEvents]);
+	else if (proc->numEvents < MAX_EVENTS && Random(8) == 0)
+	    proc->events[proc->numEvents++] = Alloc(40);
+    }
+    if (Random(1000) == 0 && s_timerTableSize < 1024 * 8)
+	Grow_Table(&s_timerTable, &s_timerTableSize);
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: heaptrace [-n spawns] [-s seed] > tracefile\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int spawns = 20000, arg;
+
+    for (arg = 1; arg < argc; arg += 2) {
+	if (arg + 1 == argc)
+	    Usage();
+	if (strcmp(argv[arg], "-n") == 0)
+	    spawns = atoi(argv[arg + 1]);
+	else if (strcmp(argv[arg], "-s") == 0)
+	    s_seed = strtoul(argv[arg + 1], 0, 0);
+	else
+	    Usage();
+    }
+
+    Boot();
+    while (spawns > 0) {
+	if (s_numLive < MAX_LIVE && Random(4) == 0) {
+	    Spawn();
+	    --spawns;
+	}
+	Run();
+    }
+    while (s_numLive > 0)
+	Run();
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Futex test
+ *
+ * Checks the fast mutex and semaphore, and compares the cost of
+ * uncontended operations on them with that of a system call.
+ * Only the uncontended paths are checked: processes cannot share
+ * memory yet, so nothing can wake a Futex_Wait() that sleeps.
+ *
+ * usage: futextest [iterations]
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+#include <futex.h>
+#include <geekos/errno.h>
+
+static struct Fast_Mutex s_mutex = FAST_MUTEX_INITIALIZER;
+static struct Fast_Semaphore s_sem = FAST_SEMAPHORE_INITIALIZER(1);
+
+static void Check(bool cond, const char *what)
+{
+    if (!cond) {
+	Print("futextest: FAILED: %s\n", what);
+	Exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 100000, i, start, rc;
+    volatile int word = 1;
+
+    if (argc > 1)
+	iterations = atoi(argv[1]);
+
+    /* Waiting on a word that doesn't hold the expected value returns at once */
+    rc = Futex_Wait(&word, 0);
+    Check(rc == EAGAIN, "wait on changed word should return EAGAIN");
+    rc = Futex_Wake(&word, 1);
+    Check(rc == 0, "wake with no waiters should wake nobody");
+    rc = Futex_Wake(&word, -1);
+    Check(rc == EINVALID, "wake of a negative count should fail");
+
+    Fast_Mutex_Lock(&s_mutex);
+    Check(!Fast_Mutex_Trylock(&s_mutex), "trylock of a locked mutex");
+    Fast_Mutex_Unlock(&s_mutex);
+    Check(s_mutex.state == 0, "unlocked mutex state");
+    Check(Fast_Mutex_Trylock(&s_mutex), "trylock of an unlocked mutex");
+    Fast_Mutex_Unlock(&s_mutex);
+
+    Fast_Sem_P(&s_sem);
+    Check(!Fast_Sem_Try_P(&s_sem), "P of a zero semaphore");
+    Fast_Sem_V(&s_sem);
+    Check(s_sem.count == 1, "semaphore count after V");
+
+    Print("futextest: checks passed\n");
+
+    /* Times are in ticks */
+    start = Get_Time_Of_Day();
+    for (i = 0; i < iterations; ++i) {
+	Fast_Mutex_Lock(&s_mutex);
+	Fast_Mutex_Unlock(&s_mutex);
+    }
+    Print("%d mutex lock/unlock pairs: %d ticks\n", iterations, Get_Time_Of_Day() - start);
+
+    start = Get_Time_Of_Day();
+    for (i = 0; i < iterations; ++i) {
+	Fast_Sem_P(&s_sem);
+	Fast_Sem_V(&s_sem);
+    }
+    Print("%d semaphore P/V pairs: %d ticks\n", iterations, Get_Time_Of_Day() - start);
+
+    start = Get_Time_Of_Day();
+    for (i = 0; i < iterations; ++i)
+	Null();
+    Print("%d null system calls: %d ticks\n", iterations, Get_Time_Of_Day() - start);
+
+    return 0;
+}
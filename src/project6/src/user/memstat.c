@@ -0,0 +1,60 @@
+/*
+ * Physical memory statistics
+ *
+ * Prints how much physical memory is free and how much the kernel
+ * heap holds, how the buddy allocator has the free memory split into
+ * blocks, and how fragmented it is: for each block size, the share of
+ * free memory in smaller blocks, which can't be used to allocate a
+ * block of that size.  Then prints the use of each kernel slab cache:
+ * objects in use now and at most, the slabs and pages holding them,
+ * and how often slabs were taken from and given back to the page
+ * allocator.
+ *
+ * usage: memstat
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <kstat.h>
+
+int main(int argc, char **argv)
+{
+    struct Page_Stats stats;
+    struct Slab_Stats slab;
+    ulong_t buddyPages, smaller = 0;
+    int rc, k;
+
+    rc = Get_Memory_Stats(&stats);
+    if (rc < 0) {
+	Print("memstat: %s\n", Get_Error_String(rc));
+	Exit(1);
+    }
+
+    Print("%lu pages of memory, %lu free (%lu of them zeroed), %lu in the kernel heap\n",
+	stats.numPages, stats.freePages, stats.zeroedPages, stats.heapPages);
+    Print("%lu pageable pages: %lu active, %lu inactive\n",
+	stats.activePages + stats.inactivePages, stats.activePages, stats.inactivePages);
+
+    /* Zeroed pages are single pages until they are given back */
+    buddyPages = stats.freePages - stats.zeroedPages;
+
+    Print("order  block KB  free blocks  unusable %%\n");
+    for (k = 0; k < BUDDY_ORDERS; ++k) {
+	Print("%5d %9d %12lu %11lu\n", k, 4 << k, stats.freeBlocks[k],
+	    buddyPages == 0 ? 0 : smaller * 100 / buddyPages);
+	smaller += stats.freeBlocks[k] << k;
+    }
+
+    Print("\n%-16s %5s %5s %6s %6s %6s %6s %9s %9s\n", "cache", "size", "inuse",
+	"max", "slabs", "pages", "grows", "shrinks", "allocs");
+    for (k = 0; Get_Slab_Cache_Stats(k, &slab) == 0; ++k) {
+	Print("%-16s %5lu %5lu %6lu %6lu %6lu %6lu %9lu %9lu\n", slab.name, slab.objSize,
+	    slab.inUse, slab.maxInUse, slab.numSlabs, slab.numSlabs * slab.pagesPerSlab,
+	    slab.numGrows, slab.numShrinks, slab.numAllocs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * sleep - suspend for a given number of milliseconds
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+int main(int argc, char *argv[])
+{
+    int ms;
+    int rc;
+
+    if (argc != 2) {
+	Print("usage: sleep <milliseconds>\n");
+	return 1;
+    }
+
+    ms = atoi(argv[1]);
+    rc = Sleep(ms);
+    if (rc != 0) {
+	Print("Could not sleep: %s\n", Get_Error_String(rc));
+	return 1;
+    }
+
+    return 0;
+}